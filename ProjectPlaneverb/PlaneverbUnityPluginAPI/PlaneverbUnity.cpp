@@ -5,6 +5,37 @@
 #define PVU_CC UNITY_INTERFACE_API
 #define PVU_EXPORT UNITY_INTERFACE_EXPORT
 
+namespace
+{
+	// vertices are x, z pairs, only polygons and segments read them
+	Planeverb::PlaneShape MakeShape(int type, float posX, float posY,
+		float width, float height, float rotation,
+		const float* vertices, int numVertices,
+		float absorption)
+	{
+		Planeverb::PlaneShape shape = {};
+		shape.type = (Planeverb::PlaneShapeType)type;
+		shape.position.x = posX;
+		shape.position.y = posY;
+		shape.width = width;
+		shape.height = height;
+		shape.rotation = rotation;
+		shape.absorption = absorption;
+		shape.numVertices = vertices ? (unsigned)numVertices : 0;
+		if (shape.numVertices > Planeverb::PV_MAX_SHAPE_VERTICES)
+			shape.numVertices = Planeverb::PV_MAX_SHAPE_VERTICES;
+		for (unsigned i = 0; i < shape.numVertices; ++i)
+		{
+			shape.vertices[i].x = vertices[2 * i];
+			shape.vertices[i].y = vertices[2 * i + 1];
+		}
+		return shape;
+	}
+
+	// emitters converted at once by the batch functions
+	const int EMISSION_BATCH = 64;
+} // namespace
+
 extern "C"
 {
 #pragma region UnityPluginInterface
@@ -57,6 +88,24 @@ extern "C"
 		Planeverb::UpdateEmission((Planeverb::EmissionID)id, Planeverb::vec3(x, y, z));
 	}
 
+	// positions are separate x, y and z arrays of count floats
+	PVU_EXPORT void PVU_CC
+	PlaneverbUpdateEmissions(const int* ids, const float* x, const float* y, const float* z, int count)
+	{
+		Planeverb::EmissionID batchIds[EMISSION_BATCH];
+		Planeverb::vec3 positions[EMISSION_BATCH];
+		for (int begin = 0; begin < count; begin += EMISSION_BATCH)
+		{
+			const int batch = count - begin < EMISSION_BATCH ? count - begin : EMISSION_BATCH;
+			for (int i = 0; i < batch; ++i)
+			{
+				batchIds[i] = (Planeverb::EmissionID)ids[begin + i];
+				positions[i] = Planeverb::vec3(x[begin + i], y[begin + i], z[begin + i]);
+			}
+			Planeverb::UpdateEmissions(batchIds, positions, (unsigned)batch);
+		}
+	}
+
 	PVU_EXPORT void PVU_CC
 	PlaneverbEndEmission(int id)
 	{
@@ -91,6 +140,34 @@ extern "C"
 		return output;
 	}
 
+	PVU_EXPORT void PVU_CC
+	PlaneverbGetOutputs(const int* emissionIDs, PlaneverbOutput* outputs, int count)
+	{
+		Planeverb::EmissionID batchIds[EMISSION_BATCH];
+		Planeverb::PlaneverbOutput poutputs[EMISSION_BATCH];
+		for (int begin = 0; begin < count; begin += EMISSION_BATCH)
+		{
+			const int batch = count - begin < EMISSION_BATCH ? count - begin : EMISSION_BATCH;
+			for (int i = 0; i < batch; ++i)
+				batchIds[i] = (Planeverb::EmissionID)emissionIDs[begin + i];
+			Planeverb::GetOutputs(batchIds, poutputs, (unsigned)batch);
+
+			for (int i = 0; i < batch; ++i)
+			{
+				const auto& poutput = poutputs[i];
+				PlaneverbOutput& output = outputs[begin + i];
+				output.occlusion = poutput.occlusion;
+				output.wetGain = poutput.wetGain;
+				output.rt60 = poutput.rt60;
+				output.lowpass = poutput.lowpass;
+				output.directionX = poutput.direction.x;
+				output.directionY = poutput.direction.y;
+				output.sourceDirectionX = poutput.sourceDirectivity.x;
+				output.sourceDirectionY = poutput.sourceDirectivity.y;
+			}
+		}
+	}
+
 	PVU_EXPORT int PVU_CC
 	PlaneverbAddGeometry(float posX, float posY,
 		float width, float height, 
@@ -122,6 +199,28 @@ extern "C"
 		Planeverb::UpdateGeometry((Planeverb::PlaneObjectID)id, &aabb);
 	}
 
+	PVU_EXPORT int PVU_CC
+	PlaneverbAddShape(int type, float posX, float posY,
+		float width, float height, float rotation,
+		const float* vertices, int numVertices,
+		float absorption)
+	{
+		Planeverb::PlaneShape shape = MakeShape(type, posX, posY, width, height, rotation,
+			vertices, numVertices, absorption);
+		return (int)Planeverb::AddGeometry(&shape);
+	}
+
+	PVU_EXPORT void PVU_CC
+	PlaneverbUpdateShape(int id, int type, float posX, float posY,
+		float width, float height, float rotation,
+		const float* vertices, int numVertices,
+		float absorption)
+	{
+		Planeverb::PlaneShape shape = MakeShape(type, posX, posY, width, height, rotation,
+			vertices, numVertices, absorption);
+		Planeverb::UpdateGeometry((Planeverb::PlaneObjectID)id, &shape);
+	}
+
 	PVU_EXPORT void PVU_CC
 	PlaneverbRemoveGeometry(int id)
 	{
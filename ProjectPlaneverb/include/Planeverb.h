@@ -19,31 +19,72 @@ namespace Planeverb
 	// Can throw pv_InvalidConfig or pv_NotEnoughMemory
 	PV_API void ChangeSettings(const PlaneverbConfig* newConfig);
 
+	// The emission and geometry functions don't lock, they queue their changes for the background thread
+	// and must all be called from the same thread, e.g. the game's main thread
+
 	// Begin tracking a new sound being played
 	PV_API EmissionID Emit(const vec3& emitterPosition);
 
 	// Update information about a given emission
 	PV_API void UpdateEmission(EmissionID id, const vec3& position);
 
+	// Update many emissions at once, positions[i] is the new position of ids[i]
+	PV_API void UpdateEmissions(const EmissionID* ids, const vec3* positions, unsigned count);
+
 	// Stop tracking a sound that's finished playing
 	PV_API void EndEmission(EmissionID id);
 
 	// Retrieve acoustic output for a given emitter
 	PV_API PlaneverbOutput GetOutput(EmissionID emitter);
 
+	// Retrieve acoustic output for a given emitter as heard by one of the config's listeners
+	PV_API PlaneverbOutput GetOutput(unsigned listener, EmissionID emitter);
+
+	// Retrieve acoustic output for many emitters at once, outputs[i] is the output of emitters[i]
+	// looks the emitters up together, e.g. every emitter once per audio block, rather than one at a time
+	PV_API void GetOutputs(const EmissionID* emitters, PlaneverbOutput* outputs, unsigned count);
+	PV_API void GetOutputs(unsigned listener, const EmissionID* emitters, PlaneverbOutput* outputs, unsigned count);
+
+	// Number of times new results were published for the listener, outputs can't change while it stays the same
+	// unless the listener is inside the bake or emitters move, 0 before the first results
+	PV_API unsigned GetOutputEpoch();
+	PV_API unsigned GetOutputEpoch(unsigned listener);
+
 	// Add a new piece of geometry to the scene
 	PV_API PlaneObjectID AddGeometry(const AABB* transform);
 
 	// Update dynamic geometry in the scene
 	PV_API void UpdateGeometry(PlaneObjectID id, const AABB* newTransform);
 
+	// Add a rotated box, polygon or wall segment, e.g. a whole mesh footprint that would take many AABBs
+	PV_API PlaneObjectID AddGeometry(const PlaneShape* shape);
+
+	// Update dynamic geometry in the scene, the new shape may be of another type
+	PV_API void UpdateGeometry(PlaneObjectID id, const PlaneShape* newShape);
+
 	// Removes dynamic geometry from the scene
 	PV_API void RemoveGeometry(PlaneObjectID id);
 
+	// Reports how loaded the game's threads are, e.g. frame time over the frame budget
+	// 1 or less is normal, above 1 the background updates are spaced out by the load to free up cores
+	PV_API void SetGameThreadLoad(float load);
+
 	// Updates listener
 	PV_API void SetListenerPosition(const vec3& listenerPosition);
 
+	// Updates one of the config's listeners, listener 0 is the one set above
+	PV_API void SetListenerPosition(unsigned listener, const vec3& listenerPosition);
+
+	// Precomputes results for a lattice of listener positions listenerSpacing meters apart inside listenerArea,
+	// or the whole grid if it's nullptr, and writes them to filePath for PlaneverbConfig::bakedResultsFile.
+	// Uses the current geometry and the config's threads, blocks until done, the running simulation isn't affected.
+	// The file is built in the config's tempFileDirectory first. Returns false if it couldn't be written.
+	PV_API bool BakeResults(const char* filePath, const AABB* listenerArea, float listenerSpacing);
+
 	// Retrieves an Impulse Response for debugging purposes.
+	// Returns { nullptr, 0 } with pv_StreamingAnalysis, which doesn't keep impulse responses.
+	// With pv_CompressedAnalysis the response is decoded at half the grid's sampling rate and the
+	// returned memory is only valid until the next call.
 	PV_API std::pair<const Cell*, unsigned> GetImpulseResponse(const vec3& position);
 	
 } // namespace Planeverb
@@ -48,6 +48,30 @@ namespace Planeverb
 		*/
 	};
 
+	// most vertices of a PlaneShape polygon
+	const constexpr unsigned PV_MAX_SHAPE_VERTICES = 16;
+
+	enum PlaneShapeType
+	{
+		pv_ShapeAABB,			// position, width and height, the same cells as an AABB
+		pv_ShapeOrientedBox,	// an AABB rotated about its position by rotation radians, from x towards z
+		pv_ShapePolygon,		// numVertices vertices in order, convex or concave, its edges may not cross
+		pv_ShapeSegment,		// a wall from vertices[0] to vertices[1], width meters thick, never thinner than a cell
+	};
+
+	// Geometry footprint in the x/z plane, one shape can replace the many AABBs a rotated or concave object needs
+	struct PlaneShape
+	{
+		PlaneShapeType type;
+		vec2 position;
+		Real width;
+		Real height;
+		Real rotation;
+		Real absorption;
+		unsigned numVertices;
+		vec2 vertices[PV_MAX_SHAPE_VERTICES];
+	};
+
 	// absorption parameter R, defined as sqrt(1-absorption)
 #define PV_ABSORPTION_FREE_SPACE				((Real)(0.000000000))
 #define PV_ABSORPTION_DEFAULT					((Real)(0.989949494))
@@ -35,6 +35,26 @@ namespace Planeverb
 		pv_ReflectingBoundary,	// walls of the grid reflect acoustic energy - !!! Not supported !!!
 	};
 
+	enum PlaneverbAnalysisMode
+	{
+		pv_FullResponseAnalysis,	// record every cell's full impulse response and analyze it after the simulation
+		pv_StreamingAnalysis,		// analyze responses while the grid simulates them, no impulse responses are kept
+		pv_CompressedAnalysis,		// record decimated, half precision impulse responses and analyze them after the simulation
+	};
+
+	enum PlaneverbRecordingMode
+	{
+		pv_FullFieldRecording,	// record and analyze every cell of the grid, any position can be queried
+		pv_ProbeRecording,		// record and analyze only the cells around active emitters
+	};
+
+	enum PlaneverbDecayFit
+	{
+		pv_DecayFitFull,	// fit rt60 to the whole energy decay curve after the direct sound
+		pv_DecayFitT20,		// fit rt60 to the curve from 5 to 25 dB below its start
+		pv_DecayFitT30,		// fit rt60 to the curve from 5 to 35 dB below its start
+	};
+
 	struct PlaneverbConfig
 	{
 		// grid size in meters
@@ -47,16 +67,118 @@ namespace Planeverb
 		// boundary type
 		PlaneverbBoundaryType gridBoundaryType = pv_AbsorbingBoundary;
 
-		// directory for Planeverb to store temporary files
+		// directory for Planeverb to store temporary files, e.g. a bake in progress
 		// must be set manually by user
 		const char* tempFileDirectory;
 
 		// thread usage
 		unsigned maxThreadUsage = 0; // can specify number of threads, 0 means as many as possible, minimum 2 otherwise
 		PlaneverbExecutionType threadExecutionType = pv_CPU; // CPU or GPU
-
-		// grid world offset - !!! Not supported !!!
+		// logical cores the background and simulation threads run on, bit i is core i, simulation thread i
+		// is pinned to the i-th core set, 0 leaves the threads' affinity to the OS
+		unsigned long long threadAffinityMask = 0;
+
+		// background scheduling, keeps acoustics from starving the game's own threads
+		// updates per second the background thread aims for, e.g. 10, 0 updates back to back
+		float updateRateHz = 0.f;
+		// milliseconds of CPU time one update may take on the background thread at the target rate, 0 for no limit
+		// an update that runs over waits proportionally longer, so acoustics stay within budget * rate of its CPU time
+		float updateBudgetMs = 0.f;
+		// priority of the background and simulation threads, -2 lowest to 2 highest
+		int threadPriority = 0;
+
+		// number of time steps each thread advances its rows between synchronizations
+		// 1 steps the whole grid every time step, larger values enable cache-blocked (temporal) stepping
+		// which is faster on large grids and gives identical results
+		unsigned timeStepsPerBlock = 1;
+
+		// when the impulse responses are analyzed
+		// streaming analysis needs a small fraction of the memory and memory bandwidth, but estimates rt60
+		// from a coarser energy decay curve, and GetImpulseResponse() returns no data
+		// compressed analysis keeps impulse responses in about a tenth of the memory, at half the sampling rate
+		// and with velocity only at the start of the direct sound
+		PlaneverbAnalysisMode analysisMode = pv_FullResponseAnalysis;
+
+		// rt60 estimation, 0 fits the energy decay curve of every sample after the direct sound, otherwise the
+		// curve of blocks of this many milliseconds, e.g. 10, which takes one log and regression update per block
+		// instead of per sample for rt60s within a few percent, streaming analysis always uses 2 ms blocks
+		float decayBlockLengthMs = 0.f;
+		// range of the block energy decay curve rt60 is extrapolated from, also used by streaming analysis
+		PlaneverbDecayFit decayFitRange = pv_DecayFitFull;
+
+		// which cells record impulse responses
+		// probe recording is far cheaper for large grids with few emitters, but only emitter positions
+		// have results, and listener direction can only be traced within each emitter's probe radius
+		PlaneverbRecordingMode recordingMode = pv_FullFieldRecording;
+		unsigned probeRadius = 2;		// cells around an emitter's cell that are recorded as well
+		unsigned maxProbeCells = 1024;	// max cells recorded in probe mode, cells past it have no results
+
+		// analyze only the cells of active emitters, and the cells their listener directions are traced through,
+		// rather than every cell, so analysis scales with the number of emitters instead of the grid size
+		// other cells then have no results, e.g. an emitter moved since the last analysis has none until the
+		// next one, and results aren't cached, probe recording already only analyzes the emitters' cells
+		bool lazyAnalysis = false;
+
+		// stop simulating once the energy left in the grid has fallen this many dB below its peak, e.g. -60
+		// damped scenes then simulate far fewer time steps, 0 always simulates the full response length
+		float responseEnergyFloorDB = 0.f;
+
+		// world space areas that are simulated, e.g. the rooms of a level, cells outside all of them are solid
+		// and get no impulse response storage, so large levels that are mostly rock need far less memory
+		// nullptr simulates the whole grid, the regions are only read while the context is created
+		const AABB* simulatedRegions = nullptr;
+		unsigned numSimulatedRegions = 0;
+
+		// grid world offset, world position + offset is the position in the grid, which spans
+		// [0, gridSizeInMeters] on x and z, e.g. half the grid size centers the grid on the origin
 		vec2 gridWorldOffset = { 0.f, 0.f };
+
+		// slide the grid with the listener, so a grid far smaller than the level always surrounds them
+		// once the listener is more than gridRecenterDistance meters from the grid's center along x or z,
+		// the grid moves by whole cells to center them again and only the newly covered cells are voxelized
+		// can't be combined with simulatedRegions, whose storage is fixed when the context is created
+		// with several listeners the grid follows listener 0
+		bool gridFollowsListener = false;
+		float gridRecenterDistance = 2.f;
+
+		// listeners sharing the same geometry, e.g. split-screen players, up to PV_MAX_LISTENERS
+		// every listener is simulated and analyzed each iteration and has its own results
+		unsigned numListeners = 1;
+
+		// simulate the listeners together, their pressure and velocity fields interleaved across the SIMD lanes
+		// of each cell, so the walls are read once per cell and the simulation threads synchronize once per
+		// time step for all of them, only with full field recording and full response analysis
+		// every listener then keeps its own full responses, numListeners times the response storage,
+		// otherwise the listeners are simulated one after another in the same storage
+		bool batchListeners = false;
+
+		// analyzed result grids kept for the listener cells visited last, per grid geometry
+		// a listener that stays in its cell, or returns to a cached one, isn't simulated again while the
+		// geometry is unchanged, results are then those of the cell rather than the exact listener position
+		// so while a listener moves inside a cell, the directions and delays of GetOutput() stay the ones
+		// computed from where it was when the cell was analyzed
+		// each takes about 36 bytes per grid cell, 0 simulates every listener every iteration
+		// a couple of cells covers a listener standing still or crossing a cell edge back and forth,
+		// raise it for listeners that revisit more cells, at the cost of its memory
+		// not used with probe recording or lazy analysis, whose results depend on the emitters as well
+		unsigned resultCacheSize = 2;
+
+		// file written by BakeResults() for this grid, nullptr simulates every listener live
+		// listeners inside its lattice get results interpolated from the file and aren't simulated, so
+		// geometry changes made after the bake only affect listeners outside it
+		// the file is memory mapped while the context runs, can throw pv_InvalidConfig if it doesn't match the grid
+		const char* bakedResultsFile = nullptr;
+
+		// geometry and emitter changes queued for the background thread without locking, e.g. an
+		// UpdateGeometry() is one command and a new or moved emitter is one, 192 bytes each
+		// should hold the changes of the frames one background update takes, past it changes still
+		// go through but take a lock
+		unsigned commandQueueCapacity = 4096;
+
+		// voxelize geometry changes on a helper thread while the grid is being simulated, into a second copy of
+		// the walls that's swapped in before the next simulation, so large edits don't delay the simulations
+		// changes then reach the simulation one update later, and the walls take about 32 more bytes per cell
+		bool voxelizeConcurrently = false;
 	};
 
 	// Final acoustic output for an emitter
@@ -78,6 +200,7 @@ namespace Planeverb
 	const constexpr PlaneObjectID PV_INVALID_PLANE_OBJECT_ID = (PlaneObjectID)(-1);
 	const constexpr EmissionID PV_INVALID_EMISSION_ID = (EmissionID)(-1);
 	const constexpr Real PV_INVALID_DRY_GAIN = (Real)-1.f;
+	const constexpr unsigned PV_MAX_LISTENERS = 8;
 
 	// Internal constants
 	const constexpr Real PV_PI = (Real)3.141593f;						// PI
@@ -96,10 +219,10 @@ namespace Planeverb
 	const constexpr Real PV_MIN_AUDIBLE_FREQ = (Real)20.f;				// minimum audible frequency for humans
 	const constexpr Real PV_POINTS_PER_WAVELENGTH = (Real)3.5f;			// number of cells per wavelength
 	const constexpr Real PV_SCHROEDER_OFFSET_S = (Real)0.01f;			// experimentally calculated amount to cut off schroeder tail
+	const constexpr Real PV_DECAY_BLOCK_LENGTH_S = (Real)0.002f;		// length of the energy blocks kept by streaming decay analysis
 	const constexpr Real PV_DISTANCE_GAIN_THRESHOLD = (Real)0.891251f;	// -1dB converted to linear gain
 	const constexpr Real PV_DELAY_CLOSE_THRESHOLD = (Real)5.f;			// "close enough" delay threshold when analyzing for direction
-	const constexpr Real PV_IMPULSE_RESPONSE_S = PV_SQRT_2 * Real(12.5) / PV_C + Real(0.25);			// number of seconds to collect per impulse response
-	//                                                             ^ should be half of the scene width
+	const constexpr Real PV_RESPONSE_TAIL_S = Real(0.25);				// seconds collected per impulse response after sound crosses half the grid diagonal
 
 	// struct to represent grid cells
 	// 16 bytes
@@ -0,0 +1,109 @@
+#include <Context\CommandQueue.h>
+#include <PvDefinitions.h>
+
+#include <algorithm>
+
+namespace Planeverb
+{
+	CommandQueue::CommandQueue(const PlaneverbConfig* config, char* mem) :
+		m_ring(reinterpret_cast<Command*>(mem)),
+		m_capacity(config->commandQueueCapacity),
+		m_head(0), m_tail(0), m_overflowed(false),
+		m_overflow(), m_taken(), m_takenIndex(0), m_mutex()
+	{
+		if (!mem)
+		{
+			throw pv_NotEnoughMemory;
+		}
+	}
+
+	CommandQueue::~CommandQueue()
+	{
+		m_ring = nullptr;
+	}
+
+	void CommandQueue::Push(const Command& command)
+	{
+		// only this thread sets the overflow flag, so it can't be missed here
+		if (!m_overflowed.load(std::memory_order_relaxed))
+		{
+			const unsigned tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_head.load(std::memory_order_acquire) < m_capacity)
+			{
+				m_ring[tail % m_capacity] = command;
+				m_tail.store(tail + 1, std::memory_order_release);
+				return;
+			}
+		}
+
+		// ring is full, or still has commands older than the overflow
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_overflow.push_back(command);
+		m_overflowed.store(true, std::memory_order_release);
+	}
+
+	void CommandQueue::Push(const Command* commands, unsigned count)
+	{
+		// as many as the ring has room for, see above
+		unsigned pushed = 0;
+		if (!m_overflowed.load(std::memory_order_relaxed))
+		{
+			const unsigned tail = m_tail.load(std::memory_order_relaxed);
+			const unsigned room = m_capacity - (tail - m_head.load(std::memory_order_acquire));
+			pushed = std::min(count, room);
+			for (unsigned i = 0; i < pushed; ++i)
+				m_ring[(tail + i) % m_capacity] = commands[i];
+			m_tail.store(tail + pushed, std::memory_order_release);
+		}
+		if (pushed == count)
+			return;
+
+		// the rest follow in the overflow
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_overflow.insert(m_overflow.end(), commands + pushed, commands + count);
+		m_overflowed.store(true, std::memory_order_release);
+	}
+
+	bool CommandQueue::Pop(Command& command)
+	{
+		if (m_takenIndex < m_taken.size())
+		{
+			command = m_taken[m_takenIndex++];
+			return true;
+		}
+
+		// read the flag first, every ring command pushed before the overflow is visible after it
+		const bool overflowed = m_overflowed.load(std::memory_order_acquire);
+		if (PopRing(command))
+			return true;
+		if (!overflowed)
+			return false;
+
+		// the ring is drained up to the overflow, which holds the next commands
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_taken.clear();
+			m_taken.swap(m_overflow);
+			m_takenIndex = 0;
+			m_overflowed.store(false, std::memory_order_relaxed);
+		}
+		command = m_taken[m_takenIndex++];
+		return true;
+	}
+
+	bool CommandQueue::PopRing(Command& command)
+	{
+		const unsigned head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire))
+			return false;
+
+		command = m_ring[head % m_capacity];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	unsigned CommandQueue::GetMemoryRequirement(const PlaneverbConfig * config)
+	{
+		return config->commandQueueCapacity * sizeof(Command);
+	}
+} // namespace Planeverb
@@ -0,0 +1,68 @@
+#pragma once
+#include <PvTypes.h>
+#include <atomic>
+#include <vector>
+#include <mutex>
+
+namespace Planeverb
+{
+	// Changes the game thread makes to geometry and emitters, applied by the background thread
+	enum CommandType : unsigned char
+	{
+		cmd_AddGeometry,
+		cmd_UpdateGeometry,
+		cmd_RemoveGeometry,
+		cmd_Emit,
+		cmd_UpdateEmission,
+		cmd_EndEmission
+	};
+
+	struct Command
+	{
+		CommandType type;
+		size_t id;			// PlaneObjectID or EmissionID
+		PlaneShape shape;	// new footprint of geometry commands
+		vec3 position;		// new position of emitter commands
+	};
+
+	// Single producer, single consumer ring of commands in pool memory
+	// the game thread pushes without locking while the ring has room, once it's full commands go to an
+	// overflow list under a lock until the background thread catches up, so nothing is dropped or reordered
+	class CommandQueue
+	{
+	public:
+		CommandQueue(const PlaneverbConfig* config, char* mem);
+		~CommandQueue();
+
+		// producer, the thread calling the geometry and emission functions
+		void Push(const Command& command);
+		// pushes count commands in order, synchronizing with the consumer once rather than once per command
+		void Push(const Command* commands, unsigned count);
+
+		// consumer, the background thread, false once every pushed command was popped
+		bool Pop(Command& command);
+
+		static unsigned GetMemoryRequirement(const struct PlaneverbConfig* config);
+
+	private:
+		bool PopRing(Command& command);
+
+		Command* m_ring;						// m_capacity commands
+		unsigned m_capacity;
+
+		// positions only ever increase, the ring holds [m_head, m_tail)
+		// padded so the producer and consumer don't share a cache line
+		char m_pad0[64];
+		std::atomic<unsigned> m_head;			// next command to pop, written by the consumer
+		char m_pad1[64];
+		std::atomic<unsigned> m_tail;			// next command to push, written by the producer
+		char m_pad2[64];
+
+		// overflow, every command is pushed here while m_overflowed is set
+		std::atomic<bool> m_overflowed;
+		std::vector<Command> m_overflow;		// commands pushed while the ring was full
+		std::vector<Command> m_taken;			// overflow commands the consumer is popping
+		size_t m_takenIndex;					// next command of m_taken to pop
+		std::mutex m_mutex;						// guards m_overflow
+	};
+} // namespace Planeverb
@@ -5,7 +5,11 @@
 #include <Emissions\EmissionManager.h>
 #include <DSP\Analyzer.h>
 #include <FDTD\FreeGrid.h>
+#include <DSP\BakedResults.h>
 #include <Util\ScopedTimer.h>
+#include <Util\ThreadUtil.h>
+#include <Context\UpdateScheduler.h>
+#include <Context\CommandQueue.h>
 #include <Planeverb.h>
 
 #include <cstring>
@@ -55,6 +59,22 @@ namespace Planeverb
 		if(context)
 			context->SetListenerPosition(listenerPosition);
 	}
+
+	// sets the load the background updates back off from
+	void SetGameThreadLoad(float load)
+	{
+		auto* context = GetContext();
+		if (context)
+			context->SetGameThreadLoad(load);
+	}
+
+	// sets the position of one of the listeners, ignores listeners the config doesn't have
+	void SetListenerPosition(unsigned listener, const vec3& listenerPosition)
+	{
+		auto* context = GetContext();
+		if (context && listener < context->GetConfig()->numListeners)
+			context->SetListenerPosition(listenerPosition, listener);
+	}
 	#pragma endregion
 
 	namespace
@@ -67,8 +87,21 @@ namespace Planeverb
 			Grid* grid = context->GetGrid();
 			GeometryManager* geometry = context->GetGeometryManager();
 			Analyzer* analyzer = context->GetAnalyzer();
+			EmissionManager* emissions = context->GetEmissionManager();
+			const BakedResults* baked = context->GetBakedResults();
+			CommandQueue* commands = context->GetCommandQueue();
 			const PlaneverbConfig* config = context->GetConfig();
-			vec3 listenerPos = context->GetListenerPosition();
+			const unsigned numListeners = config->numListeners;
+			vec3 listenerPos[PV_MAX_LISTENERS];
+			for (unsigned i = 0; i < numListeners; ++i)
+				listenerPos[i] = context->GetListenerPosition(i);
+			std::vector<int> probeCells;
+			UpdateScheduler scheduler(config);
+			Command command;
+
+			// the background thread is the simulation's thread 0
+			SetThreadCores(config->threadAffinityMask);
+			SetThreadPriorityLevel(config->threadPriority);
 			
 			// run while context runs
 			while (isRunning)
@@ -76,17 +109,85 @@ namespace Planeverb
 				// debug profile if needed
 				PROFILE_SECTION(
 				{
-					// generate impulse responses
-					PROFILE_TIME(grid->GenerateResponse(listenerPos), "Time for Generating Response");
-					
-					// generate runtime data
-					PROFILE_TIME(analyzer->AnalyzeResponses(listenerPos), "Time for Analyzing Response");
+					scheduler.BeginUpdate();
 
-					// update geometry in grid
+					// apply the game thread's changes, then update geometry in grid
+					while (commands->Pop(command))
+					{
+						if (command.type <= cmd_RemoveGeometry)
+							geometry->ApplyCommand(command);
+						else
+							emissions->ApplyCommand(command);
+					}
 					geometry->PushGeometryChanges();
 
-					// update listener position and running flag
-					listenerPos = context->GetListenerPosition();
+					// recenter the grid before anything reads its offset
+					if (config->gridFollowsListener)
+					{
+						geometry->FollowListener(listenerPos[0]);
+					}
+
+					// only record where the emitters are
+					if (config->recordingMode == pv_ProbeRecording)
+					{
+						emissions->GetProbeCells(grid, (int)config->probeRadius, probeCells);
+						grid->SetProbeCells(probeCells.data(), (int)probeCells.size());
+					}
+					// or only analyze where they are
+					else if (config->lazyAnalysis)
+					{
+						emissions->GetProbeCells(grid, 0, probeCells);
+					}
+
+					// listeners inside the bake are answered from the file, and ones whose cell and geometry were
+					// analyzed recently from the cache, the others are simulated
+					unsigned simulatedListeners[PV_MAX_LISTENERS];
+					vec3 simulatedPositions[PV_MAX_LISTENERS];
+					unsigned numSimulated = 0;
+					const unsigned geometryVersion = grid->GetGeometryVersion();
+					for (unsigned i = 0; i < numListeners; ++i)
+					{
+						if (baked && baked->ContainsListener(listenerPos[i]))
+							continue;
+						if (analyzer->UseCachedResults(i, grid->GetListenerCell(listenerPos[i]), geometryVersion))
+							continue;
+						simulatedListeners[numSimulated] = i;
+						simulatedPositions[numSimulated++] = listenerPos[i];
+					}
+					const bool simulated = numSimulated > 0;
+
+					// a batched grid simulates the listeners together, each into its own responses, otherwise
+					// every listener reuses the grid's geometry and response storage in turn
+					const bool batched = numSimulated > 1 && numSimulated <= grid->GetMaxBatchedListeners();
+					if (batched)
+					{
+						PROFILE_TIME(grid->GenerateResponses(simulatedPositions, numSimulated), "Time for Generating Responses");
+					}
+					for (unsigned k = 0; k < numSimulated; ++k)
+					{
+						const unsigned i = simulatedListeners[k];
+
+						// generate impulse responses
+						if (batched)
+						{
+							grid->SelectListener(k);
+						}
+						else
+						{
+							PROFILE_TIME(grid->GenerateResponse(listenerPos[i]), "Time for Generating Response");
+						}
+
+						// generate runtime data
+						PROFILE_TIME(analyzer->AnalyzeResponses(listenerPos[i], i, probeCells.data(), (int)probeCells.size()), "Time for Analyzing Response");
+						analyzer->CacheResults(i, grid->GetListenerCell(listenerPos[i]), geometryVersion);
+					}
+
+					// wait for the next update, longer while over budget, the game is loaded or there was nothing to do
+					scheduler.EndUpdate(simulated, context->GetGameThreadLoad());
+
+					// update listener positions and running flag
+					for (unsigned i = 0; i < numListeners; ++i)
+						listenerPos[i] = context->GetListenerPosition(i);
 					isRunning = context->IsRunning();
 				}, 
 				"Time for one analysis iteration");
@@ -101,7 +202,13 @@ namespace Planeverb
 		if (config == nullptr || config->gridResolution < pv_LowResolution ||
 			config->gridSizeInMeters.x == 0 || config->gridSizeInMeters.y == 0 ||
 			config->tempFileDirectory == nullptr || 
-			config->maxThreadUsage < 0)
+			config->maxThreadUsage < 0 ||
+			config->numListeners == 0 || config->numListeners > PV_MAX_LISTENERS ||
+			config->updateRateHz < 0.f || config->updateBudgetMs < 0.f ||
+			config->threadPriority < -2 || config->threadPriority > 2 ||
+			config->commandQueueCapacity == 0 ||
+			config->decayBlockLengthMs < 0.f || config->decayFitRange < pv_DecayFitFull || config->decayFitRange > pv_DecayFitT30 ||
+			(config->gridFollowsListener && config->simulatedRegions != nullptr))
 		{
 			throw pv_InvalidConfig;
 		}
@@ -110,8 +217,9 @@ namespace Planeverb
 		std::memcpy(&m_config, config, sizeof(PlaneverbConfig));
 
 		// determine size for context pool, throw if operator new fails
-		unsigned systemSize = sizeof(GeometryManager) + sizeof(Grid) + sizeof(EmissionManager) + sizeof(Analyzer) + sizeof(FreeGrid);
-		unsigned internalSize = GeometryManager::GetMemoryRequirement(config) +
+		unsigned systemSize = sizeof(CommandQueue) + sizeof(GeometryManager) + sizeof(Grid) + sizeof(EmissionManager) + sizeof(Analyzer) + sizeof(FreeGrid) + sizeof(BakedResults);
+		unsigned internalSize = CommandQueue::GetMemoryRequirement(config) +
+			GeometryManager::GetMemoryRequirement(config) +
 			Grid::GetMemoryRequirement(config) +
 			EmissionManager::GetMemoryRequirement(config) +
 			Analyzer::GetMemoryRequirement(config) +
@@ -131,18 +239,40 @@ namespace Planeverb
 		// set pool memory to 0
 		std::memset(m_systemMem, 0, size);
 
+		// placement new construct the baked results first, a file that doesn't match fails before the grid is built
+		// the file is mapped rather than pooled
+		m_baked = nullptr;
+		if (config->bakedResultsFile)
+		{
+			try
+			{
+				m_baked = new (tempSysMem) BakedResults(config->bakedResultsFile, &m_config);
+			}
+			catch (PlaneverbErrorCode)
+			{
+				delete[] m_systemMem;
+				throw;
+			}
+			tempSysMem += sizeof(BakedResults);
+		}
+
+		// placement new construct the command queue, first in the pool so its commands are aligned
+		m_commands = new (tempSysMem) CommandQueue(&m_config, tempPoolMem);
+		tempSysMem += sizeof(CommandQueue);
+		tempPoolMem += CommandQueue::GetMemoryRequirement(config);
+
 		// placement new construct the grid
 		m_grid = new (tempSysMem) Grid(&m_config, tempPoolMem);
 		tempSysMem += sizeof(Grid);
 		tempPoolMem += Grid::GetMemoryRequirement(config);
 
 		// placement new construct the geometry manager
-		m_geometry = new (tempSysMem) GeometryManager(m_grid, tempPoolMem);
+		m_geometry = new (tempSysMem) GeometryManager(&m_config, m_grid, m_commands, tempPoolMem);
 		tempSysMem += sizeof(GeometryManager);
 		tempPoolMem += GeometryManager::GetMemoryRequirement(config);
 
 		// placement new construct the emissions manager
-		m_emissions = new (tempSysMem) EmissionManager(tempPoolMem);
+		m_emissions = new (tempSysMem) EmissionManager(m_commands, tempPoolMem);
 		tempSysMem += sizeof(EmissionManager);
 		tempPoolMem += EmissionManager::GetMemoryRequirement(config);
 
@@ -152,7 +282,7 @@ namespace Planeverb
 		tempPoolMem += FreeGrid::GetMemoryRequirement(config);
 
 		// placement new construct the analyzer
-		m_analyzer = new (tempSysMem) Analyzer(m_grid, m_freeGrid, tempPoolMem);
+		m_analyzer = new (tempSysMem) Analyzer(&m_config, m_grid, m_freeGrid, tempPoolMem);
 		tempSysMem += sizeof(Analyzer);
 		tempPoolMem += Analyzer::GetMemoryRequirement(config);
 
@@ -167,11 +297,14 @@ namespace Planeverb
 		m_backgroundProcessor.join();
 
 		// call dtor on all systems in reverse order
+		if (m_baked)
+			m_baked->~BakedResults();
 		m_analyzer->~Analyzer();
 		m_emissions->~EmissionManager();
 		m_geometry->~GeometryManager();
 		m_grid->~Grid();
 		m_freeGrid->~FreeGrid();
+		m_commands->~CommandQueue();
 
 		// delete pool
 		delete[] m_systemMem;
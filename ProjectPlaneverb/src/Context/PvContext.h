@@ -1,6 +1,7 @@
 #pragma once
 #include <PvTypes.h>	// vec3
 #include <thread>		// std::thread
+#include <atomic>		// std::atomic
 
 namespace Planeverb
 {
@@ -11,6 +12,8 @@ namespace Planeverb
 	class EmissionManager;
 	class Analyzer;
 	class FreeGrid;
+	class BakedResults;
+	class CommandQueue;
 
 	// Global context singleton that stores all systems
 	class Context
@@ -27,23 +30,31 @@ namespace Planeverb
 		GeometryManager* GetGeometryManager() { return m_geometry; }
 		Analyzer* GetAnalyzer() { return m_analyzer; }
 		EmissionManager* GetEmissionManager() { return m_emissions; }
+		const BakedResults* GetBakedResults() const { return m_baked; }
+		CommandQueue* GetCommandQueue() { return m_commands; }
 		bool IsRunning() const { return m_isRunning; }
-		const vec3& GetListenerPosition() const { return m_listenerPos; }
+		const vec3& GetListenerPosition(unsigned listener = 0) const { return m_listenerPos[listener]; }
+		float GetGameThreadLoad() const { return m_gameThreadLoad.load(std::memory_order_relaxed); }
 
 		// setters
 		void StopRunning() { m_isRunning = false; }
-		void SetListenerPosition(const vec3& listenerPos) { m_listenerPos = listenerPos; }
+		void SetListenerPosition(const vec3& listenerPos, unsigned listener = 0) { m_listenerPos[listener] = listenerPos; }
+		void SetGameThreadLoad(float load) { m_gameThreadLoad.store(load, std::memory_order_relaxed); }
 		
 	private:
 		PlaneverbConfig m_config;			// copy of the input config
 		std::thread m_backgroundProcessor;	// background thread handle
 		bool m_isRunning = true;			// running flag used by thread
 
-		vec3 m_listenerPos;					// global listener position
+		vec3 m_listenerPos[PV_MAX_LISTENERS];	// global listener positions
+		std::atomic<float> m_gameThreadLoad{ 0.f };	// last load reported by the game, set by the game thread
 
 		char* m_systemMem;
 		char* m_mem;						// all memory for systems stored linearly
 
+		// game thread changes for the background thread
+		CommandQueue* m_commands;			// command queue handle
+
 		// FDTD manager
 		Grid* m_grid;						// acoustic grid handle
 
@@ -58,6 +69,9 @@ namespace Planeverb
 		
 		// free grid
 		FreeGrid* m_freeGrid;				// free grid handle
+
+		// baked results
+		BakedResults* m_baked;				// mapped bake, nullptr without one
 	};
 
 	// Internal context singleton getter function
@@ -0,0 +1,52 @@
+#include <Context\UpdateScheduler.h>
+#include <Util\ThreadUtil.h>
+#include <algorithm>
+#include <thread>
+
+namespace Planeverb
+{
+	namespace
+	{
+		// how long the background thread waits when no listener needs simulating
+		const constexpr double IDLE_SECONDS = 0.005;
+	} // namespace <>
+
+	UpdateScheduler::UpdateScheduler(const PlaneverbConfig* config) :
+		m_updateBegin(Clock::now()),
+		m_cpuBegin(GetThreadCpuSeconds()),
+		m_period(config->updateRateHz > 0.f ? 1.0 / (double)config->updateRateHz : 0.0),
+		m_budget((double)config->updateBudgetMs / 1000.0)
+	{
+	}
+
+	void UpdateScheduler::BeginUpdate()
+	{
+		m_updateBegin = Clock::now();
+		m_cpuBegin = GetThreadCpuSeconds();
+	}
+
+	void UpdateScheduler::EndUpdate(bool didWork, float gameThreadLoad)
+	{
+		const double elapsed = std::chrono::duration_cast<Seconds>(Clock::now() - m_updateBegin).count();
+		// the budget is CPU time, time the thread was preempted or blocked doesn't count against it
+		const double cpu = GetThreadCpuSeconds() - m_cpuBegin;
+
+		// the whole update, work and wait, takes the target period, or just its work if unpaced
+		double cycle = std::max(m_period, elapsed);
+
+		// over budget, keep the share of CPU time acoustics use to budget / period
+		if (m_period > 0.0 && m_budget > 0.0 && cpu > m_budget)
+			cycle = std::max(cycle, cpu * m_period / m_budget);
+
+		// a loaded game stretches the cycle, an unpaced update then leaves the game the same share of time
+		if (gameThreadLoad > 1.f)
+			cycle *= (double)gameThreadLoad;
+
+		if (!didWork)
+			cycle = std::max(cycle, elapsed + IDLE_SECONDS);
+
+		const double wait = cycle - elapsed;
+		if (wait > 0.0)
+			std::this_thread::sleep_for(Seconds(wait));
+	}
+} // namespace Planeverb
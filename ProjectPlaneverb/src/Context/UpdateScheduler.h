@@ -0,0 +1,30 @@
+#pragma once
+#include <PvTypes.h>
+#include <chrono>
+
+namespace Planeverb
+{
+	// Paces the background thread's updates
+	// each update waits for the rest of the target period, longer after updates whose CPU time ran over the budget
+	// or while the game is loaded, and briefly when there was nothing to simulate so the thread never spins
+	class UpdateScheduler
+	{
+	public:
+		UpdateScheduler(const PlaneverbConfig* config);
+
+		void BeginUpdate();
+
+		// blocks until the next update should begin
+		// didWork is false if nothing was simulated, gameThreadLoad is the last load reported by the game
+		void EndUpdate(bool didWork, float gameThreadLoad);
+
+	private:
+		using Clock = std::chrono::steady_clock;
+		using Seconds = std::chrono::duration<double>;
+
+		Clock::time_point m_updateBegin;	// start of the current update
+		double m_cpuBegin;					// CPU time of the thread at the start of the current update
+		double m_period;					// seconds per update at the target rate, 0 if unpaced
+		double m_budget;					// seconds of CPU time an update may take, 0 if unlimited
+	};
+} // namespace Planeverb
@@ -0,0 +1,178 @@
+#include <DSP\AnalysisKernels.h>
+#include <DSP\DecayEstimator.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace Planeverb
+{
+	namespace
+	{
+		// blocks start on multiples of the block length, so vector kernels share their boundaries across lanes
+		Real ReduceDecayBlocks(const AnalysisWindows& windows, const Cell* response, int startingPoint)
+		{
+			const int numSamples = windows.numSamples;
+			const int endPoint = numSamples - windows.schroederOffset;
+			const int blockLength = windows.decayBlockLength;
+
+			Real energies[PV_MAX_DECAY_BLOCKS];
+			DecayBlocks blocks;
+			blocks.energies = energies;
+			blocks.numBlocks = 0;
+			blocks.blockLength = blockLength;
+			blocks.firstBlockLength = std::min((startingPoint / blockLength + 1) * blockLength, endPoint) - startingPoint;
+			blocks.regressionLength = endPoint - startingPoint;
+			for (int begin = startingPoint; begin < endPoint;)
+			{
+				const int end = std::min((begin / blockLength + 1) * blockLength, endPoint);
+				Real energy = 0.f;
+				for (int i = begin; i < end; ++i)
+				{
+					const Real p = response[i].pr;
+					energy += p * p;
+				}
+				energies[blocks.numBlocks++] = energy;
+				begin = end;
+			}
+
+			blocks.tailEnergy = 0.f;
+			for (int i = endPoint; i < numSamples; ++i)
+			{
+				const Real p = response[i].pr;
+				blocks.tailEnergy += p * p;
+			}
+			return EstimateDecaySlope(blocks, windows.decayFit);
+		}
+
+		void ReduceResponse(const AnalysisWindows& windows, const Cell* response, ResponseReductions& out)
+		{
+			const int numSamples = windows.numSamples;
+
+			// onset delay
+			int onsetSample = 0;
+			for (; onsetSample < numSamples; ++onsetSample)
+			{
+				if (std::abs(response[onsetSample].pr) > windows.onsetThreshold)
+					break;
+			}
+
+			// no onset found, nothing else can be encoded
+			if (onsetSample == numSamples)
+			{
+				out.onsetSample = -1;
+				return;
+			}
+			out.onsetSample = onsetSample;
+
+			// dry energy and source direction, the directivity window is the shorter one
+			const int sourceDirEnd = std::min(onsetSample + windows.sourceDirSamples, numSamples);
+			const int directEnd = std::min(onsetSample + windows.directGainSamples, numSamples);
+			Real Edry = 0;
+			vec2 flux(0, 0);
+			int j = 0;
+			for (; j < sourceDirEnd; ++j)
+			{
+				const auto& r = response[j];
+				Edry += r.pr * r.pr;
+				flux.x += r.pr * r.vx;
+				flux.y += r.pr * r.vy;
+			}
+			for (; j < directEnd; ++j)
+			{
+				const auto& r = response[j];
+				Edry += r.pr * r.pr;
+			}
+			out.dryEnergy = Edry;
+			out.flux = flux;
+
+			// wet energy
+			Real wetEnergy = 0.0f;
+			const int wetEnd = std::min(directEnd + 1 + windows.wetGainSamples, numSamples);
+			for (j = directEnd + 1; j < wetEnd; j++)
+			{
+				const float p = response[j].pr;
+				wetEnergy += p * p;
+			}
+			out.wetEnergy = wetEnergy;
+
+			// decay slope of the block energy decay curve, one log per block
+			if (windows.decayBlockLength > 0)
+			{
+				out.decaySlope = ReduceDecayBlocks(windows, response, directEnd + 1);
+				return;
+			}
+
+			// decay slope, use backwards Schroeder integration
+			//         ^ inf
+			// I(t) = | (P(t))^2 dt
+			//       v t
+			//
+			// Effectively:
+			//	s[i], i = 0...N-1 is the signal
+			//	EnergyDecayCurve[i] = sum(s[i...N-1]^2)
+			//	EnergyDecayCurveDB[i] = 10*log10(EnergyDecayCurve[i])
+			// the slope of the curve after the dry window is its simple linear regression:
+			//
+			// B = sum((x_i - xbar) * (y_i - ybar), 1, n)
+			//	   ----------------------------------------
+			//		     sum( (x_i - xbar)^2, 1, n )
+			//
+			// We regress assuming time-step is 1 and startingPoint is x=0.
+			// The latter offset does not change slope, and time-step adjustment is done by the analyzer.
+			// Linear regression ignores some fixed bit of tail of energy decay curve which dips towards 0
+			const int startingPoint = directEnd + 1;
+			const int endPoint = numSamples - windows.schroederOffset;
+			const Real rn = Real(endPoint - startingPoint);
+			const Real xmean = (rn - 1.0f) * 0.5f;
+			const Real xsum = rn * xmean;
+			// Sum[(x-xmean)^2] = Sum[(i - ((n - 1)/2))^2, {i, 0, n - 1}] = 1/12 n (-1 + n^2)
+			const Real denominator = (1.0f / 12.0f) * rn * (rn*rn - 1.0f);
+
+			Real energyDecayCurve = 0.f;
+			Real xysum = 0;
+			Real ysum = 0;
+
+			// for the tail bit just accumulate energy, no regression
+			for (int i = numSamples - 1; i >= endPoint; --i)
+			{
+				const Real p = response[i].pr;
+				energyDecayCurve += p * p;
+			}
+			for (int i = endPoint - 1; i >= startingPoint; --i)
+			{
+				const Real p = response[i].pr;
+				energyDecayCurve += p * p;
+				const Real y_i = 10.f * std::log10(energyDecayCurve);
+				const auto x_i = (i - startingPoint);
+				xysum += y_i * x_i;
+				ysum += y_i;
+			}
+
+			const Real ymean = ysum / rn;
+			const Real numerator = xysum - ymean * xsum - xmean * ysum + rn * xmean * ymean;
+			out.decaySlope = numerator / denominator;
+		}
+
+		void ReduceScalar(const AnalysisWindows& windows, const Cell* const* responses, int count, ResponseReductions* out)
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				ReduceResponse(windows, responses[i], out[i]);
+			}
+		}
+	} // namespace <>
+
+	const AnalysisKernels g_AnalysisKernelsScalar = { ReduceScalar, "Scalar" };
+
+	const AnalysisKernels& GetAnalysisKernels(SimdLevel level)
+	{
+		switch (level)
+		{
+		case simd_AVX512:
+		case simd_AVX2:
+			return g_AnalysisKernelsAVX2;
+		default:
+			return g_AnalysisKernelsScalar;
+		}
+	}
+} // namespace Planeverb
@@ -0,0 +1,50 @@
+#pragma once
+#include <PvTypes.h>
+#include <PvDefinitions.h>
+#include <Util\CPUFeatures.h>
+
+namespace Planeverb
+{
+	// widest analysis kernel, responses are reduced in groups of this many cells, one per lane
+	const constexpr int PV_ANALYSIS_LANES = 8;
+
+	// analysis windows shared by every response of one analysis, in samples
+	struct AnalysisWindows
+	{
+		int numSamples;				// length of every response
+		int directGainSamples;		// dry energy window from the onset
+		int sourceDirSamples;		// source directivity window from the onset, no longer than the dry window
+		int wetGainSamples;			// wet energy window after the dry window
+		int schroederOffset;		// samples at the end of the response the decay regression ignores
+		int decayBlockLength;		// 0 regresses the decay curve of every sample, otherwise of blocks of this many samples
+		PlaneverbDecayFit decayFit;	// range of the block decay curve that's regressed
+		Real onsetThreshold;		// pressure magnitude of the onset
+	};
+
+	// reductions of one response, everything the analyzer encodes its result from
+	struct ResponseReductions
+	{
+		int onsetSample;			// first audible sample, -1 if there is none and the rest is unset
+		Real dryEnergy;				// pressure energy of the dry window
+		vec2 flux;					// pressure times velocity over the directivity window
+		Real wetEnergy;				// pressure energy of the wet window
+		Real decaySlope;			// regression slope of the energy decay curve in dB per sample
+	};
+
+	// Reduces count responses, 1 to PV_ANALYSIS_LANES of them, of windows.numSamples cells each
+	using AnalysisKernel = void(*)(const AnalysisWindows& windows, const Cell* const* responses, int count, ResponseReductions* out);
+
+	// One set of kernels per instruction set
+	struct AnalysisKernels
+	{
+		AnalysisKernel reduce;		// onset, dry, flux, wet and decay reductions
+		const char* name;			// instruction set name for debug output
+	};
+
+	// Retrieve the kernels for a given instruction set, narrower sets fall back to the scalar kernels
+	const AnalysisKernels& GetAnalysisKernels(SimdLevel level);
+
+	// Per instruction set kernel tables, each is defined in its own translation unit
+	extern const AnalysisKernels g_AnalysisKernelsScalar;
+	extern const AnalysisKernels g_AnalysisKernelsAVX2;
+} // namespace Planeverb
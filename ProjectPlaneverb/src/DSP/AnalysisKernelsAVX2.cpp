@@ -0,0 +1,271 @@
+#include <DSP\AnalysisKernels.h>
+#include <DSP\DecayEstimator.h>
+
+#include <immintrin.h>
+#include <algorithm>
+#include <limits>
+
+namespace Planeverb
+{
+	namespace
+	{
+		const constexpr int LANES = 8;
+		static_assert(LANES == PV_ANALYSIS_LANES, "AVX2 kernel reduces one response per lane");
+
+		// one sample of each lane's response
+		PV_FORCEINLINE __m256 LoadPressure(const Cell* const* r, int t)
+		{
+			return _mm256_setr_ps(r[0][t].pr, r[1][t].pr, r[2][t].pr, r[3][t].pr, r[4][t].pr, r[5][t].pr, r[6][t].pr, r[7][t].pr);
+		}
+
+		PV_FORCEINLINE __m256 LoadVelocityX(const Cell* const* r, int t)
+		{
+			return _mm256_setr_ps(r[0][t].vx, r[1][t].vx, r[2][t].vx, r[3][t].vx, r[4][t].vx, r[5][t].vx, r[6][t].vx, r[7][t].vx);
+		}
+
+		PV_FORCEINLINE __m256 LoadVelocityY(const Cell* const* r, int t)
+		{
+			return _mm256_setr_ps(r[0][t].vy, r[1][t].vy, r[2][t].vy, r[3][t].vy, r[4][t].vy, r[5][t].vy, r[6][t].vy, r[7][t].vy);
+		}
+
+		// lanes where lo <= t < hi
+		PV_FORCEINLINE __m256 InWindow(__m256i t, __m256i lo, __m256i hi)
+		{
+			const __m256i notBelow = _mm256_cmpgt_epi32(_mm256_add_epi32(t, _mm256_set1_epi32(1)), lo);
+			return _mm256_castsi256_ps(_mm256_and_si256(notBelow, _mm256_cmpgt_epi32(hi, t)));
+		}
+
+		// base 10 logarithm of positive values, Cephes' single precision logf polynomial, 0 gives -inf
+		PV_FORCEINLINE __m256 Log10(__m256 x)
+		{
+			const __m256 isZero = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_EQ_OQ);
+
+			// a denormal is its mantissa bits times 2^-149, converting the bits avoids the slow denormal multiply
+			const __m256 isDenormal = _mm256_cmp_ps(x, _mm256_set1_ps(std::numeric_limits<float>::min()), _CMP_LT_OQ);
+			x = _mm256_blendv_ps(x, _mm256_cvtepi32_ps(_mm256_castps_si256(x)), isDenormal);
+			__m256 e = _mm256_and_ps(isDenormal, _mm256_set1_ps(-149.f));
+
+			// x = m * 2^e, m in [0.5, 1)
+			const __m256i bits = _mm256_castps_si256(x);
+			e = _mm256_add_ps(e, _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126))));
+			__m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f000000)));
+
+			// m in [sqrt(0.5), sqrt(2)) - 1
+			const __m256 isSmall = _mm256_cmp_ps(m, _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+			e = _mm256_sub_ps(e, _mm256_and_ps(isSmall, _mm256_set1_ps(1.f)));
+			m = _mm256_sub_ps(_mm256_add_ps(m, _mm256_and_ps(isSmall, m)), _mm256_set1_ps(1.f));
+
+			const __m256 z = _mm256_mul_ps(m, m);
+			__m256 y = _mm256_set1_ps(7.0376836292E-2f);
+			y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-1.1514610310E-1f));
+			y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(1.1676998740E-1f));
+			y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-1.2420140846E-1f));
+			y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(1.4249322787E-1f));
+			y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-1.6668057665E-1f));
+			y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(2.0000714765E-1f));
+			y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(-2.4999993993E-1f));
+			y = _mm256_add_ps(_mm256_mul_ps(y, m), _mm256_set1_ps(3.3333331174E-1f));
+			y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+			y = _mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(-2.12194440E-4f)));
+			y = _mm256_sub_ps(y, _mm256_mul_ps(z, _mm256_set1_ps(0.5f)));
+
+			// ln(x) = m + y + e * ln(2), ln(2) split in two for precision
+			__m256 ln = _mm256_add_ps(m, y);
+			ln = _mm256_add_ps(ln, _mm256_mul_ps(e, _mm256_set1_ps(0.693359375f)));
+
+			const __m256 result = _mm256_mul_ps(ln, _mm256_set1_ps(0.434294481903251827651f));
+			return _mm256_blendv_ps(result, _mm256_set1_ps(-std::numeric_limits<float>::infinity()), isZero);
+		}
+
+		// horizontal sums stay per lane, so every lane adds its samples in the scalar kernel's order
+		void ReduceAVX2(const AnalysisWindows& windows, const Cell* const* responses, int count, ResponseReductions* out)
+		{
+			const int numSamples = windows.numSamples;
+
+			// squares of near silent samples are denormal, one such lane would slow the whole group down,
+			// they're flushed to zero instead, the caller's rounding mode is restored below
+			const unsigned int csr = _mm_getcsr();
+			_mm_setcsr(csr | _MM_FLUSH_ZERO_ON);
+
+			// unused lanes repeat the first response, their results are dropped
+			const Cell* r[LANES];
+			for (int l = 0; l < LANES; ++l)
+				r[l] = responses[l < count ? l : 0];
+
+			// onset delay, first sample above the threshold in every lane
+			alignas(32) int onset[LANES];
+			for (int l = 0; l < LANES; ++l)
+				onset[l] = -1;
+			{
+				const __m256 signMask = _mm256_set1_ps(-0.f);
+				const __m256 threshold = _mm256_set1_ps(windows.onsetThreshold);
+				int found = 0;
+				for (int t = 0; t < numSamples && found != (1 << LANES) - 1; ++t)
+				{
+					const __m256 magnitude = _mm256_andnot_ps(signMask, LoadPressure(r, t));
+					const int audible = _mm256_movemask_ps(_mm256_cmp_ps(magnitude, threshold, _CMP_GT_OQ)) & ~found;
+					if (!audible)
+						continue;
+					found |= audible;
+					for (int l = 0; l < LANES; ++l)
+					{
+						if (audible & (1 << l))
+							onset[l] = t;
+					}
+				}
+			}
+
+			// per lane windows, lanes without onset get empty ones
+			const int endPoint = numSamples - windows.schroederOffset;
+			alignas(32) int sourceDirEnd[LANES], directEnd[LANES], wetEnd[LANES], startingPoint[LANES];
+			int forwardEnd = 0, backwardBegin = endPoint;
+			for (int l = 0; l < LANES; ++l)
+			{
+				if (onset[l] < 0)
+				{
+					sourceDirEnd[l] = directEnd[l] = wetEnd[l] = 0;
+					startingPoint[l] = endPoint;
+					continue;
+				}
+				sourceDirEnd[l] = std::min(onset[l] + windows.sourceDirSamples, numSamples);
+				directEnd[l] = std::min(onset[l] + windows.directGainSamples, numSamples);
+				wetEnd[l] = std::min(directEnd[l] + 1 + windows.wetGainSamples, numSamples);
+				startingPoint[l] = directEnd[l] + 1;
+				forwardEnd = std::max(forwardEnd, std::max(directEnd[l], wetEnd[l]));
+				backwardBegin = std::min(backwardBegin, startingPoint[l]);
+			}
+
+			// dry energy, flux and wet energy in one forward pass
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i sourceDirEndV = _mm256_load_si256(reinterpret_cast<const __m256i*>(sourceDirEnd));
+			const __m256i directEndV = _mm256_load_si256(reinterpret_cast<const __m256i*>(directEnd));
+			const __m256i wetBeginV = _mm256_add_epi32(directEndV, _mm256_set1_epi32(1));
+			const __m256i wetEndV = _mm256_load_si256(reinterpret_cast<const __m256i*>(wetEnd));
+			__m256 dry = _mm256_setzero_ps();
+			__m256 fluxX = _mm256_setzero_ps();
+			__m256 fluxY = _mm256_setzero_ps();
+			__m256 wet = _mm256_setzero_ps();
+			for (int t = 0; t < forwardEnd; ++t)
+			{
+				const __m256i tv = _mm256_set1_epi32(t);
+				const __m256 pr = LoadPressure(r, t);
+				const __m256 energy = _mm256_mul_ps(pr, pr);
+				dry = _mm256_add_ps(dry, _mm256_and_ps(InWindow(tv, zero, directEndV), energy));
+				wet = _mm256_add_ps(wet, _mm256_and_ps(InWindow(tv, wetBeginV, wetEndV), energy));
+
+				const __m256 isSourceDir = InWindow(tv, zero, sourceDirEndV);
+				if (_mm256_movemask_ps(isSourceDir))
+				{
+					fluxX = _mm256_add_ps(fluxX, _mm256_and_ps(isSourceDir, _mm256_mul_ps(pr, LoadVelocityX(r, t))));
+					fluxY = _mm256_add_ps(fluxY, _mm256_and_ps(isSourceDir, _mm256_mul_ps(pr, LoadVelocityY(r, t))));
+				}
+			}
+
+			// backwards Schroeder integral, the tail only accumulates energy, then each lane regresses from its own start
+			__m256 xysum = _mm256_setzero_ps();
+			__m256 ysum = _mm256_setzero_ps();
+			const __m256i startingPointV = _mm256_load_si256(reinterpret_cast<const __m256i*>(startingPoint));
+			if (windows.decayBlockLength == 0)
+			{
+				__m256 energyDecayCurve = _mm256_setzero_ps();
+				for (int i = numSamples - 1; i >= endPoint; --i)
+				{
+					const __m256 pr = LoadPressure(r, i);
+					energyDecayCurve = _mm256_add_ps(energyDecayCurve, _mm256_mul_ps(pr, pr));
+				}
+				const __m256 ten = _mm256_set1_ps(10.f);
+				for (int i = endPoint - 1; i >= backwardBegin; --i)
+				{
+					const __m256i iv = _mm256_set1_epi32(i);
+					const __m256 isRegressed = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_add_epi32(iv, _mm256_set1_epi32(1)), startingPointV));
+					const __m256 pr = LoadPressure(r, i);
+					energyDecayCurve = _mm256_add_ps(energyDecayCurve, _mm256_and_ps(isRegressed, _mm256_mul_ps(pr, pr)));
+
+					const __m256 y = _mm256_mul_ps(ten, Log10(energyDecayCurve));
+					const __m256 x = _mm256_cvtepi32_ps(_mm256_sub_epi32(iv, startingPointV));
+					xysum = _mm256_add_ps(xysum, _mm256_and_ps(isRegressed, _mm256_mul_ps(y, x)));
+					ysum = _mm256_add_ps(ysum, _mm256_and_ps(isRegressed, y));
+				}
+			}
+
+			// block energies, blocks start on multiples of the block length so every lane shares their boundaries,
+			// a lane's first block only has the samples from its start
+			const int blockLength = windows.decayBlockLength;
+			alignas(32) Real blockEnergies[PV_MAX_DECAY_BLOCKS][LANES];
+			alignas(32) Real tailEnergy[LANES];
+			const int firstBlock = blockLength > 0 ? backwardBegin / blockLength : 0;
+			if (blockLength > 0)
+			{
+				for (int begin = backwardBegin; begin < endPoint;)
+				{
+					const int end = std::min((begin / blockLength + 1) * blockLength, endPoint);
+					__m256 energy = _mm256_setzero_ps();
+					for (int i = begin; i < end; ++i)
+					{
+						const __m256i iv = _mm256_set1_epi32(i);
+						const __m256 isRegressed = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_add_epi32(iv, _mm256_set1_epi32(1)), startingPointV));
+						const __m256 pr = LoadPressure(r, i);
+						energy = _mm256_add_ps(energy, _mm256_and_ps(isRegressed, _mm256_mul_ps(pr, pr)));
+					}
+					_mm256_store_ps(blockEnergies[begin / blockLength - firstBlock], energy);
+					begin = end;
+				}
+
+				__m256 tail = _mm256_setzero_ps();
+				for (int i = endPoint; i < numSamples; ++i)
+				{
+					const __m256 pr = LoadPressure(r, i);
+					tail = _mm256_add_ps(tail, _mm256_mul_ps(pr, pr));
+				}
+				_mm256_store_ps(tailEnergy, tail);
+			}
+
+			alignas(32) Real dryOut[LANES], fluxXOut[LANES], fluxYOut[LANES], wetOut[LANES], xysumOut[LANES], ysumOut[LANES];
+			_mm256_store_ps(dryOut, dry);
+			_mm256_store_ps(fluxXOut, fluxX);
+			_mm256_store_ps(fluxYOut, fluxY);
+			_mm256_store_ps(wetOut, wet);
+			_mm256_store_ps(xysumOut, xysum);
+			_mm256_store_ps(ysumOut, ysum);
+			_mm_setcsr(csr);
+
+			for (int l = 0; l < count; ++l)
+			{
+				out[l].onsetSample = onset[l];
+				if (onset[l] < 0)
+					continue;
+				out[l].dryEnergy = dryOut[l];
+				out[l].flux = vec2(fluxXOut[l], fluxYOut[l]);
+				out[l].wetEnergy = wetOut[l];
+
+				// the same fit as the scalar kernel on the lane's blocks
+				if (blockLength > 0)
+				{
+					Real energies[PV_MAX_DECAY_BLOCKS];
+					DecayBlocks blocks;
+					blocks.energies = energies;
+					blocks.numBlocks = 0;
+					blocks.blockLength = blockLength;
+					blocks.firstBlockLength = std::min((startingPoint[l] / blockLength + 1) * blockLength, endPoint) - startingPoint[l];
+					blocks.regressionLength = endPoint - startingPoint[l];
+					blocks.tailEnergy = tailEnergy[l];
+					for (int b = startingPoint[l] / blockLength; startingPoint[l] < endPoint && b * blockLength < endPoint; ++b)
+						energies[blocks.numBlocks++] = blockEnergies[b - firstBlock][l];
+					out[l].decaySlope = EstimateDecaySlope(blocks, windows.decayFit);
+					continue;
+				}
+
+				// same regression as the scalar kernel
+				const Real rn = Real(endPoint - startingPoint[l]);
+				const Real xmean = (rn - 1.0f) * 0.5f;
+				const Real xsum = rn * xmean;
+				const Real denominator = (1.0f / 12.0f) * rn * (rn*rn - 1.0f);
+				const Real ymean = ysumOut[l] / rn;
+				const Real numerator = xysumOut[l] - ymean * xsum - xmean * ysumOut[l] + rn * xmean * ymean;
+				out[l].decaySlope = numerator / denominator;
+			}
+		}
+	} // namespace <>
+
+	const AnalysisKernels g_AnalysisKernelsAVX2 = { ReduceAVX2, "AVX2" };
+} // namespace Planeverb
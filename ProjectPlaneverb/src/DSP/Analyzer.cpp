@@ -1,7 +1,10 @@
 #include <DSP\Analyzer.h>
+#include <DSP\AnalysisKernels.h>
+#include <DSP\DecayEstimator.h>
 #include <FDTD\Grid.h>
 #include <FDTD\FreeGrid.h>
 #include <PvDefinitions.h>
+#include <Util\ThreadUtil.h>
 
 #include <omp.h>
 #include <cmath>
@@ -9,35 +12,81 @@
 #include <utility>
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 
 namespace Planeverb
 {
 	// allocate memory for analysis results
-	Analyzer::Analyzer(Grid * grid, FreeGrid* freeGrid, char* mem) :
-		m_mem(mem),	m_grid(grid), m_freeGrid(freeGrid), m_results(nullptr)
+	Analyzer::Analyzer(const PlaneverbConfig* config, Grid * grid, FreeGrid* freeGrid, char* mem) :
+		m_mem(mem),	m_grid(grid), m_freeGrid(freeGrid), m_results(nullptr),
+		m_numListeners(config->numListeners),
+		m_cache(nullptr), m_cacheSize(config->recordingMode == pv_ProbeRecording || config->lazyAnalysis ? 0 : config->resultCacheSize), m_cacheClock(0),
+		m_fieldEpoch(0), m_lazy(config->lazyAnalysis && config->recordingMode != pv_ProbeRecording)
 	{
 		// set up data
 		vec2 gridSize = m_grid->GetGridSize();
 		m_gridX = (unsigned)gridSize.x;
 		m_gridY = (unsigned)gridSize.y; 
 		m_responseLength = m_grid->GetResponseSize();
-		m_samplingRate = m_grid->GetSamplingRate();
+		m_samplingRate = m_grid->GetResponseSamplingRate();
 		m_dx = grid->GetDX();
-		m_numThreads = grid->GetMaxThreads();
+		m_numThreads = (unsigned)std::max(1, GetThreadCount(config->maxThreadUsage));
+		m_kernels = &GetAnalysisKernels(GetSupportedSimdLevel());
+		m_decodedLength = Grid::GetDecodedResponseLength(config);
+		m_decayBlockSeconds = (Real)config->decayBlockLengthMs * (Real)0.001f;
+		m_decayFit = config->decayFitRange;
 		m_resolution = grid->GetResolution();
 
-		// find size for both grids, allocate pool of memory
-		unsigned size =
-			m_gridX * m_gridY * sizeof(AnalyzerResult) +
-			m_gridX * m_gridY * sizeof(Real);
 		if (!m_mem)
 		{
 			throw pv_NotEnoughMemory;
 		}
 
-		// set grid ptrs into pool
-		m_results = reinterpret_cast<AnalyzerResult*>(m_mem);
-		m_delaySamples = reinterpret_cast<Real*>(m_mem + m_gridX * m_gridY * sizeof(AnalyzerResult));
+		// set grid ptrs into pool, both buffers of every listener's and the cached grids' results, the cache slots,
+		// all the delays, the walk ends, the cell epochs of lazy analysis, then the decode buffers
+		const unsigned numCells = m_gridX * m_gridY;
+		const unsigned numBuffers = 2 * m_numListeners;
+		const unsigned numGrids = numBuffers + m_cacheSize;
+		char* next = m_mem;
+		m_listenerResults = reinterpret_cast<AnalyzerResult*>(next);
+		next += numGrids * numCells * sizeof(AnalyzerResult);
+		m_cache = reinterpret_cast<CachedResults*>(next);
+		next += m_cacheSize * sizeof(CachedResults);
+		m_listenerDelays = reinterpret_cast<Real*>(next);
+		next += numGrids * numCells * sizeof(Real);
+		m_walkEnds = reinterpret_cast<int*>(next);
+		next += numCells * sizeof(int);
+		m_cellEpochs = m_lazy ? reinterpret_cast<unsigned*>(next) : nullptr;
+		next += m_lazy ? numCells * sizeof(unsigned) : 0;
+		m_decodeBuffers = m_decodedLength > 0 ? reinterpret_cast<Cell*>(next) : nullptr;
+		m_results = m_listenerResults;
+		m_delaySamples = m_listenerDelays;
+
+		// cached grids follow the listeners' buffers
+		for (unsigned i = 0; i < m_cacheSize; ++i)
+		{
+			m_cache[i].listenerCell = -1;
+			m_cache[i].geometryVersion = 0;
+			m_cache[i].lastUse = 0;
+			m_cache[i].results = m_listenerResults + (numBuffers + i) * numCells;
+			m_cache[i].delaySamples = m_listenerDelays + (numBuffers + i) * numCells;
+		}
+		for (unsigned i = 0; i < PV_MAX_LISTENERS; ++i)
+		{
+			for (unsigned b = 0; b < 2; ++b)
+			{
+				ResultBuffer& buffer = m_buffers[i][b];
+				const unsigned grid = i < m_numListeners ? 2 * i + b : 0;
+				buffer.results = m_listenerResults + grid * numCells;
+				buffer.delaySamples = m_listenerDelays + grid * numCells;
+				buffer.gridOffset = m_grid->GetGridOffset();
+				buffer.sequence.store(0, std::memory_order_relaxed);
+			}
+			m_published[i].store(&m_buffers[i][0], std::memory_order_relaxed);
+			m_epochs[i].store(0, std::memory_order_relaxed);
+			m_listenerCells[i] = -1;
+			m_listenerVersions[i] = 0;
+		}
 	}
 	Analyzer::~Analyzer()
 	{
@@ -45,21 +94,25 @@ namespace Planeverb
 		//delete[] m_mem;
 	}
 
-	void Analyzer::AnalyzeResponses(const vec3& listenerPosGiven)
+	void Analyzer::AnalyzeResponses(const vec3& listenerPosGiven, unsigned listener, const int* warmCells, int numWarmCells)
 	{
 		vec2 dim((Real)m_gridX, (Real)m_gridY);
 
-		// set OMP thread count
-		if (m_numThreads == 0)
-			omp_set_num_threads(omp_get_max_threads());
-		else
-			omp_set_num_threads(m_numThreads);
+		// early termination changes the response length every simulation
+		m_responseLength = m_grid->GetResponseSize();
 
         int gridSize = (int)m_gridX * (int)m_gridY;
 
+		// the encoders write the listener's back buffer, its results then aren't for any cache key
+		ResultBuffer* buffer = BeginWrite(listener);
+		m_results = buffer->results;
+		m_delaySamples = buffer->delaySamples;
+		m_listenerCells[listener] = -1;
+
+		buffer->gridOffset = m_grid->GetGridOffset();
 		vec3 listenerPos = listenerPosGiven;
-		listenerPos.x += m_grid->GetGridOffset().x;
-		listenerPos.z += m_grid->GetGridOffset().y;
+		listenerPos.x += buffer->gridOffset.x;
+		listenerPos.z += buffer->gridOffset.y;
 
 		// reset delay values
 		Real* delayLooper = m_delaySamples;
@@ -67,52 +120,221 @@ namespace Planeverb
 		for (int i = 0; i < gridSize; ++i)
 			*delayLooper++ = maxVal;
 
-		// each type of analysis can be done in parallel
-		// each index can be done in parallel
-		
-//#pragma omp parallel for
-		for (int serialIndex = 0; serialIndex < gridSize; ++serialIndex)
+		// probe recording only has responses for the cells around emitters, lazy analysis starts from them
+		const bool probes = m_grid->IsProbeRecording();
+		const int numCells = probes ? m_grid->GetNumProbeCells() : m_lazy ? numWarmCells : gridSize;
+		const int* cells = probes ? m_grid->GetProbeCells() : m_lazy ? warmCells : nullptr;
+
+		m_windows.numSamples = (int)m_responseLength;
+		m_windows.directGainSamples = (int)(PV_DRY_GAIN_ANALYSIS_LENGTH * (Real)m_samplingRate);
+		m_windows.sourceDirSamples = (int)(PV_DRY_DIRECTION_ANALYSIS_LENGTH * (Real)m_samplingRate);
+		m_windows.wetGainSamples = (int)(PV_WET_GAIN_ANALYSIS_LENGTH * (Real)m_samplingRate);
+		m_windows.schroederOffset = (int)(PV_SCHROEDER_OFFSET_S * m_samplingRate);
+		m_windows.decayBlockLength = m_decayBlockSeconds > 0.f ? GetDecayBlockLength(m_decayBlockSeconds, m_samplingRate, (int)m_responseLength) : 0;
+		m_windows.decayFit = m_decayFit;
+		m_windows.onsetThreshold = PV_AUDIBLE_THRESHOLD_GAIN;
+		assert(m_windows.sourceDirSamples <= m_windows.directGainSamples && "Analysis kernels assume source directivity is estimated on a shorter interval of time than dry gain.");
+
+		// cells stamped with the new field epoch are analyzed, the stamps restart if it wraps around
+		if (m_lazy && ++m_fieldEpoch == 0)
 		{
-			// convert index to grid position, to retrieve IR
-			vec2 gridIndex;
-			unsigned gridX, gridY;
-			INDEX_TO_POS(gridX, gridY, serialIndex, dim);
-			gridIndex.x = (Real)gridX;
-			gridIndex.y = (Real)gridY;
-			const Cell* response = m_grid->GetResponse(gridIndex);
+			std::fill(m_cellEpochs, m_cellEpochs + gridSize, 0u);
+			m_fieldEpoch = 1;
+		}
 
-            EncodeResponse(serialIndex, gridIndex, response, listenerPos, m_responseLength);
+		// every cell only writes its own result and delay, cells are reduced a group of kernel lanes at a time
+		const int numGroups = (numCells + PV_ANALYSIS_LANES - 1) / PV_ANALYSIS_LANES;
+#pragma omp parallel for schedule(dynamic) num_threads(m_numThreads)
+		for (int group = 0; group < numGroups; ++group)
+		{
+			// compressed responses are decoded into the thread's own buffers
+			Cell* decodeBuffer = m_decodeBuffers ? m_decodeBuffers + omp_get_thread_num() * PV_ANALYSIS_LANES * m_decodedLength : nullptr;
+			int serialIndices[PV_ANALYSIS_LANES];
+			int count = 0;
+
+			const int groupEnd = std::min(numCells, (group + 1) * PV_ANALYSIS_LANES);
+			for (int cell = group * PV_ANALYSIS_LANES; cell < groupEnd; ++cell)
+			{
+				const int serialIndex = cells ? GetSerialIndex(cells[cell]) : cell;
+				if (serialIndex >= 0)
+					serialIndices[count++] = serialIndex;
+			}
+			AnalyzeGroup(serialIndices, count, decodeBuffer, listenerPos);
 		}
 
 		// run a post processing step to find directions based off of delays
-		// can be run in parallel for each grid position
-		
-//#pragma omp parallel for
-		for (int i = 0; i < gridSize; ++i)
+		// walks toward the listener share their ends, which are found once per analysis
+		// lazy analysis analyzes the cells the walks pass on the way
+		std::fill(m_walkEnds, m_walkEnds + gridSize, -1);
+		for (int cell = 0; cell < numCells; ++cell)
 		{
-			// retrieve IR
-			vec2 gridIndex;
-			unsigned gridX, gridY;
-			INDEX_TO_POS(gridX, gridY, i, dim);
-			gridIndex.x = (Real)gridX;
-			gridIndex.y = (Real)gridY;
-			const Cell* response = m_grid->GetResponse(gridIndex);
+			const int i = cells ? GetSerialIndex(cells[cell]) : cell;
+			if (i < 0)
+				continue;
+
+			// analyze for listener direction, only needs the delays found above
+			m_results[i].direction = EncodeListenerDirection(i, listenerPos);
+		}
+
+		Publish(listener, buffer);
+	}
+
+	bool Analyzer::GetResponseResult(const vec3 & emitterPos, unsigned listener, AnalyzerResult& result) const 
+	{
+		const vec3* position = &emitterPos;
+		bool found;
+		GetResponseResults(&position, 1, listener, &result, &found);
+		return found;
+	}
+
+	void Analyzer::GetResponseResults(const vec3* const* emitterPositions, unsigned count, unsigned listener, AnalyzerResult* results, bool* found) const
+	{
+		if (listener >= m_numListeners)
+		{
+			std::fill(found, found + count, false);
+			return;
+		}
+
+		// with probe recording or lazy analysis, cells away from the emitters weren't analyzed
+		const bool sparse = m_grid->IsProbeRecording() || m_lazy;
+		const vec2 dim((Real)m_gridX, (Real)m_gridY);
+
+		// the published buffer is never written, it only gets reused if this thread stalls through a whole
+		// analysis, so this retries rarely and never waits on the analysis
+		for (;;)
+		{
+			const ResultBuffer* buffer = m_published[listener].load(std::memory_order_acquire);
+			const unsigned sequence = buffer->sequence.load(std::memory_order_acquire);
+			if (sequence & 1u)
+				continue;
+
+			// retrieve analyzer result based off of an emitter position in world space
+			const auto& offset = buffer->gridOffset;
+			for (unsigned i = 0; i < count; ++i)
+			{
+				const vec3* emitterPos = emitterPositions[i];
+				found[i] = false;
+				if (!emitterPos)
+					continue;
+
+				unsigned posX = (unsigned)((emitterPos->x + offset.x) / m_dx); //(unsigned)(emitterPos.x + offset.x);
+				unsigned posY = (unsigned)((emitterPos->z + offset.y) / m_dx); //(unsigned)(emitterPos.z + offset.y);
+				if (posX >= m_gridX || posY >= m_gridY)
+					continue;
+				const unsigned index = INDEX(posX, posY, dim);
+
+				// cells outside the simulated regions weren't analyzed either
+				if ((sparse && buffer->delaySamples[index] == std::numeric_limits<Real>::max()) ||
+					!m_grid->IsCellSimulated(m_grid->GetCellIndex(vec2((Real)posX, (Real)posY))))
+					continue;
+				results[i] = buffer->results[index];
+				found[i] = true;
+			}
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (buffer->sequence.load(std::memory_order_relaxed) == sequence)
+				return;
+		}
+	}
 
-			// analyze for listener direction
-			m_results[i].direction = EncodeListenerDirection(i, response, listenerPos, m_responseLength);
+	unsigned Analyzer::GetResultEpoch(unsigned listener) const
+	{
+		if (listener >= m_numListeners)
+			return 0;
+		return m_epochs[listener].load(std::memory_order_acquire);
+	}
+
+	Analyzer::ResultBuffer* Analyzer::BeginWrite(unsigned listener)
+	{
+		ResultBuffer* front = m_published[listener].load(std::memory_order_relaxed);
+		ResultBuffer* back = front == &m_buffers[listener][0] ? &m_buffers[listener][1] : &m_buffers[listener][0];
+
+		// odd sequence before any write to the buffer is visible
+		back->sequence.store(back->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		return back;
+	}
+
+	void Analyzer::Publish(unsigned listener, ResultBuffer* buffer)
+	{
+		buffer->sequence.store(buffer->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		m_published[listener].store(buffer, std::memory_order_release);
+		m_epochs[listener].fetch_add(1, std::memory_order_release);
+	}
+
+	bool Analyzer::UseCachedResults(unsigned listener, int listenerCell, unsigned geometryVersion)
+	{
+		if (m_cacheSize == 0)
+			return false;
+
+		// the listener stayed in its cell
+		if (m_listenerCells[listener] == listenerCell && m_listenerVersions[listener] == geometryVersion)
+			return true;
+
+		for (unsigned i = 0; i < m_cacheSize; ++i)
+		{
+			CachedResults& cached = m_cache[i];
+			if (cached.listenerCell != listenerCell || cached.geometryVersion != geometryVersion)
+				continue;
+
+			// copy into the listener's back buffer and publish it
+			const unsigned numCells = m_gridX * m_gridY;
+			ResultBuffer* buffer = BeginWrite(listener);
+			std::memcpy(buffer->results, cached.results, numCells * sizeof(AnalyzerResult));
+			std::memcpy(buffer->delaySamples, cached.delaySamples, numCells * sizeof(Real));
+			buffer->gridOffset = cached.gridOffset;
+			Publish(listener, buffer);
+			m_listenerCells[listener] = listenerCell;
+			m_listenerVersions[listener] = geometryVersion;
+			cached.lastUse = ++m_cacheClock;
+			return true;
+		}
+		return false;
+	}
+
+	void Analyzer::CacheResults(unsigned listener, int listenerCell, unsigned geometryVersion)
+	{
+		if (m_cacheSize == 0)
+			return;
+
+		m_listenerCells[listener] = listenerCell;
+		m_listenerVersions[listener] = geometryVersion;
+
+		// reuse the slot of the same key, otherwise the least recently used one, unused slots come first
+		CachedResults* slot = &m_cache[0];
+		for (unsigned i = 0; i < m_cacheSize; ++i)
+		{
+			CachedResults& cached = m_cache[i];
+			if (cached.listenerCell == listenerCell && cached.geometryVersion == geometryVersion)
+			{
+				slot = &cached;
+				break;
+			}
+			if (cached.lastUse < slot->lastUse)
+				slot = &cached;
 		}
+
+		// only the analysis thread writes buffers, so the published one is stable here
+		const unsigned numCells = m_gridX * m_gridY;
+		const ResultBuffer* buffer = m_published[listener].load(std::memory_order_relaxed);
+		std::memcpy(slot->results, buffer->results, numCells * sizeof(AnalyzerResult));
+		std::memcpy(slot->delaySamples, buffer->delaySamples, numCells * sizeof(Real));
+		slot->listenerCell = listenerCell;
+		slot->geometryVersion = geometryVersion;
+		slot->gridOffset = buffer->gridOffset;
+		slot->lastUse = ++m_cacheClock;
 	}
 
-	const AnalyzerResult * Analyzer::GetResponseResult(const vec3 & emitterPos) const 
+	int Analyzer::GetSerialIndex(int gridCell) const
 	{
-		// retrieve analyzer result based off of an emitter position in world space
-		const auto& offset = m_grid->GetGridOffset();
-		unsigned posX = (unsigned)((emitterPos.x + offset.x) / m_dx); //(unsigned)(emitterPos.x + offset.x);
-		unsigned posY = (unsigned)((emitterPos.z + offset.y) / m_dx); //(unsigned)(emitterPos.z + offset.y);
-		if (posX > m_gridX || posY > m_gridY)
-			return nullptr;
-		const auto* res = &(m_results[INDEX(posX, posY, vec2((Real)m_gridX, (Real)m_gridY))]);
-		return res;
+		// the grid has an extra row and column for the velocity fields that isn't analyzed
+		const int rowLength = (int)m_grid->GetGridSize().y + 1;
+		const int row = gridCell / rowLength;
+		const int col = gridCell % rowLength;
+		const int serialIndex = (int)INDEX(row, col, vec2((Real)m_gridX, (Real)m_gridY));
+		if (col >= (int)m_gridX || serialIndex >= (int)(m_gridX * m_gridY))
+			return -1;
+		return serialIndex;
 	}
 
 	unsigned Analyzer::GetMemoryRequirement(const PlaneverbConfig * config)
@@ -128,72 +350,98 @@ namespace Planeverb
 		unsigned m_gridX = (unsigned)m_gridSize.x;
 		unsigned m_gridY = (unsigned)m_gridSize.y;
 		
-		// find size for both grids, allocate pool of memory
+		// find size for both grids of both buffers of every listener and of every cached grid, allocate pool of memory
+		const bool probes = config->recordingMode == pv_ProbeRecording;
+		const unsigned cacheSize = probes || config->lazyAnalysis ? 0 : config->resultCacheSize;
+		const unsigned numGrids = 2 * config->numListeners + cacheSize;
 		unsigned size =
-			m_gridX * m_gridY * sizeof(AnalyzerResult) +
-			m_gridX * m_gridY * sizeof(Real);
+			numGrids * m_gridX * m_gridY * sizeof(AnalyzerResult) +
+			cacheSize * sizeof(CachedResults) +
+			numGrids * m_gridX * m_gridY * sizeof(Real) +
+			m_gridX * m_gridY * sizeof(int) +
+			(config->lazyAnalysis && !probes ? m_gridX * m_gridY * sizeof(unsigned) : 0) +
+			std::max(1, GetThreadCount(config->maxThreadUsage)) * PV_ANALYSIS_LANES * Grid::GetDecodedResponseLength(config) * sizeof(Cell);
 
 		return size;
 	}
 
-    void Analyzer::EncodeResponse(unsigned serialIndex, vec2 gridIndex, const Cell* response, const vec3& listenerPos, unsigned n)
-    {
-        const int numSamples = (int)n;
+	void Analyzer::AnalyzeGroup(const int* serialIndices, int count, Cell* decodeBuffer, const vec3& listenerPos)
+	{
+		vec2 dim((Real)m_gridX, (Real)m_gridY);
+		const bool streaming = m_grid->GetAnalysisMode() == pv_StreamingAnalysis;
+		const Cell* responses[PV_ANALYSIS_LANES];
+		unsigned responseIndices[PV_ANALYSIS_LANES];
+		vec2 gridIndices[PV_ANALYSIS_LANES];
+		int numResponses = 0;
 
-        // 
-        // ONSET DELAY
-        // 
-        int onsetSample = 0;
-        for (; onsetSample < numSamples; ++onsetSample)
-        {
-            Real next = response[onsetSample].pr;
-            if (std::abs(next) > PV_AUDIBLE_THRESHOLD_GAIN)
-            {
-                break;
-            }
-        }
+		for (int i = 0; i < count; ++i)
+		{
+			const int serialIndex = serialIndices[i];
+			if (m_lazy)
+				m_cellEpochs[serialIndex] = m_fieldEpoch;
+
+			// convert index to grid position, to retrieve IR
+			vec2 gridIndex;
+			unsigned gridX, gridY;
+			INDEX_TO_POS(gridX, gridY, serialIndex, dim);
+			gridIndex.x = (Real)gridX;
+			gridIndex.y = (Real)gridY;
+
+			// cells outside the simulated regions have no response
+			if (!m_grid->IsCellSimulated(m_grid->GetCellIndex(gridIndex)))
+				continue;
+
+			if (streaming)
+			{
+				EncodeAccumulatedResponse(serialIndex, gridIndex, listenerPos);
+				continue;
+			}
+
+			responses[numResponses] = m_grid->GetResponse(gridIndex, decodeBuffer ? decodeBuffer + numResponses * m_decodedLength : nullptr);
+			if (!responses[numResponses])
+				continue;
+			responseIndices[numResponses] = (unsigned)serialIndex;
+			gridIndices[numResponses] = gridIndex;
+			++numResponses;
+		}
+
+		if (numResponses == 0)
+			return;
+
+		ResponseReductions reductions[PV_ANALYSIS_LANES];
+		m_kernels->reduce(m_windows, responses, numResponses, reductions);
+		for (int i = 0; i < numResponses; ++i)
+		{
+			EncodeResponse(responseIndices[i], gridIndices[i], reductions[i], listenerPos);
+		}
+	}
+
+    void Analyzer::EncodeResponse(unsigned serialIndex, vec2 gridIndex, const ResponseReductions& response, const vec3& listenerPos)
+    {
+        // the analysis kernels reduced the response, see AnalysisKernels.cpp for the meaning of each reduction
 
-        if (onsetSample < numSamples)
-        {
-            m_delaySamples[serialIndex] = (Real)onsetSample;
-        }
         //no onset found, fill infinity and bail, can't encode anything else.
-        else
+        if (response.onsetSample < 0)
         {
             m_delaySamples[serialIndex] = std::numeric_limits<Real>::max();
             return;
         }
+        m_delaySamples[serialIndex] = (Real)response.onsetSample;
 
-        // 
-        // DRY PROCESSING: OBSTRUCTION and SOURCE DIRECTION
-        //
-        int directGainSamples = (int)(PV_DRY_GAIN_ANALYSIS_LENGTH * (Real)m_samplingRate);
-        int sourceDirSamples = (int)(PV_DRY_DIRECTION_ANALYSIS_LENGTH * (Real)m_samplingRate);
-        int sourceDirEnd = onsetSample + sourceDirSamples;
-        int directEnd = onsetSample + directGainSamples;
+        EncodeDry(serialIndex, gridIndex, listenerPos, response.dryEnergy, response.flux);
 
-        assert(sourceDirSamples <= directGainSamples && "Code below assumes source directivity is estimated on a shorter interval of time than dry gain.");
+        // Normalize as if source had unit energy at 1m distance
+        m_results[serialIndex].wetGain = std::sqrt(response.wetEnergy / m_freeGrid->GetEnergyAtOneMeter());
+
+        // T60 = -60dB / slope of the energy decay curve
+        Real slopeDBperSec = response.decaySlope * m_samplingRate;
+        m_results[serialIndex].rt60 = -60.f / slopeDBperSec;
+    }
 
+    void Analyzer::EncodeDry(unsigned serialIndex, vec2 gridIndex, const vec3& listenerPos, Real Edry, vec2 radiationDir)
+    {
         Real obstructionGain = 0.0f;
-        vec2 radiationDir(0,0);
         {
-            Real Edry = 0;
-
-            int j = 0;
-            for (; j < sourceDirEnd; ++j)
-            {
-                const auto& r = response[j];
-                Edry += r.pr * r.pr;
-                radiationDir.x += r.pr * r.vx;
-                radiationDir.y += r.pr * r.vy;
-            }
-
-            for (; j < directEnd; ++j)
-            {
-                const auto& r = response[j];
-                Edry += r.pr * r.pr;
-            }
-
             // Normalize dry energy by free-space energy to obtain geometry-based 
             // obstruction gain with distance attenuation factored out
             Real EfreePr = 0.0f;
@@ -228,103 +476,30 @@ namespace Planeverb
         // Find LPF cutoff frequency by feeding into equation: y = -147 + (18390) / (1 + (x / 12)^0.8 )
         m_results[serialIndex].lowpassIntensity = 
             (Real)-147.f + ((Real)18390.f) / ((Real)1.f + std::pow(r / (Real)12.f, (Real)0.8f));
+    }
 
-        //
-        // Wet gain
-        //
-        Real wetEnergy = 0.0f;
+    void Analyzer::EncodeAccumulatedResponse(unsigned serialIndex, vec2 gridIndex, const vec3& listenerPos)
+    {
+        // the grid already reduced the response to running sums while simulating it,
+        // see EncodeResponse for the meaning of each of them
+        const ResponseAccumulator* accumulator = m_grid->GetAccumulator();
+        const int cellIndex = m_grid->GetStorageIndex(m_grid->GetCellIndex(gridIndex));
+        const AccumulatedResponse& response = accumulator->GetResponse(cellIndex);
+
+        //no onset found, fill infinity and bail, can't encode anything else.
+        if (response.onsetSample < 0)
         {
-            const int wetGainSamples = (int)(PV_WET_GAIN_ANALYSIS_LENGTH * (Real)m_samplingRate);
-            const int end = std::min(directEnd + 1 + wetGainSamples, numSamples);
-            for (int j = directEnd + 1; j < end; j++)
-            {
-                const float p = response[j].pr;
-                wetEnergy += p * p;
-            }
+            m_delaySamples[serialIndex] = std::numeric_limits<Real>::max();
+            return;
         }
+        m_delaySamples[serialIndex] = (Real)response.onsetSample;
 
-        // Normalize as if source had unit energy at 1m distance
-        m_results[serialIndex].wetGain = std::sqrt(wetEnergy / m_freeGrid->GetEnergyAtOneMeter());
+        EncodeDry(serialIndex, gridIndex, listenerPos, response.dryEnergy, response.flux);
 
-        //
-        // Decay Time
-        //
-        {
-            // FIND THE T60 OF A SIGNAL
-            //==========================
-            //
-            // Use backwards Schroeder integration
-            //         ^ inf
-            // I(t) = | (P(t))^2 dt
-            //       v t
-            //
-            // For each point in the signal starting at the end, going backwards until the end of the impulse
-            // the intensity at the point is sum of the signal squared.
-            // Effectively: 
-            //	s[i], i = 0...N-1 is the signal
-            //	EnergyDecayCurve[i] = sum(s[i...N-1]^2)
-            //	EnergyDecayCurveDB[i] = 10*log10(EnergyDecayCurve[i])
-            // Taking the slope of the generated curve will give the T60
-            // slope of I(t), given f = max seconds, the slope is the simple linear regression, as above:
-            //
-            // B = sum((x_i - xbar) * (y_i - ybar), 1, n)
-            //	   ----------------------------------------
-            //		     sum( (x_i - xbar)^2, 1, n )
-            // i = index
-            // x_i = t
-            // xbar = average of x_i
-            // y_i = EnergyDecayCurveDB[i]
-            // ybar = average of y_i
-            // 
-            // To find the T60: 
-            // T60 = -60dB / B
-
-            int startingPoint = directEnd + 1;
-            // linear regression ignores some fixed bit of tail of energy decay curve which dips towards 0
-            int endPoint = numSamples - (int)(PV_SCHROEDER_OFFSET_S * m_samplingRate);
-            int regressN = endPoint - startingPoint;
-            Real rn = Real(regressN);
-
-            // We regress assuming time-step is 1 and startingPoint is x=0.
-            // The latter offset does not change slope, and time-step adjustment is done at end.
-            Real xmean = (rn - 1.0f) * 0.5f;
-            Real xsum = rn * xmean;
-            
-            // Sum[(x-xmean)^2] = Sum[(i - ((n - 1)/2))^2, {i, 0, n - 1}] = 1/12 n (-1 + n^2)
-            Real denominator = (1.0f / 12.0f) * rn * (rn*rn - 1.0f);
-
-            // Backward energy integral
-            Real energyDecayCurve = 0.f;
-            Real energyDecayCurveDB = 0.f;
-            Real xysum = 0;
-            Real ysum = 0;
-
-            // For tail bit just accumulate energy, no regression
-            for (int i = numSamples - 1; i >= endPoint; --i)
-            {
-                auto p = response[i].pr;
-                energyDecayCurve += p * p;
-            }
-
-            for (int i = endPoint-1; i >= startingPoint; --i)
-            {
-                auto p = response[i].pr;
-                energyDecayCurve += p * p;
-                energyDecayCurveDB = 10.f * std::log10(energyDecayCurve);
-
-                Real y_i = energyDecayCurveDB;
-                auto x_i = (i - startingPoint);
-                xysum += y_i * x_i;
-                ysum += y_i;
-            }
+        // Normalize as if source had unit energy at 1m distance
+        m_results[serialIndex].wetGain = std::sqrt(response.wetEnergy / m_freeGrid->GetEnergyAtOneMeter());
 
-            Real ymean = ysum / rn;
-            Real numerator = xysum - ymean * xsum - xmean * ysum + rn * xmean * ymean;
-            
-            Real slopeDBperSample = numerator / denominator;
-            Real slopeDBperSec = slopeDBperSample * m_samplingRate;
-            m_results[serialIndex].rt60 = -60.f / slopeDBperSec;
-        }
+        m_results[serialIndex].rt60 = accumulator->EstimateDecayTime(cellIndex, (int)m_responseLength);
     }
 
 	namespace
@@ -337,81 +512,143 @@ namespace Planeverb
 		};
 	} // namespace <>
 
-    vec2 Analyzer::EncodeListenerDirection(unsigned index, const Cell * response, const vec3& listenerPos, unsigned numSamples)
+    void Analyzer::AnalyzeNeighbors(int index, const vec3& listenerPos)
     {
-        Real loudness = m_results[index].occlusion;
         vec2 dim((Real)m_gridX, (Real)m_gridY);
-        int nextIndex = index;
-        const constexpr Real maxDelay = std::numeric_limits<Real>::max();
-        Real delay = maxDelay;
-        Real nextDelay = maxDelay;
-        Real samplingRate = (Real)m_samplingRate;
-        Real wavelength = PV_C / (Real)m_resolution;
-        const Real threshold = (Real)0.3f;
-        Real thresholdDist = threshold * wavelength;
+        int r, c;
+        INDEX_TO_POS(r, c, index, dim);
 
-        // loop while not close to the listener
-        while (delay > PV_DELAY_CLOSE_THRESHOLD && loudness < PV_DISTANCE_GAIN_THRESHOLD)
+        // there are as many neighbors as kernel lanes, so they're reduced together
+        int serialIndices[_countof(POSSIBLE_NEIGHBORS)];
+        int count = 0;
+        for (int i = 0; i < _countof(POSSIBLE_NEIGHBORS); ++i)
         {
-            int r, c;
-            INDEX_TO_POS(r, c, nextIndex, dim);
-            Real nextLoudness = 0.f;
-            Real nextDelay = maxDelay;
+            int nr = r + POSSIBLE_NEIGHBORS[i].first;
+            int nc = c + POSSIBLE_NEIGHBORS[i].second;
+            if (nr < 0 || nc < 0 || nr >= (int)dim.x || nc >= (int)dim.y)
+                continue;
+
+            int newPosIndex = INDEX(nr, nc, dim);
+            if (m_cellEpochs[newPosIndex] != m_fieldEpoch)
+                serialIndices[count++] = newPosIndex;
+        }
 
-            // for each neighbor find the neighbor with the smallest delay time
-            for (int i = 0; i < _countof(POSSIBLE_NEIGHBORS); ++i)
+        // the walks run on the analysis thread, which decodes into the first thread's buffers
+        for (int i = 0; i < count; i += PV_ANALYSIS_LANES)
+            AnalyzeGroup(serialIndices + i, std::min(PV_ANALYSIS_LANES, count - i), m_decodeBuffers, listenerPos);
+    }
+
+    int Analyzer::GetEarliestNeighbor(int index, const vec3& listenerPos)
+    {
+        // lazy analysis only knows the delays of the neighbors once they're analyzed
+        if (m_lazy)
+            AnalyzeNeighbors(index, listenerPos);
+
+        vec2 dim((Real)m_gridX, (Real)m_gridY);
+        int r, c;
+        INDEX_TO_POS(r, c, index, dim);
+
+        // the first neighbor with the smallest delay
+        int earliest = -1;
+        Real earliestDelay = std::numeric_limits<Real>::max();
+        for (int i = 0; i < _countof(POSSIBLE_NEIGHBORS); ++i)
+        {
+            int nr = r + POSSIBLE_NEIGHBORS[i].first;
+            int nc = c + POSSIBLE_NEIGHBORS[i].second;
+            if (nr < 0 || nc < 0 || nr >= (int)dim.x || nc >= (int)dim.y)
+                continue;
+
+            int newPosIndex = INDEX(nr, nc, dim);
+            auto& result = m_results[newPosIndex];
+            Real delay = m_delaySamples[newPosIndex];
+            if ((unsigned)delay == m_responseLength || result.occlusion == 0.f)
+                continue;
+            else if (delay < earliestDelay && result.occlusion > 0.f)
             {
-                int nr = r + POSSIBLE_NEIGHBORS[i].first;
-                int nc = c + POSSIBLE_NEIGHBORS[i].second;
-                if (nr < 0 || nc < 0 || nr >= (int)dim.x || nc >= (int)dim.y)
-                    continue;
-
-                int newPosIndex = INDEX(nr, nc, dim);
-                auto& result = m_results[newPosIndex];
-                Real delay = m_delaySamples[newPosIndex];
-                if ((unsigned)delay == numSamples || result.occlusion == 0.f)
-                    continue;
-                else if (delay < nextDelay && result.occlusion > 0.f)
-                {
-                    nextLoudness = result.occlusion;
-                    nextIndex = newPosIndex;
-                    nextDelay = delay;
-                }
+                earliest = newPosIndex;
+                earliestDelay = delay;
             }
+        }
+        return earliest;
+    }
 
-            // case couldn't find a valid neighbor
-            if (nextDelay == std::numeric_limits<Real>::max() || nextDelay >= delay)
+    int Analyzer::GetWalkStep(int index, const vec3& listenerPos, bool& stop)
+    {
+        // close to the listener, or loud enough to be heard directly
+        stop = true;
+        const Real delay = m_delaySamples[index];
+        if (delay <= PV_DELAY_CLOSE_THRESHOLD || m_results[index].occlusion >= PV_DISTANCE_GAIN_THRESHOLD)
+            return index;
+
+        // line of sight check, the sound took the straight path to the cell
+        vec2 dim((Real)m_gridX, (Real)m_gridY);
+        const Real wavelength = PV_C / (Real)m_resolution;
+        const Real threshold = (Real)0.3f;
+        const Real thresholdDist = threshold * wavelength;
+        Real geodesicDist = PV_C * delay / (Real)m_samplingRate;
+        int r, c;
+        INDEX_TO_POS(r, c, index, dim);
+        vec2 temp((Real)r * m_dx - listenerPos.x, (Real)c * m_dx - listenerPos.z);
+        Real euclideanDist = std::sqrt((temp.x * temp.x) + (temp.y * temp.y));
+        if (std::abs(geodesicDist - euclideanDist) < thresholdDist)
+            return index;
+
+        // only walk toward the listener, the walk stops on a neighbor the sound didn't reach earlier
+        const int next = GetEarliestNeighbor(index, listenerPos);
+        if (next < 0)
+            return index;
+        stop = m_delaySamples[next] >= delay;
+        return next;
+    }
+
+    int Analyzer::GetWalkEnd(int index, const vec3& listenerPos)
+    {
+        // follow the walk to a cell that stops it or whose end is known, marking the cells on the way with
+        // -2 - next, delays strictly decrease along it so it can't loop
+        int cell = index;
+        while (m_walkEnds[cell] == -1)
+        {
+            bool stop;
+            const int next = GetWalkStep(cell, listenerPos, stop);
+            if (stop)
             {
+                m_walkEnds[cell] = next;
                 break;
             }
+            m_walkEnds[cell] = -2 - next;
+            cell = next;
+        }
+        const int end = m_walkEnds[cell];
 
-            delay = nextDelay;
-            loudness = nextLoudness;
-
-            // line of sight check
-            Real geodesicDist = PV_C * nextDelay / samplingRate;
-            int r2, c2;
-            INDEX_TO_POS(r2, c2, nextIndex, dim);
-
-            // convert grid position to worldspace
-            Real ex = (Real)r2 * m_dx;
-            Real ey = (Real)c2 * m_dx;
-
-            // find vector between and normalize
-            vec2 temp(ex - listenerPos.x, ey - listenerPos.z);
-            Real euclideanDist = (temp.x * temp.x) + (temp.y * temp.y);;
-            euclideanDist = std::sqrt(euclideanDist);
-            Real distCheck = std::abs(geodesicDist - euclideanDist);
-            bool isInLineOfSight = distCheck < thresholdDist;
-            if (isInLineOfSight)
-                break;
+        // every cell on the way shares the end
+        for (cell = index; m_walkEnds[cell] <= -2;)
+        {
+            const int next = -2 - m_walkEnds[cell];
+            m_walkEnds[cell] = end;
+            cell = next;
         }
+        return end;
+    }
 
-        // find direction vector between nextIndex and listener position
+    vec2 Analyzer::EncodeListenerDirection(unsigned index, const vec3& listenerPos)
+    {
+        // Walk from the cell to the neighbor with the smallest delay until close to the listener, loud enough,
+        // in line of sight of it, or no neighbor is closer. Past the first step the walk only depends on the
+        // cell it reached, so the walks of neighboring cells merge, and each cell's end is found once.
+        int end = (int)index;
+        if (m_results[index].occlusion < PV_DISTANCE_GAIN_THRESHOLD)
+        {
+            const int first = GetEarliestNeighbor((int)index, listenerPos);
+            if (first >= 0)
+                end = GetWalkEnd(first, listenerPos);
+        }
+
+        // find direction vector between the end and listener position
 
         // convert 1D index to 2D grid position
+        vec2 dim((Real)m_gridX, (Real)m_gridY);
         int r, c;
-        INDEX_TO_POS(r, c, nextIndex, dim);
+        INDEX_TO_POS(r, c, end, dim);
 
         // convert grid position to worldspace
         Real ex = (Real)r * m_dx;
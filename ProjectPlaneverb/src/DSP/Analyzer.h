@@ -1,6 +1,8 @@
 #pragma once
 
 #include <PvTypes.h>	// vec2, vec3, Real
+#include <DSP\AnalysisKernels.h>
+#include <atomic>
 
 namespace Planeverb
 {
@@ -24,19 +26,97 @@ namespace Planeverb
 	class Analyzer
 	{
 	public:
-		Analyzer(Grid* grid, FreeGrid* freeGrid, char* mem);
+		Analyzer(const PlaneverbConfig* config, Grid* grid, FreeGrid* freeGrid, char* mem);
 		~Analyzer();
 
-        void AnalyzeResponses(const vec3& listenerPos);
-		const AnalyzerResult* GetResponseResult(const vec3& emitterPos) const;
+		// every listener has its own results, the grid's responses must be those of the listener analyzed
+		// results are analyzed into a back buffer and published when complete
+		// lazy analysis only analyzes the warm cells, flat grid indices like the grid's probe cells, and the
+		// cells their directions are traced through, the other cells have no results
+        void AnalyzeResponses(const vec3& listenerPos, unsigned listener = 0, const int* warmCells = nullptr, int numWarmCells = 0);
+
+		// copies the listener's published result for the emitter, false if there is none
+		// safe to call from any thread while the listener is being analyzed, never blocks
+		bool GetResponseResult(const vec3& emitterPos, unsigned listener, AnalyzerResult& result) const;
+		// the same for count emitters from one published buffer, found[i] is false where there is no result,
+		// nullptr positions have none
+		void GetResponseResults(const vec3* const* emitterPositions, unsigned count, unsigned listener, AnalyzerResult* results, bool* found) const;
+
+		// number of times results were published for the listener, 0 before the first
+		unsigned GetResultEpoch(unsigned listener = 0) const;
+
+		// result reuse, keyed by the listener's grid cell and the grid's geometry version
+		// UseCachedResults returns true if the listener's results are already those of the key, or were
+		// restored from the cache, the listener then doesn't need to be simulated
+		bool UseCachedResults(unsigned listener, int listenerCell, unsigned geometryVersion);
+		// call after analyzing a listener for a key, evicts the least recently used grid if the cache is full
+		void CacheResults(unsigned listener, int listenerCell, unsigned geometryVersion);
 		static unsigned GetMemoryRequirement(const struct PlaneverbConfig* config);
 
 	private:
-        void EncodeResponse(unsigned serialIndex, vec2 gridIndex, const Cell* response, const vec3& listenerPos, unsigned numSamples);
-		vec2 EncodeListenerDirection(unsigned index, const Cell* response, const vec3& listenerPos, unsigned numSamples);
+		// one grid of results and delays, each listener has one published and one being written
+		// sequence is odd while the buffer is written, readers that raced a reuse of the buffer retry
+		struct ResultBuffer
+		{
+			AnalyzerResult* results;
+			Real* delaySamples;
+			vec2 gridOffset;					// grid offset the results were analyzed with, the grid may move since
+			std::atomic<unsigned> sequence;
+		};
+
+		// one cached grid of results and delays
+		struct CachedResults
+		{
+			int listenerCell;			// -1 if the slot is unused
+			unsigned geometryVersion;	// grid geometry the results were analyzed with
+			unsigned lastUse;			// m_cacheClock when last stored or restored
+			vec2 gridOffset;			// grid offset the results were analyzed with
+			AnalyzerResult* results;
+			Real* delaySamples;
+		};
+
+		// analyzes up to PV_ANALYSIS_LANES cells, serial indices, decoding compressed responses into the buffer
+		void AnalyzeGroup(const int* serialIndices, int count, Cell* decodeBuffer, const vec3& listenerPos);
+		// lazy analysis, analyzes the neighbors of a cell not analyzed yet in this field epoch
+		void AnalyzeNeighbors(int index, const vec3& listenerPos);
+
+        void EncodeResponse(unsigned serialIndex, vec2 gridIndex, const ResponseReductions& response, const vec3& listenerPos);
+        void EncodeAccumulatedResponse(unsigned serialIndex, vec2 gridIndex, const vec3& listenerPos);
+        void EncodeDry(unsigned serialIndex, vec2 gridIndex, const vec3& listenerPos, Real Edry, vec2 radiationDir);
+		vec2 EncodeListenerDirection(unsigned index, const vec3& listenerPos);
+
+		// the walk toward the listener, neighbor with the smallest delay, -1 if none
+		int GetEarliestNeighbor(int index, const vec3& listenerPos);
+		// next cell of the walk once it reached a cell, stop is set if the walk ends on the returned cell
+		int GetWalkStep(int index, const vec3& listenerPos, bool& stop);
+		// cell the walk stops at once it reached a cell, resolved once per analysis
+		int GetWalkEnd(int index, const vec3& listenerPos);
+
+		// analyzer index of a flat grid index, -1 if the cell isn't analyzed
+		int GetSerialIndex(int gridCell) const;
+
+		// back buffer of a listener, BeginWrite marks it as being written, Publish swaps it to the front
+		ResultBuffer* BeginWrite(unsigned listener);
+		void Publish(unsigned listener, ResultBuffer* buffer);
+
 		char* m_mem;				// pool of memory
-		AnalyzerResult* m_results;	// 2D grid using 1D memory, grid of results
-		Real* m_delaySamples;		// grid of delay, to be used to find direction
+		AnalyzerResult* m_results;	// 2D grid using 1D memory, grid of results of the listener being analyzed
+		Real* m_delaySamples;		// grid of delay, to be used to find direction, of the listener being analyzed
+		int* m_walkEnds;			// grid of walk ends of the listener being analyzed, -1 until found
+		unsigned* m_cellEpochs;		// lazy analysis, field epoch each cell was last analyzed in, nullptr otherwise
+		unsigned m_fieldEpoch;		// lazy analysis, counts analyses, cells stamped with it are analyzed
+		bool m_lazy;				// only analyze the warm cells and the cells their directions need
+		AnalyzerResult* m_listenerResults;	// two grids of results per listener
+		Real* m_listenerDelays;		// two grids of delays per listener
+		unsigned m_numListeners;	// number of listeners
+		ResultBuffer m_buffers[PV_MAX_LISTENERS][2];				// front and back buffer of each listener
+		std::atomic<ResultBuffer*> m_published[PV_MAX_LISTENERS];	// front buffer of each listener
+		std::atomic<unsigned> m_epochs[PV_MAX_LISTENERS];			// publications of each listener
+		int m_listenerCells[PV_MAX_LISTENERS];			// cell each listener's results are for, -1 if unknown
+		unsigned m_listenerVersions[PV_MAX_LISTENERS];	// geometry version each listener's results are for
+		CachedResults* m_cache;		// cached grids, m_cacheSize of them
+		unsigned m_cacheSize;		// number of cached grids, 0 disables reuse
+		unsigned m_cacheClock;		// counts cache accesses for least recently used eviction
 
 		Grid* m_grid;				// handle to the grid system
 		FreeGrid* m_freeGrid;		// handle to the free grid system
@@ -45,6 +125,12 @@ namespace Planeverb
 		unsigned m_responseLength;	// number of samples per IR
 		unsigned m_samplingRate;	// sampling rate for conversions (samples per second)
 		unsigned m_numThreads;		// number of threads the module is allowed to use
+		const AnalysisKernels* m_kernels;	// response reductions for the widest instruction set the CPU supports
+		AnalysisWindows m_windows;	// windows of the analysis in progress
+		Cell* m_decodeBuffers;		// compressed analysis decodes a group of responses per thread, nullptr otherwise
+		unsigned m_decodedLength;	// cells per decoded response
+		Real m_decayBlockSeconds;	// block length of the energy decay curve, 0 regresses every sample
+		PlaneverbDecayFit m_decayFit;	// range of the block energy decay curve that's regressed
 		int m_resolution;			// grid resolution
 
 	};
@@ -0,0 +1,298 @@
+#include <DSP\BakedResults.h>
+#include <DSP\Analyzer.h>
+#include <FDTD\Grid.h>
+#include <FDTD\FreeGrid.h>
+#include <Geometry\GeometryManager.h>
+#include <Context\PvContext.h>
+#include <Util\HalfFloat.h>
+#include <Planeverb.h>
+#include <PvDefinitions.h>
+
+// keep std::min and std::max usable
+#define NOMINMAX
+#include <Windows.h>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace Planeverb
+{
+	namespace
+	{
+		const constexpr char BAKED_FILE_MAGIC[4] = { 'P', 'V', 'B', 'K' };
+
+		// written next to the other temporary files, then moved over the destination once complete
+		const constexpr char* BAKED_TEMP_FILE_NAME = "PlaneverbBake.tmp";
+
+		// analyzed cells of a grid, the grid's extra velocity row and column aren't analyzed
+		void GetAnalyzedCells(const PlaneverbConfig* config, unsigned& gridX, unsigned& gridY, Real& dx)
+		{
+			Real dt;
+			unsigned samplingRate;
+			CalculateGridParameters(config->gridResolution, dx, dt, samplingRate);
+			gridX = (unsigned)((1.f / dx) * config->gridSizeInMeters.x);
+			gridY = (unsigned)((1.f / dx) * config->gridSizeInMeters.y);
+		}
+
+		std::int8_t QuantizeUnit(Real value)
+		{
+			return (std::int8_t)std::lround(std::min(std::max(value, (Real)-1.f), (Real)1.f) * (Real)127.f);
+		}
+
+		BakedResult Quantize(const AnalyzerResult* result)
+		{
+			BakedResult baked;
+			if (!result)
+			{
+				std::memset(&baked, 0, sizeof(baked));
+				baked.occlusion = FloatToHalf(PV_INVALID_DRY_GAIN);
+				return baked;
+			}
+
+			baked.occlusion = FloatToHalf((float)result->occlusion);
+			baked.wetGain = FloatToHalf((float)result->wetGain);
+			baked.rt60 = FloatToHalf((float)result->rt60);
+			baked.lowpassIntensity = FloatToHalf((float)result->lowpassIntensity);
+			baked.direction[0] = QuantizeUnit(result->direction.x);
+			baked.direction[1] = QuantizeUnit(result->direction.y);
+			baked.sourceDirectivity[0] = QuantizeUnit(result->sourceDirectivity.x);
+			baked.sourceDirectivity[1] = QuantizeUnit(result->sourceDirectivity.y);
+			return baked;
+		}
+
+		void Normalize(vec2& v)
+		{
+			Real length = v.x * v.x + v.y * v.y;
+			if (length != 0.f)
+			{
+				length = std::sqrt(length);
+				v.x /= length;
+				v.y /= length;
+			}
+		}
+	} // namespace <>
+
+#pragma region ClientInterface
+	bool BakeResults(const char* filePath, const AABB* listenerArea, float listenerSpacing)
+	{
+		auto* context = GetContext();
+		if (!context || !filePath || listenerSpacing <= 0.f)
+			return false;
+
+		// bake every cell for one listener at a time, the regions were only valid while the context was created
+		PlaneverbConfig config = *context->GetConfig();
+		config.recordingMode = pv_FullFieldRecording;
+		config.lazyAnalysis = false;
+		config.simulatedRegions = nullptr;
+		config.numSimulatedRegions = 0;
+		config.gridFollowsListener = false;
+		config.numListeners = 1;
+		config.bakedResultsFile = nullptr;
+
+		// listener lattice, the whole grid unless an area is given
+		const vec2& offset = config.gridWorldOffset;
+		Real minX = -offset.x, minZ = -offset.y;
+		Real maxX = config.gridSizeInMeters.x - offset.x, maxZ = config.gridSizeInMeters.y - offset.y;
+		if (listenerArea)
+		{
+			minX = std::max(minX, listenerArea->position.x - listenerArea->width / (Real)2.f);
+			maxX = std::min(maxX, listenerArea->position.x + listenerArea->width / (Real)2.f);
+			minZ = std::max(minZ, listenerArea->position.y - listenerArea->height / (Real)2.f);
+			maxZ = std::min(maxZ, listenerArea->position.y + listenerArea->height / (Real)2.f);
+			if (maxX < minX || maxZ < minZ)
+				return false;
+		}
+
+		BakedFileHeader header;
+		std::memcpy(header.magic, BAKED_FILE_MAGIC, sizeof(header.magic));
+		header.version = PV_BAKED_FILE_VERSION;
+		header.gridResolution = config.gridResolution;
+		Real dx;
+		GetAnalyzedCells(&config, header.gridX, header.gridY, dx);
+		header.dx = (float)dx;
+		header.gridOffsetX = (float)offset.x;
+		header.gridOffsetZ = (float)offset.y;
+		header.latticeOriginX = (float)minX;
+		header.latticeOriginZ = (float)minZ;
+		header.latticeSpacing = listenerSpacing;
+		header.latticeCountX = (std::uint32_t)((maxX - minX) / listenerSpacing) + 1;
+		header.latticeCountZ = (std::uint32_t)((maxZ - minZ) / listenerSpacing) + 1;
+
+		// a private grid with a snapshot of the geometry, the running simulation isn't disturbed
+		// each probe's simulation uses all of the config's threads
+		std::vector<char> gridMem(Grid::GetMemoryRequirement(&config));
+		std::vector<char> analyzerMem(Analyzer::GetMemoryRequirement(&config));
+		Grid grid(&config, gridMem.data());
+		Analyzer analyzer(&config, &grid, context->GetFreeGrid(), analyzerMem.data());
+		context->GetGeometryManager()->VoxelizeInto(&grid);
+
+		std::string tempPath = config.tempFileDirectory;
+		if (!tempPath.empty() && tempPath.back() != '\\' && tempPath.back() != '/')
+			tempPath += '\\';
+		tempPath += BAKED_TEMP_FILE_NAME;
+		std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+		if (!file)
+			return false;
+		bool written = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+		std::vector<BakedResult> probeResults(header.gridX * header.gridY);
+		for (std::uint32_t ix = 0; written && ix < header.latticeCountX; ++ix)
+		{
+			for (std::uint32_t iz = 0; written && iz < header.latticeCountZ; ++iz)
+			{
+				const vec3 listener(minX + (Real)ix * listenerSpacing, 0.f, minZ + (Real)iz * listenerSpacing);
+				grid.GenerateResponse(listener);
+				analyzer.AnalyzeResponses(listener);
+
+				// look the cells up by world position so cells without a result are marked invalid
+				AnalyzerResult result;
+				for (std::uint32_t x = 0; x < header.gridX; ++x)
+				{
+					for (std::uint32_t y = 0; y < header.gridY; ++y)
+					{
+						const vec3 emitter(((Real)x + (Real)0.5f) * dx - offset.x, 0.f, ((Real)y + (Real)0.5f) * dx - offset.y);
+						probeResults[x * header.gridY + y] = Quantize(analyzer.GetResponseResult(emitter, 0, result) ? &result : nullptr);
+					}
+				}
+				written = std::fwrite(probeResults.data(), sizeof(BakedResult), probeResults.size(), file) == probeResults.size();
+			}
+		}
+
+		written = std::fclose(file) == 0 && written;
+		if (!written || !MoveFileExA(tempPath.c_str(), filePath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED))
+		{
+			std::remove(tempPath.c_str());
+			return false;
+		}
+		return true;
+	}
+#pragma endregion
+
+	BakedResults::BakedResults(const char* filePath, const PlaneverbConfig* config) :
+		m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr), m_view(nullptr),
+		m_header(nullptr), m_results(nullptr)
+	{
+		// map the whole file read only
+		m_file = CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		LARGE_INTEGER fileSize;
+		if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(BakedFileHeader))
+		{
+			Close();
+			throw pv_InvalidConfig;
+		}
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		m_view = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (!m_view)
+		{
+			Close();
+			throw pv_InvalidConfig;
+		}
+		m_header = reinterpret_cast<const BakedFileHeader*>(m_view);
+		m_results = reinterpret_cast<const BakedResult*>(m_header + 1);
+
+		// the file must be complete and baked with this config's grid
+		unsigned gridX, gridY;
+		Real dx;
+		GetAnalyzedCells(config, gridX, gridY, dx);
+		const unsigned long long numResults = (unsigned long long)m_header->latticeCountX * m_header->latticeCountZ * gridX * gridY;
+		if (std::memcmp(m_header->magic, BAKED_FILE_MAGIC, sizeof(m_header->magic)) != 0 ||
+			m_header->version != PV_BAKED_FILE_VERSION ||
+			m_header->gridResolution != config->gridResolution ||
+			m_header->gridX != gridX || m_header->gridY != gridY ||
+			m_header->latticeSpacing <= 0.f ||
+			(unsigned long long)fileSize.QuadPart != sizeof(BakedFileHeader) + numResults * sizeof(BakedResult))
+		{
+			Close();
+			throw pv_InvalidConfig;
+		}
+	}
+
+	BakedResults::~BakedResults()
+	{
+		Close();
+	}
+
+	void BakedResults::Close()
+	{
+		if (m_view)
+			UnmapViewOfFile(m_view);
+		if (m_mapping)
+			CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE)
+			CloseHandle(m_file);
+		m_view = nullptr;
+		m_mapping = nullptr;
+		m_file = INVALID_HANDLE_VALUE;
+		m_header = nullptr;
+		m_results = nullptr;
+	}
+
+	bool BakedResults::ContainsListener(const vec3& listenerPos) const
+	{
+		const Real spacing = m_header->latticeSpacing;
+		const Real x = listenerPos.x - m_header->latticeOriginX;
+		const Real z = listenerPos.z - m_header->latticeOriginZ;
+		return x >= 0.f && z >= 0.f &&
+			x <= (Real)(m_header->latticeCountX - 1) * spacing &&
+			z <= (Real)(m_header->latticeCountZ - 1) * spacing;
+	}
+
+	bool BakedResults::GetResult(const vec3& listenerPos, const vec3& emitterPos, AnalyzerResult& result) const
+	{
+		if (!ContainsListener(listenerPos))
+			return false;
+
+		// emitter cell in the grid the file was baked with
+		const unsigned gridX = m_header->gridX, gridY = m_header->gridY;
+		const Real ex = (emitterPos.x + m_header->gridOffsetX) / m_header->dx;
+		const Real ey = (emitterPos.z + m_header->gridOffsetZ) / m_header->dx;
+		if (ex < 0.f || ey < 0.f || (unsigned)ex >= gridX || (unsigned)ey >= gridY)
+			return false;
+		const unsigned cell = (unsigned)ex * gridY + (unsigned)ey;
+
+		// the probe cell holding the listener, a lattice with a single probe along an axis has no second one
+		const Real fx = (listenerPos.x - m_header->latticeOriginX) / m_header->latticeSpacing;
+		const Real fz = (listenerPos.z - m_header->latticeOriginZ) / m_header->latticeSpacing;
+		const unsigned ix = std::min((unsigned)fx, m_header->latticeCountX > 1 ? m_header->latticeCountX - 2 : 0u);
+		const unsigned iz = std::min((unsigned)fz, m_header->latticeCountZ > 1 ? m_header->latticeCountZ - 2 : 0u);
+		const Real tx = std::min(fx - (Real)ix, (Real)1.f);
+		const Real tz = std::min(fz - (Real)iz, (Real)1.f);
+
+		// bilinear blend of the probes that have a result, weights are renormalized over them
+		std::memset(&result, 0, sizeof(result));
+		Real totalWeight = 0.f;
+		for (unsigned corner = 0; corner < 4; ++corner)
+		{
+			const unsigned px = std::min(ix + (corner & 1u), m_header->latticeCountX - 1);
+			const unsigned pz = std::min(iz + (corner >> 1), m_header->latticeCountZ - 1);
+			const Real weight = ((corner & 1u) ? tx : (Real)1.f - tx) * ((corner >> 1) ? tz : (Real)1.f - tz);
+			const BakedResult& baked = m_results[((unsigned long long)px * m_header->latticeCountZ + pz) * gridX * gridY + cell];
+			const Real occlusion = (Real)HalfToFloat(baked.occlusion);
+			if (weight <= 0.f || occlusion < 0.f)
+				continue;
+
+			totalWeight += weight;
+			result.occlusion += weight * occlusion;
+			result.wetGain += weight * (Real)HalfToFloat(baked.wetGain);
+			result.rt60 += weight * (Real)HalfToFloat(baked.rt60);
+			result.lowpassIntensity += weight * (Real)HalfToFloat(baked.lowpassIntensity);
+			result.direction.x += weight * (Real)baked.direction[0] / (Real)127.f;
+			result.direction.y += weight * (Real)baked.direction[1] / (Real)127.f;
+			result.sourceDirectivity.x += weight * (Real)baked.sourceDirectivity[0] / (Real)127.f;
+			result.sourceDirectivity.y += weight * (Real)baked.sourceDirectivity[1] / (Real)127.f;
+		}
+		if (totalWeight <= 0.f)
+			return false;
+
+		result.occlusion /= totalWeight;
+		result.wetGain /= totalWeight;
+		result.rt60 /= totalWeight;
+		result.lowpassIntensity /= totalWeight;
+		Normalize(result.direction);
+		Normalize(result.sourceDirectivity);
+		return true;
+	}
+} // namespace Planeverb
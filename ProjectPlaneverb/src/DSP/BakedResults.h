@@ -0,0 +1,66 @@
+#pragma once
+
+#include <PvTypes.h>	// vec2, vec3, Real
+#include <cstdint>
+
+namespace Planeverb
+{
+	// Forward declares
+	struct AnalyzerResult;
+
+	// Baked file layout, a header followed by every listener probe's grid of results
+	// probe (ix, iz) sits at latticeOrigin + (ix, iz) * latticeSpacing and is stored at ix * latticeCountZ + iz
+	struct BakedFileHeader
+	{
+		char magic[4];				// "PVBK"
+		std::uint32_t version;		// PV_BAKED_FILE_VERSION
+		std::int32_t gridResolution;	// resolution the grid was baked with
+		std::uint32_t gridX, gridY;	// analyzed cells per probe
+		float dx;					// meters per cell
+		float gridOffsetX;			// grid world offset at bake time
+		float gridOffsetZ;
+		float latticeOriginX;		// world position of the first listener probe
+		float latticeOriginZ;
+		float latticeSpacing;		// meters between listener probes
+		std::uint32_t latticeCountX, latticeCountZ;	// listener probes along x and z
+	};
+
+	// One quantized AnalyzerResult, gains and decay as half floats, unit vectors as signed bytes
+	// 12 bytes
+	struct BakedResult
+	{
+		std::uint16_t occlusion;	// PV_INVALID_DRY_GAIN if the cell has no result
+		std::uint16_t wetGain;
+		std::uint16_t rt60;
+		std::uint16_t lowpassIntensity;
+		std::int8_t direction[2];
+		std::int8_t sourceDirectivity[2];
+	};
+
+	const constexpr std::uint32_t PV_BAKED_FILE_VERSION = 1;
+
+	// Read only view of a baked file, memory mapped so only the probes that are looked up are paged in
+	class BakedResults
+	{
+	public:
+		// throws pv_InvalidConfig if the file can't be mapped or wasn't baked for this grid
+		BakedResults(const char* filePath, const struct PlaneverbConfig* config);
+		~BakedResults();
+
+		// true if the listener is inside the baked lattice, its results then come from the file
+		bool ContainsListener(const vec3& listenerPos) const;
+
+		// interpolates the 4 listener probes around the listener, false if it's outside the lattice
+		// or none of them has a result for the emitter's cell
+		bool GetResult(const vec3& listenerPos, const vec3& emitterPos, AnalyzerResult& result) const;
+
+	private:
+		void Close();
+
+		void* m_file;					// file handle
+		void* m_mapping;				// file mapping handle
+		const void* m_view;				// mapped file
+		const BakedFileHeader* m_header;	// start of the mapped file
+		const BakedResult* m_results;	// every probe's results, right after the header
+	};
+} // namespace Planeverb
@@ -0,0 +1,85 @@
+#include <DSP\DecayEstimator.h>
+
+#include <algorithm>
+
+namespace Planeverb
+{
+	namespace
+	{
+		// dB per unit of log2
+		const constexpr Real DB_PER_LOG2 = (Real)3.0103f;
+		// the fit ranges start this far below the curve's start, past the early decay
+		const constexpr Real DECAY_FIT_HEADROOM_DB = (Real)5.f;
+
+		// weighted least squares sums
+		struct Regression
+		{
+			Real wsum = 0.f, xsum = 0.f, ysum = 0.f, xxsum = 0.f, xysum = 0.f;
+			int numPoints = 0;
+
+			void Add(Real w, Real x, Real y)
+			{
+				wsum += w;
+				xsum += w * x;
+				ysum += w * y;
+				xxsum += w * x * x;
+				xysum += w * x * y;
+				++numPoints;
+			}
+
+			Real GetSlope() const
+			{
+				return (wsum * xysum - xsum * ysum) / (wsum * xxsum - xsum * xsum);
+			}
+		};
+	} // namespace <>
+
+	Real EstimateDecaySlope(const DecayBlocks& blocks, PlaneverbDecayFit fit)
+	{
+		// Assuming energy is spread evenly in a block, the energy decay curve averaged over the
+		// block's samples is the energy after the block plus (n + 1) / 2n of the block's energy,
+		// which is exact for blocks of one sample. Every block weighs as many samples as it covers.
+		Real energyDecayCurve = blocks.tailEnergy;
+		Real totalEnergy = blocks.tailEnergy;
+		for (int b = 0; b < blocks.numBlocks; ++b)
+			totalEnergy += blocks.energies[b];
+
+		// fit range below the level at the start of the curve
+		Real fitTop = std::numeric_limits<Real>::infinity();
+		Real fitBottom = -std::numeric_limits<Real>::infinity();
+		if (fit != pv_DecayFitFull)
+		{
+			fitTop = DB_PER_LOG2 * FastLog2(totalEnergy) - DECAY_FIT_HEADROOM_DB;
+			fitBottom = fitTop - (fit == pv_DecayFitT20 ? (Real)20.f : (Real)30.f);
+		}
+
+		// x is relative to the middle of the range, which keeps the float sums from cancelling out
+		const Real center = (Real)blocks.regressionLength * 0.5f;
+		Regression full, ranged;
+		for (int b = blocks.numBlocks - 1; b >= 0; --b)
+		{
+			const int first = b == 0 ? 0 : blocks.firstBlockLength + (b - 1) * blocks.blockLength;
+			const int count = std::min(b == 0 ? blocks.firstBlockLength : blocks.blockLength, blocks.regressionLength - first);
+			const Real n = (Real)count;
+
+			const Real blockEnergy = blocks.energies[b];
+			const Real y = DB_PER_LOG2 * FastLog2(energyDecayCurve + blockEnergy * (n + 1.f) / (2.f * n));
+			const Real x = (Real)first + (n - 1.f) * 0.5f - center;
+			energyDecayCurve += blockEnergy;
+
+			full.Add(n, x, y);
+			if (y <= fitTop && y >= fitBottom)
+				ranged.Add(n, x, y);
+		}
+
+		return ranged.numPoints >= 2 ? ranged.GetSlope() : full.GetSlope();
+	}
+
+	int GetDecayBlockLength(Real blockLengthSeconds, unsigned samplingRate, int responseLength)
+	{
+		// a range that doesn't start on a block boundary has one block more than its length needs
+		const int blockLength = std::max(1, (int)(blockLengthSeconds * (Real)samplingRate));
+		const int minBlockLength = (responseLength + PV_MAX_DECAY_BLOCKS - 2) / (PV_MAX_DECAY_BLOCKS - 1);
+		return std::max(blockLength, minBlockLength);
+	}
+} // namespace Planeverb
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <PvTypes.h>		// Real, PlaneverbDecayFit
+#include <PvDefinitions.h>	// PV_FORCEINLINE
+#include <cstring>
+#include <limits>
+
+namespace Planeverb
+{
+	// most blocks the analysis kernels keep per response, the block length grows for longer responses
+	const constexpr int PV_MAX_DECAY_BLOCKS = 512;
+
+	// log2 of a positive value, its exponent plus a cubic of its mantissa, within 0.0011 (0.0033 dB)
+	// denormals are rough, 0 gives -inf
+	PV_FORCEINLINE Real FastLog2(Real x)
+	{
+		if (!(x > 0.f))
+			return -std::numeric_limits<Real>::infinity();
+
+		unsigned bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		const Real exponent = (Real)((int)(bits >> 23) - 127);
+		bits = (bits & 0x007fffffu) | 0x3f800000u;
+		Real t;
+		std::memcpy(&t, &bits, sizeof(t));
+		t -= 1.f;
+		return exponent + t * ((Real)1.42f + t * ((Real)-0.5717036f + t * (Real)0.1517036f));
+	}
+
+	// energy decay curve of a response decimated into blocks, the regression range starts at sample 0
+	struct DecayBlocks
+	{
+		const Real* energies;		// pressure energy of every block of the regression range, in time order
+		int numBlocks;
+		int blockLength;			// samples per block
+		int firstBlockLength;		// samples of the first block, the range can start inside a block
+		int regressionLength;		// samples of the regression range, the last block can be cut short
+		Real tailEnergy;			// energy after the regression range
+	};
+
+	// slope in dB per sample of the backward Schroeder integral in dB, fitted on the block centers,
+	// one log per block, falls back to the full range if the fit range has fewer than two blocks
+	Real EstimateDecaySlope(const DecayBlocks& blocks, PlaneverbDecayFit fit);
+
+	// samples per block for a configured block length, long enough that a response has at most
+	// PV_MAX_DECAY_BLOCKS of them
+	int GetDecayBlockLength(Real blockLengthSeconds, unsigned samplingRate, int responseLength);
+} // namespace Planeverb
@@ -0,0 +1,114 @@
+#include <DSP\ResponseAccumulator.h>
+#include <DSP\DecayEstimator.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace Planeverb
+{
+	namespace
+	{
+		// mirrors the analysis windows used by Analyzer::AnalyzeResponses
+		struct Windows
+		{
+			int directGainSamples;
+			int sourceDirSamples;
+			int wetGainSamples;
+			int regressionEnd;
+			int schroederOffset;
+			int decayBlockLength;
+			int numDecayBlocks;
+		};
+
+		Windows GetWindows(unsigned responseLength, unsigned samplingRate)
+		{
+			Windows w;
+			w.directGainSamples = (int)(PV_DRY_GAIN_ANALYSIS_LENGTH * (Real)samplingRate);
+			w.sourceDirSamples = (int)(PV_DRY_DIRECTION_ANALYSIS_LENGTH * (Real)samplingRate);
+			w.wetGainSamples = (int)(PV_WET_GAIN_ANALYSIS_LENGTH * (Real)samplingRate);
+			w.schroederOffset = (int)(PV_SCHROEDER_OFFSET_S * samplingRate);
+			w.regressionEnd = (int)responseLength - w.schroederOffset;
+			w.decayBlockLength = std::max(1, (int)(PV_DECAY_BLOCK_LENGTH_S * (Real)samplingRate));
+
+			// the regression starts one sample after the dry window, at the earliest an onset at 0
+			int maxRegressionLength = std::max(0, w.regressionEnd - w.directGainSamples - 1);
+			w.numDecayBlocks = (maxRegressionLength + w.decayBlockLength - 1) / w.decayBlockLength;
+			return w;
+		}
+	} // namespace <>
+
+	ResponseAccumulator::ResponseAccumulator(unsigned numCells, unsigned responseLength, unsigned samplingRate, PlaneverbDecayFit decayFit, char * mem) :
+		m_cells(nullptr),
+		m_decayBlocks(nullptr),
+		m_samplingRate(samplingRate),
+		m_decayFit(decayFit)
+	{
+		if (!mem)
+		{
+			throw pv_NotEnoughMemory;
+		}
+
+		Windows w = GetWindows(responseLength, samplingRate);
+		m_directGainSamples = w.directGainSamples;
+		m_sourceDirSamples = w.sourceDirSamples;
+		m_wetGainSamples = w.wetGainSamples;
+		m_regressionEnd = w.regressionEnd;
+		m_schroederOffset = w.schroederOffset;
+		m_decayBlockLength = w.decayBlockLength;
+		m_numDecayBlocks = w.numDecayBlocks;
+
+		m_cells = reinterpret_cast<AccumulatedResponse*>(mem);
+		m_decayBlocks = reinterpret_cast<Real*>(mem + numCells * sizeof(AccumulatedResponse));
+		Reset(0, (int)numCells);
+	}
+
+	void ResponseAccumulator::Reset(int begin, int end)
+	{
+		if (end <= begin)
+			return;
+
+		for (int i = begin; i < end; ++i)
+		{
+			AccumulatedResponse& cell = m_cells[i];
+			cell.onsetSample = -1;
+			cell.dryEnergy = 0.f;
+			cell.flux = vec2(0.f, 0.f);
+			cell.wetEnergy = 0.f;
+			cell.tailEnergy = 0.f;
+		}
+		std::memset(m_decayBlocks + begin * m_numDecayBlocks, 0, (end - begin) * m_numDecayBlocks * sizeof(Real));
+	}
+
+	Real ResponseAccumulator::EstimateDecayTime(int index, int responseLength) const
+	{
+		// same backward Schroeder integration as the analysis kernels, on the blocks kept while simulating
+		const AccumulatedResponse& cell = m_cells[index];
+		const Real* blocks = m_decayBlocks + index * m_numDecayBlocks;
+		const int startingPoint = cell.onsetSample + m_directGainSamples + 1;
+		const int regressionEnd = std::min(m_regressionEnd, responseLength - m_schroederOffset);
+		const int regressN = regressionEnd - startingPoint;
+		const int numBlocks = std::min(regressN > 0 ? (regressN + m_decayBlockLength - 1) / m_decayBlockLength : 0, m_numDecayBlocks);
+
+		// a shorter simulation moves the tail's start into the blocks
+		DecayBlocks curve;
+		curve.energies = blocks;
+		curve.numBlocks = numBlocks;
+		curve.blockLength = m_decayBlockLength;
+		curve.firstBlockLength = m_decayBlockLength;
+		curve.regressionLength = regressN;
+		curve.tailEnergy = cell.tailEnergy;
+		for (int b = std::max(numBlocks, 0); b < m_numDecayBlocks; ++b)
+			curve.tailEnergy += blocks[b];
+
+		Real slopeDBperSample = EstimateDecaySlope(curve, m_decayFit);
+		Real slopeDBperSec = slopeDBperSample * m_samplingRate;
+		return -60.f / slopeDBperSec;
+	}
+
+	unsigned ResponseAccumulator::GetMemoryRequirement(unsigned numCells, unsigned responseLength, unsigned samplingRate)
+	{
+		Windows w = GetWindows(responseLength, samplingRate);
+		return numCells * sizeof(AccumulatedResponse) +
+			numCells * w.numDecayBlocks * sizeof(Real);
+	}
+} // namespace Planeverb
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <PvTypes.h>		// vec2, Real
+#include <PvDefinitions.h>	// PV_FORCEINLINE
+#include <cmath>
+
+namespace Planeverb
+{
+	// Running analysis state of one cell's impulse response
+	struct AccumulatedResponse
+	{
+		int onsetSample;	// first sample above the audible threshold, -1 until found
+		Real dryEnergy;		// pressure energy up to the end of the dry gain window
+		vec2 flux;			// pressure times velocity up to the end of the source direction window
+		Real wetEnergy;		// pressure energy of the early reflections
+		Real tailEnergy;	// pressure energy past the end of the decay regression
+	};
+
+	// Analyzes every cell's impulse response while the grid simulates it, so no response history is kept.
+	// Onset, dry energy, source flux and wet energy are exact running sums. The decay time needs a
+	// backward integral, so energy after the dry window is kept in coarse blocks instead of per sample.
+	class ResponseAccumulator
+	{
+	public:
+		ResponseAccumulator(unsigned numCells, unsigned responseLength, unsigned samplingRate, PlaneverbDecayFit decayFit, char* mem);
+		~ResponseAccumulator() = default;
+
+		// reset cells [begin, end) before a simulation
+		void Reset(int begin, int end);
+
+		// add sample t of a cell's response, samples of a cell must arrive in order
+		PV_FORCEINLINE void Accumulate(int index, int t, Real pr, Real vx, Real vy)
+		{
+			AccumulatedResponse& cell = m_cells[index];
+			const Real energy = pr * pr;
+
+			// before the onset every sample is inside the dry and source direction windows
+			if (cell.onsetSample < 0)
+			{
+				if (std::abs(pr) > PV_AUDIBLE_THRESHOLD_GAIN)
+				{
+					cell.onsetSample = t;
+				}
+				else
+				{
+					cell.dryEnergy += energy;
+					cell.flux.x += pr * vx;
+					cell.flux.y += pr * vy;
+					return;
+				}
+			}
+
+			const int sinceOnset = t - cell.onsetSample;
+			if (sinceOnset < m_sourceDirSamples)
+			{
+				cell.flux.x += pr * vx;
+				cell.flux.y += pr * vy;
+			}
+			if (sinceOnset < m_directGainSamples)
+			{
+				cell.dryEnergy += energy;
+				return;
+			}
+
+			// the sample at the end of the dry window belongs to neither the dry nor the wet part
+			const int sinceDirectEnd = sinceOnset - m_directGainSamples - 1;
+			if (sinceDirectEnd < 0)
+				return;
+
+			if (sinceDirectEnd < m_wetGainSamples)
+			{
+				cell.wetEnergy += energy;
+			}
+
+			if (t >= m_regressionEnd)
+			{
+				cell.tailEnergy += energy;
+			}
+			else
+			{
+				m_decayBlocks[index * m_numDecayBlocks + sinceDirectEnd / m_decayBlockLength] += energy;
+			}
+		}
+
+		const AccumulatedResponse& GetResponse(int index) const { return m_cells[index]; }
+
+		// decay time in seconds from the Schroeder backward integral of a cell's blocks, fitted on the decay fit range
+		// responseLength is the number of samples simulated, less than the max with early termination
+		Real EstimateDecayTime(int index, int responseLength) const;
+
+		static unsigned GetMemoryRequirement(unsigned numCells, unsigned responseLength, unsigned samplingRate);
+
+	private:
+		AccumulatedResponse* m_cells;	// per cell running sums
+		Real* m_decayBlocks;			// per cell block energies, m_numDecayBlocks per cell
+
+		unsigned m_samplingRate;		// samples per second
+		int m_directGainSamples;		// length of the dry gain window
+		int m_sourceDirSamples;			// length of the source direction window
+		int m_wetGainSamples;			// length of the early reflection window
+		int m_regressionEnd;			// first sample of the tail that's cut off from the regression
+		int m_schroederOffset;			// length of the tail that's cut off from the regression
+		int m_decayBlockLength;			// samples per decay block
+		int m_numDecayBlocks;			// decay blocks per cell
+		PlaneverbDecayFit m_decayFit;	// range of the energy decay curve the decay time is fitted to
+	};
+} // namespace Planeverb
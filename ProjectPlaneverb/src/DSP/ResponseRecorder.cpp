@@ -0,0 +1,217 @@
+#include <DSP\ResponseRecorder.h>
+#include <Util\HalfFloat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace Planeverb
+{
+	namespace
+	{
+		// Kaiser windowed (beta 4) half-band low-pass, 23 taps. Every even tap but the center is zero
+		// and the filter is symmetric, so only the odd taps on one side are stored.
+		// -0.04 dB at the grid's max frequency, -46 dB where the decimated signal would alias into it.
+		const constexpr int FILTER_LENGTH = 23;
+		const constexpr int FILTER_DELAY = FILTER_LENGTH / 2;
+		const constexpr int NUM_ODD_TAPS = (FILTER_DELAY + 1) / 2;
+		const constexpr Real FILTER_CENTER_TAP = (Real)0.5f;
+		const constexpr Real FILTER_ODD_TAPS[NUM_ODD_TAPS] =
+		{
+			(Real)0.314129180f, (Real)-0.093223972f, (Real)0.043869689f,
+			(Real)-0.021075078f, (Real)0.008863324f, (Real)-0.002563142f,
+		};
+
+		// the pulse peaks at 1, the scale keeps the quiet tail of a response out of the
+		// half float subnormals while leaving room for pressures up to 16 at the source
+		const constexpr Real HALF_SCALE = (Real)4096.f;
+		const constexpr Real INV_HALF_SCALE = (Real)1.f / HALF_SCALE;
+
+		const constexpr int NUM_FIELDS = 3;
+
+		std::uint16_t Compress(Real value)
+		{
+			return FloatToHalf(value * HALF_SCALE);
+		}
+
+		Real Decompress(std::uint16_t value)
+		{
+			return HalfToFloat(value) * INV_HALF_SCALE;
+		}
+
+		unsigned GetVelocityLength(unsigned decimatedSamplingRate)
+		{
+			return (unsigned)(PV_DRY_DIRECTION_ANALYSIS_LENGTH * (Real)decimatedSamplingRate);
+		}
+	} // namespace <>
+
+	ResponseRecorder::ResponseRecorder(unsigned numCells, unsigned responseLength, unsigned samplingRate, char * mem) :
+		m_pressure(nullptr),
+		m_velocity(nullptr),
+		m_onsetSample(nullptr),
+		m_onsetStep(nullptr),
+		m_history(nullptr),
+		m_numCells(numCells),
+		m_length(GetDecimatedLength(responseLength)),
+		m_samplingRate(GetDecimatedSamplingRate(samplingRate)),
+		m_velocityLength((int)GetVelocityLength(GetDecimatedSamplingRate(samplingRate)))
+	{
+		if (!mem)
+		{
+			throw pv_NotEnoughMemory;
+		}
+
+		// history first, it's the only float array
+		char* temp = mem;
+		m_history = reinterpret_cast<Real*>(temp);				temp += NUM_FIELDS * FILTER_LENGTH * numCells * sizeof(Real);
+		m_onsetSample = reinterpret_cast<int*>(temp);			temp += numCells * sizeof(int);
+		m_onsetStep = reinterpret_cast<int*>(temp);				temp += numCells * sizeof(int);
+		m_pressure = reinterpret_cast<std::uint16_t*>(temp);	temp += numCells * m_length * sizeof(std::uint16_t);
+		m_velocity = reinterpret_cast<std::uint16_t*>(temp);
+		Reset(0, (int)numCells);
+	}
+
+	void ResponseRecorder::Reset(int begin, int end)
+	{
+		if (end <= begin)
+			return;
+
+		for (int i = begin; i < end; ++i)
+		{
+			m_onsetSample[i] = -1;
+			m_onsetStep[i] = -1;
+		}
+
+		// time steps before the first one read as silence
+		for (int slot = 0; slot < NUM_FIELDS * FILTER_LENGTH; ++slot)
+		{
+			std::memset(m_history + slot * m_numCells + begin, 0, (end - begin) * sizeof(Real));
+		}
+
+		// pre-onset velocity is never written
+		std::memset(m_velocity + begin * 2 * m_velocityLength, 0, (end - begin) * 2 * m_velocityLength * sizeof(std::uint16_t));
+	}
+
+	void ResponseRecorder::RecordSilence(int index, int steps)
+	{
+		// outputs are computed FILTER_DELAY steps after their center, history slots of the skipped steps are still 0
+		const int count = std::min((int)m_length, std::max(0, (steps - FILTER_DELAY + 1) / 2));
+		std::memset(m_pressure + index * m_length, 0, count * sizeof(std::uint16_t));
+	}
+
+	void ResponseRecorder::Record(int begin, int end, int t, const Real* pr, const Real* vx, const Real* vy)
+	{
+		const int count = end - begin;
+		const unsigned fieldLength = FILTER_LENGTH * m_numCells;
+
+		// push this time step into the history
+		const int slot = t % FILTER_LENGTH;
+		std::memcpy(m_history + slot * m_numCells + begin, pr, count * sizeof(Real));
+		std::memcpy(m_history + fieldLength + slot * m_numCells + begin, vx, count * sizeof(Real));
+		std::memcpy(m_history + 2 * fieldLength + slot * m_numCells + begin, vy, count * sizeof(Real));
+
+		for (int i = 0; i < count; ++i)
+		{
+			if (m_onsetStep[begin + i] < 0 && std::abs(pr[i]) > PV_AUDIBLE_THRESHOLD_GAIN)
+				m_onsetStep[begin + i] = t;
+		}
+
+		// the output at time step center needs FILTER_DELAY steps after it, only every other one is kept
+		const int center = t - FILTER_DELAY;
+		if (center < 0 || (center & 1))
+			return;
+		const int m = center / 2;
+		if (m >= (int)m_length)
+			return;
+
+		// history slots of the taps, steps before 0 land on slots that haven't been written yet and read as 0
+		int centerSlot = center % FILTER_LENGTH;
+		int beforeSlots[NUM_ODD_TAPS];
+		int afterSlots[NUM_ODD_TAPS];
+		for (int k = 0; k < NUM_ODD_TAPS; ++k)
+		{
+			const int offset = 2 * k + 1;
+			beforeSlots[k] = (center - offset + FILTER_LENGTH) % FILTER_LENGTH;
+			afterSlots[k] = (center + offset) % FILTER_LENGTH;
+		}
+
+		auto filter = [&](const Real* history, int i)
+		{
+			Real y = FILTER_CENTER_TAP * history[centerSlot * m_numCells + i];
+			for (int k = 0; k < NUM_ODD_TAPS; ++k)
+			{
+				y += FILTER_ODD_TAPS[k] * (history[beforeSlots[k] * m_numCells + i] + history[afterSlots[k] * m_numCells + i]);
+			}
+			return y;
+		};
+
+		for (int i = begin; i < end; ++i)
+		{
+			// nothing audible has arrived yet, don't keep the filter's pre-ringing
+			const int onsetStep = m_onsetStep[i];
+			if (onsetStep < 0 || center < onsetStep)
+			{
+				m_pressure[i * m_length + m] = 0;
+				continue;
+			}
+
+			const std::uint16_t p = Compress(filter(m_history, i));
+			m_pressure[i * m_length + m] = p;
+
+			// onset is found on the stored value so analysis of the decoded response agrees with it
+			int& onset = m_onsetSample[i];
+			if (onset < 0 && std::abs(Decompress(p)) > PV_AUDIBLE_THRESHOLD_GAIN)
+			{
+				onset = m;
+			}
+
+			// velocity only matters for the source direction, right after the onset
+			if (onset >= 0 && m - onset < m_velocityLength)
+			{
+				std::uint16_t* velocity = m_velocity + i * 2 * m_velocityLength;
+				velocity[m - onset] = Compress(filter(m_history + fieldLength, i));
+				velocity[m_velocityLength + m - onset] = Compress(filter(m_history + 2 * fieldLength, i));
+			}
+		}
+	}
+
+	void ResponseRecorder::Decode(int index, Cell * out, unsigned length, int b, int by) const
+	{
+		const std::uint16_t* pressure = m_pressure + index * m_length;
+		const std::uint16_t* velocity = m_velocity + index * 2 * m_velocityLength;
+		const int onset = m_onsetSample[index];
+
+		for (int m = 0; m < (int)std::min(length, m_length); ++m)
+		{
+			Real vx = 0.f, vy = 0.f;
+			if (onset >= 0 && m >= onset && m - onset < m_velocityLength)
+			{
+				vx = Decompress(velocity[m - onset]);
+				vy = Decompress(velocity[m_velocityLength + m - onset]);
+			}
+			out[m] = Cell(Decompress(pressure[m]), vx, vy, b, by);
+		}
+	}
+
+	unsigned ResponseRecorder::GetMemoryRequirement(unsigned numCells, unsigned responseLength, unsigned samplingRate)
+	{
+		return
+			NUM_FIELDS * FILTER_LENGTH * numCells * sizeof(Real) +	// filter history
+			2 * numCells * sizeof(int) +	// onsets
+			numCells * GetDecimatedLength(responseLength) * sizeof(std::uint16_t) +	// pressure
+			numCells * 2 * GetVelocityLength(GetDecimatedSamplingRate(samplingRate)) * sizeof(std::uint16_t);	// velocity
+	}
+
+	unsigned ResponseRecorder::GetDecimatedLength(unsigned responseLength)
+	{
+		// every other time step whose filter delay has passed before the simulation ends
+		if (responseLength <= (unsigned)FILTER_DELAY)
+			return 0;
+		return (responseLength - FILTER_DELAY - 1) / 2 + 1;
+	}
+
+	unsigned ResponseRecorder::GetDecimatedSamplingRate(unsigned samplingRate)
+	{
+		return samplingRate / 2;
+	}
+} // namespace Planeverb
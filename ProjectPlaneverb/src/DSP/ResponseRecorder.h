@@ -0,0 +1,53 @@
+#pragma once
+
+#include <PvTypes.h>	// Cell, Real
+#include <cstdint>
+
+namespace Planeverb
+{
+	// Records every cell's impulse response in a compressed form.
+	// Pressure is low-pass filtered and decimated by 2 with a half-band filter, the grid's sampling rate
+	// is over 5x its max frequency so nothing below it is lost, and stored as scaled half floats.
+	// Velocity is only kept for the source direction window after the onset, the b and by fields not at all.
+	// The filter's pre-ringing before the wavefront arrives would be well above the audible threshold, so
+	// samples before the first audible time step are stored as silence, like the unfiltered response.
+	class ResponseRecorder
+	{
+	public:
+		ResponseRecorder(unsigned numCells, unsigned responseLength, unsigned samplingRate, char* mem);
+		~ResponseRecorder() = default;
+
+		// reset cells [begin, end) before a simulation
+		void Reset(int begin, int end);
+
+		// add sample t of cells [begin, end), pr[0], vx[0] and vy[0] belong to cell begin
+		// samples of a cell must arrive in order
+		void Record(int begin, int end, int t, const Real* pr, const Real* vx, const Real* vy);
+
+		// the first steps time steps of a cell weren't recorded because it was known to be at rest
+		void RecordSilence(int index, int steps);
+
+		// expand the first length samples of a cell's response, at most GetLength()
+		void Decode(int index, Cell* out, unsigned length, int b, int by) const;
+
+		// decimated response length and sampling rate
+		unsigned GetLength() const { return m_length; }
+		unsigned GetSamplingRate() const { return m_samplingRate; }
+
+		static unsigned GetMemoryRequirement(unsigned numCells, unsigned responseLength, unsigned samplingRate);
+		static unsigned GetDecimatedLength(unsigned responseLength);
+		static unsigned GetDecimatedSamplingRate(unsigned samplingRate);
+
+	private:
+		std::uint16_t* m_pressure;		// per cell decimated pressure, m_length per cell
+		std::uint16_t* m_velocity;		// per cell x and y velocity of the source direction window, 2 * m_velocityLength per cell
+		int* m_onsetSample;				// per cell first decimated sample above the audible threshold, -1 until found
+		int* m_onsetStep;				// per cell first time step above the audible threshold, -1 until found
+		Real* m_history;				// filter input history, [field][slot][cell] so a time step's slot is contiguous
+
+		unsigned m_numCells;			// number of cells recorded
+		unsigned m_length;				// decimated samples per cell
+		unsigned m_samplingRate;		// decimated samples per second
+		int m_velocityLength;			// decimated samples of the source direction window
+	};
+} // namespace Planeverb
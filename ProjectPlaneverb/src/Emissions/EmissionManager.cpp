@@ -1,9 +1,20 @@
 #include <Emissions\EmissionManager.h>
 #include <Planeverb.h>
 #include <Context\PvContext.h>
+#include <FDTD\Grid.h>
+#include <PvDefinitions.h>
+#include <Context\CommandQueue.h>
+
+#include <algorithm>
 
 namespace Planeverb
 {
+	namespace
+	{
+		// emitter updates pushed to the command queue at once
+		const constexpr unsigned EMISSION_COMMAND_BATCH = 32;
+	} // namespace <>
+
 #pragma region ClientInterface
 	EmissionID Emit(const vec3& emitterPosition)
 	{
@@ -20,6 +31,13 @@ namespace Planeverb
 			context->GetEmissionManager()->UpdateEmission(id, position);
 	}
 
+	void UpdateEmissions(const EmissionID* ids, const vec3* positions, unsigned count)
+	{
+		auto* context = GetContext();
+		if (context)
+			context->GetEmissionManager()->UpdateEmissions(ids, positions, count);
+	}
+
 	void EndEmission(EmissionID id)
 	{
 		auto* context = GetContext();
@@ -30,40 +48,149 @@ namespace Planeverb
 
 	EmissionManager::~EmissionManager()
 	{
-		m_emitterPositions.~vector();
-		m_openSlots.~vector();
+		// reset information, the vectors themselves are destroyed with the manager
+		m_emitterPositions.clear();
+		m_openSlots.clear();
+		m_gridEmitters.clear();
+		m_gridActive.clear();
 	}
 
 	EmissionID EmissionManager::Emit(const vec3 & emitterPosition)
 	{
+		EmissionID next;
+
 		// case there is an ID that can be reused
 		if (!m_openSlots.empty())
 		{
-			EmissionID next = m_openSlots.back();
+			next = m_openSlots.back();
 			m_openSlots.pop_back();
 			m_emitterPositions[next] = emitterPosition;
-			return next;
 		}
 		// case a new ID needs to be generated
 		else
 		{
-			EmissionID next = m_emitterPositions.size();
+			next = m_emitterPositions.size();
 			m_emitterPositions.push_back(emitterPosition);
-			return next;
 		}
+
+		Command command;
+		command.type = cmd_Emit;
+		command.id = next;
+		command.position = emitterPosition;
+		m_commands->Push(command);
+		return next;
 	}
 
 	void EmissionManager::UpdateEmission(EmissionID id, const vec3 & pos)
 	{
 		int size = (int)m_emitterPositions.size();
-		if(id >= 0 && id < size)
+		if (id >= 0 && id < size)
+		{
 			m_emitterPositions[id] = pos;
+
+			Command command;
+			command.type = cmd_UpdateEmission;
+			command.id = id;
+			command.position = pos;
+			m_commands->Push(command);
+		}
+	}
+
+	void EmissionManager::UpdateEmissions(const EmissionID* ids, const vec3* positions, unsigned count)
+	{
+		// commands are pushed a batch at a time
+		Command commands[EMISSION_COMMAND_BATCH];
+		unsigned numCommands = 0;
+		const int size = (int)m_emitterPositions.size();
+		for (unsigned i = 0; i < count; ++i)
+		{
+			const EmissionID id = ids[i];
+			if (id < 0 || id >= size)
+				continue;
+			m_emitterPositions[id] = positions[i];
+
+			Command& command = commands[numCommands++];
+			command.type = cmd_UpdateEmission;
+			command.id = id;
+			command.position = positions[i];
+			if (numCommands == EMISSION_COMMAND_BATCH)
+			{
+				m_commands->Push(commands, numCommands);
+				numCommands = 0;
+			}
+		}
+		if (numCommands > 0)
+			m_commands->Push(commands, numCommands);
 	}
 
 	void EmissionManager::EndEmission(EmissionID id)
 	{
 		// add to the open slots to be reused
 		m_openSlots.push_back(id);
+
+		Command command;
+		command.type = cmd_EndEmission;
+		command.id = id;
+		m_commands->Push(command);
+	}
+
+	void EmissionManager::ApplyCommand(const Command& command)
+	{
+		const EmissionID id = command.id;
+		if (id >= m_gridEmitters.size())
+		{
+			m_gridEmitters.resize(id + 1);
+			m_gridActive.resize(id + 1, false);
+		}
+
+		switch (command.type)
+		{
+		case cmd_Emit:
+			m_gridEmitters[id] = command.position;
+			m_gridActive[id] = true;
+			break;
+		case cmd_UpdateEmission:
+			m_gridEmitters[id] = command.position;
+			break;
+		case cmd_EndEmission:
+			m_gridActive[id] = false;
+			break;
+		default:
+			break;
+		}
+	}
+
+	void EmissionManager::GetProbeCells(const Grid * grid, int radius, std::vector<int>& cells) const
+	{
+		cells.clear();
+
+		const Real dx = grid->GetDX();
+		const vec2& offset = grid->GetGridOffset();
+		const int gridX = (int)grid->GetGridSize().x;
+		const int gridY = (int)grid->GetGridSize().y;
+		const vec2 incDim((Real)(gridX + 1), (Real)(gridY + 1));
+
+		for (unsigned id = 0; id < m_gridEmitters.size(); ++id)
+		{
+			if (!m_gridActive[id])
+				continue;
+
+			// same conversion as the analyzer uses for emitter lookups
+			const vec3& pos = m_gridEmitters[id];
+			const int posX = (int)((pos.x + offset.x) / dx);
+			const int posY = (int)((pos.z + offset.y) / dx);
+
+			for (int x = std::max(0, posX - radius); x <= std::min(gridX - 1, posX + radius); ++x)
+			{
+				for (int y = std::max(0, posY - radius); y <= std::min(gridY - 1, posY + radius); ++y)
+				{
+					cells.push_back((int)INDEX(x, y, incDim));
+				}
+			}
+		}
+
+		std::sort(cells.begin(), cells.end());
+		cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
 	}
 
 	const vec3* EmissionManager::GetEmitter(EmissionID id) const
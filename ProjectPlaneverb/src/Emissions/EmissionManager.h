@@ -5,26 +5,49 @@
 
 namespace Planeverb
 {
+	class Grid;
+	class CommandQueue;
+	struct Command;
+
 	// Keeps track of playing sounds, and distributes emitter IDs
+	// the game thread's emitters are mirrored to the background thread through the command queue
 	class EmissionManager
 	{
 	public:
-		EmissionManager(char* mem) :
+		EmissionManager(CommandQueue* commands, char* mem) :
 			m_emitterPositions(),
-			m_openSlots()
+			m_openSlots(),
+			m_commands(commands),
+			m_gridEmitters(),
+			m_gridActive()
 		{
 		}
 
 		~EmissionManager();
 
+		// game thread
 		EmissionID Emit(const vec3& emitterPosition);
 		void UpdateEmission(EmissionID id, const vec3& pos);
+		void UpdateEmissions(const EmissionID* ids, const vec3* positions, unsigned count);
 		void EndEmission(EmissionID id);
 
 		const vec3* GetEmitter(EmissionID id) const;
+
+		// background thread, applies a popped emitter command
+		void ApplyCommand(const Command& command);
+
+		// flat grid indices of the cells active emitters occupy and the cells within radius of them,
+		// sorted and without duplicates, for probe recording
+		void GetProbeCells(const Grid* grid, int radius, std::vector<int>& cells) const;
 		static unsigned GetMemoryRequirement(const struct PlaneverbConfig* config);
 	private:
+		// game thread
 		std::vector<vec3> m_emitterPositions;	// dynamic array of current emitter positions, ID is index into vector
 		std::vector<EmissionID> m_openSlots;	// dynamic array of open slots into the emitter positions vector, handles dynamic sources
+		CommandQueue* m_commands;				// changes for the background thread
+
+		// background thread
+		std::vector<vec3> m_gridEmitters;		// emitter positions as of the last popped command, ID is index into vector
+		std::vector<bool> m_gridActive;			// false for ended emissions
 	};
 } // namespace Planeverb
@@ -5,86 +5,227 @@
 #include <Context\PvContext.h>
 
 #include <DSP\Analyzer.h>
+#include <DSP\BakedResults.h>
 #include <Emissions\EmissionManager.h>
 #include <Util/ScopedTimer.h>
+#include <Util\ThreadUtil.h>
 #include <omp.h>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
 
 namespace Planeverb
 {
+	namespace
+	{
+		// cells the active region reaches ahead of the stencil's one cell per time step
+		const constexpr int ACTIVE_REGION_PAD = 2;
+		// emitters GetOutputs looks up at once
+		const constexpr unsigned OUTPUT_BATCH = 64;
+
+		// called by every thread of a simulation's team, the calling thread is pinned by the caller
+		// an empty core mask leaves the threads' affinity to the OS
+		void PinSimulationThread(int thread, unsigned long long coreMask, int priority)
+		{
+			if (thread == 0)
+				return;
+
+			// worker threads persist between simulations, only pin them and set their priority once
+			static thread_local int pinnedCore = -1;
+			static thread_local bool hasPriority = false;
+			static thread_local int pinnedPriority = 0;
+			if (coreMask)
+			{
+				const int core = (int)GetThreadCore((unsigned)thread, coreMask);
+				if (pinnedCore != core)
+				{
+					PinCurrentThread((unsigned)core);
+					pinnedCore = core;
+				}
+			}
+			if (!hasPriority || pinnedPriority != priority)
+			{
+				SetThreadPriorityLevel(priority);
+				hasPriority = true;
+				pinnedPriority = priority;
+			}
+		}
+	} // namespace <>
+
 #pragma region ClientInterface
 	PlaneverbOutput GetOutput(EmissionID emitter)
+	{
+		return GetOutput(0u, emitter);
+	}
+
+	PlaneverbOutput GetOutput(unsigned listener, EmissionID emitter)
 	{
 		PlaneverbOutput out;
-		std::memset(&out, 0, sizeof(out));
+		GetOutputs(listener, &emitter, &out, 1);
+		return out;
+	}
+
+	void GetOutputs(const EmissionID* emitters, PlaneverbOutput* outputs, unsigned count)
+	{
+		GetOutputs(0u, emitters, outputs, count);
+	}
+
+	void GetOutputs(unsigned listener, const EmissionID* emitters, PlaneverbOutput* outputs, unsigned count)
+	{
+		std::fill(outputs, outputs + count, PlaneverbOutput());
 		auto* context = GetContext();
 
 		// case module hasn't been created yet
 		if(!context)
 		{
-			out.occlusion = PV_INVALID_DRY_GAIN;
-			return out;
+			for (unsigned i = 0; i < count; ++i)
+				outputs[i].occlusion = PV_INVALID_DRY_GAIN;
+			return;
 		}
 
 		auto* analyzer = context->GetAnalyzer();
 		auto* emissions = context->GetEmissionManager();
-		const auto* emitterPos = emissions->GetEmitter(emitter);
+		const BakedResults* baked = context->GetBakedResults();
+		const bool inBake = baked && listener < context->GetConfig()->numListeners;
+		const vec3 listenerPos = inBake ? context->GetListenerPosition(listener) : vec3();
 
-		// case emitter is invalid
-		if (!emitterPos)
+		// emitters are looked up a batch at a time from one published result grid
+		const vec3* positions[OUTPUT_BATCH];
+		AnalyzerResult results[OUTPUT_BATCH];
+		bool found[OUTPUT_BATCH];
+		bool fromBake[OUTPUT_BATCH];
+		for (unsigned begin = 0; begin < count; begin += OUTPUT_BATCH)
 		{
-			out.occlusion = PV_INVALID_DRY_GAIN;
-			return out;
-		}
+			const unsigned batch = std::min(OUTPUT_BATCH, count - begin);
+
+			// listeners inside the bake are answered from the file, every other one from the live simulation
+			// case emitter is invalid, it has no position
+			for (unsigned i = 0; i < batch; ++i)
+			{
+				positions[i] = emissions->GetEmitter(emitters[begin + i]);
+				fromBake[i] = positions[i] && inBake && baked->GetResult(listenerPos, *positions[i], results[i]);
+				if (fromBake[i])
+					positions[i] = nullptr;
+			}
+			analyzer->GetResponseResults(positions, batch, listener, results, found);
 
-		auto* result = analyzer->GetResponseResult(*emitterPos);
+			for (unsigned i = 0; i < batch; ++i)
+			{
+				PlaneverbOutput& out = outputs[begin + i];
 
-		// case invalid emitter position
-		if (!result)
-		{
-			out.occlusion = PV_INVALID_DRY_GAIN;
-			return out;
+				// case invalid emitter position or listener
+				if (!found[i] && !fromBake[i])
+				{
+					out.occlusion = PV_INVALID_DRY_GAIN;
+					continue;
+				}
+
+				// copy over values
+				const AnalyzerResult& result = results[i];
+				out.occlusion = (float)result.occlusion;
+				out.wetGain = (float)result.wetGain;
+				out.lowpass = (float)result.lowpassIntensity;
+				out.rt60 = (float)result.rt60;
+				out.direction = result.direction;
+				out.sourceDirectivity = result.sourceDirectivity;
+			}
 		}
+	}
 
-		// copy over values
-		out.occlusion = (float)result->occlusion;
-        out.wetGain = (float)result->wetGain;
-		out.lowpass = (float)result->lowpassIntensity;
-		out.rt60 = (float)result->rt60;
-		out.direction = result->direction;
-		out.sourceDirectivity = result->sourceDirectivity;
+	unsigned GetOutputEpoch()
+	{
+		return GetOutputEpoch(0u);
+	}
 
-		return out;
+	unsigned GetOutputEpoch(unsigned listener)
+	{
+		auto* context = GetContext();
+		if (!context)
+			return 0;
+		return context->GetAnalyzer()->GetResultEpoch(listener);
 	}
 
 	std::pair<const Cell*, unsigned> GetImpulseResponse(const vec3& position)
 	{
 		Grid* grid = GetContext()->GetGrid();
 		Real dx = grid->GetDX();
+		const vec2& offset = grid->GetGridOffset();
 		vec2 gridPosition =
 		{
-			position.x / dx,
-			position.z / dx
+			(position.x + offset.x) / dx,
+			(position.z + offset.y) / dx
 		};
-		return std::make_pair(grid->GetResponse(gridPosition), grid->GetResponseSize());
+
+		// positions outside the grid have no response
+		const vec2& gridSize = grid->GetGridSize();
+		if (gridPosition.x < 0 || gridPosition.y < 0 || (int)gridPosition.x > (int)gridSize.x || (int)gridPosition.y > (int)gridSize.y)
+			return std::make_pair((const Cell*)nullptr, 0u);
+
+		const Cell* response = grid->GetResponse(gridPosition);
+		return std::make_pair(response, response ? grid->GetResponseSize() : 0u);
 	}
 
 #pragma endregion
 	
 	Cell* Grid::GetResponse(const vec2& gridPosition)
+	{
+		return GetResponse(gridPosition, m_decodedResponse);
+	}
+
+	Cell* Grid::GetResponse(const vec2& gridPosition, Cell* decodeBuffer)
+	{
+		const int index = GetCellIndex(gridPosition);
+		const int storageIndex = GetStorageIndex(index);
+		if (storageIndex < 0)
+			return nullptr;
+
+		if (m_recorder)
+		{
+			const Cell cell = GetCell(index);
+			m_recorder->Decode(storageIndex, decodeBuffer, GetResponseSize(), cell.b, cell.by);
+			return decodeBuffer;
+		}
+
+		// probe recording only keeps the probe cells' responses
+		if (m_probeResponses)
+		{
+			const int slot = m_probeSlots[index];
+			return slot >= 0 ? m_probeResponses + slot * m_responseLength : nullptr;
+		}
+
+		// streaming analysis doesn't keep responses
+		if (!m_pulseResponse)
+			return nullptr;
+		return m_pulseResponse[m_selectedListener * m_numStoredCells + storageIndex].data();
+	}
+
+	int Grid::GetCellIndex(const vec2& gridPosition) const
 	{
 		vec2 incDim(m_gridSize.x + 1, m_gridSize.y + 1);
-		int index = INDEX((int)gridPosition.x, (int)gridPosition.y, incDim);
-		return m_pulseResponse[index].data();
+		return INDEX((int)gridPosition.x, (int)gridPosition.y, incDim);
+	}
+
+	int Grid::GetListenerCell(const vec3& listener) const
+	{
+		// same cell as GenerateResponseCPU
+		const int row = (int)((listener.x + m_gridOffset.x) / m_dx);
+		const int col = (int)((listener.z + m_gridOffset.y) / m_dx);
+		return row * ((int)m_gridSize.y + 1) + col;
 	}
 
 	unsigned Grid::GetResponseSize() const
 	{
-		return m_responseLength;
+		// early termination may have stopped before the max response length
+		return m_recorder ? ResponseRecorder::GetDecimatedLength((unsigned)m_simulatedSteps) : (unsigned)m_simulatedSteps;
+	}
+
+	unsigned Grid::GetResponseSamplingRate() const
+	{
+		return m_recorder ? m_recorder->GetSamplingRate() : m_samplingRate;
 	}
 	
-	// process FDTD
-	void Grid::GenerateResponseCPU(const vec3 &listener)
+	Grid::SimulationInfo Grid::GetSimulationInfo(const vec3& listener) const
 	{
 		// determine pressure and velocity update constants
 		const Real Courant = PV_C * m_dt / m_dx;
@@ -92,146 +233,818 @@ namespace Planeverb
 		// grid constants
 		const int gridx = (int)m_gridSize.x;
 		const int gridy = (int)m_gridSize.y;
-		const vec2 dim = m_gridSize;
-		const vec2 incdim(dim.x + 1, dim.y + 1);
 		const int listenerPosX = (int)((listener.x + m_gridOffset.x) / m_dx);
 		const int listenerPosY = (int)((listener.z + m_gridOffset.y) / m_dx);
 		const int listenerPos = listenerPosX * (gridy + 1) + listenerPosY;
-		const int responseLength = m_responseLength;
-		int loopSize = (int)(incdim.x) * (int)(incdim.y);
 
-		// thread usage
-		if (m_maxThreads == 0)
-			omp_set_num_threads(omp_get_max_threads());
-		else
-			omp_set_num_threads(m_maxThreads);
+		SimulationInfo info;
+		info.gridx = gridx;
+		info.gridy = gridy;
+		info.numRows = gridx + 1;
+		info.listenerPos = listenerPos;
+		info.listenerRow = listenerPosX;
+		info.listenerCol = listenerPosY;
+		info.responseLength = (int)m_responseLength;
+
+		// structure-of-arrays view for the kernels
+		info.planes.pr = m_pr;
+		info.planes.vx = m_vx;
+		info.planes.vy = m_vy;
+		info.planes.bMask = m_front->bMask;
+		info.planes.admittance = m_front->admittance;
+		info.planes.rowLength = gridy + 1;
+		info.planes.courant = Courant;
+		return info;
+	}
+
+	// process FDTD
+	void Grid::GenerateResponseCPU(const vec3 &listener)
+	{
+		const SimulationInfo info = GetSimulationInfo(listener);
+		const int listenerPos = info.listenerPos;
+
+		// the pressure update cancels a pulse inside a wall, which a solid tile would skip
+		const TileClass listenerTileClass = m_front->tileClasses[listenerPos / PV_TILE_SIZE];
+		m_front->tileClasses[listenerPos / PV_TILE_SIZE] = tile_Mixed;
+
+		// the calling thread joins the team as thread 0, pin it only for the duration of the simulation
+		size_t callerAffinity = m_threadAffinityMask ? PinCurrentThread(GetThreadCore(0, m_threadAffinityMask)) : 0;
+
+		// one parallel region for the whole simulation, threads stay alive and pinned
+		// across time steps and only synchronize at barriers
+#pragma omp parallel num_threads(m_numThreads)
+		{
+			const int thread = omp_get_thread_num();
+			const int teamSize = omp_get_num_threads();
+			PinSimulationThread(thread, m_threadAffinityMask, m_threadPriority);
+
+			// rows are partitioned between the threads of the team
+			const int rowBegin = info.numRows * thread / teamSize;
+			const int rowEnd = info.numRows * (thread + 1) / teamSize;
+
+			// RESET all pressure and velocity, but not B fields
+			{
+				const int begin = rowBegin * info.planes.rowLength;
+				const int end = rowEnd * info.planes.rowLength;
+				std::memset(m_pr + begin, 0, (end - begin) * sizeof(Real));
+				std::memset(m_vx + begin, 0, (end - begin) * sizeof(Real));
+				std::memset(m_vy + begin, 0, (end - begin) * sizeof(Real));
+			}
+
+			// with simulated regions the response storage isn't laid out by rows, each thread resets an equal share
+			{
+				const int begin = m_numStoredCells * thread / teamSize;
+				const int end = m_numStoredCells * (thread + 1) / teamSize;
+				if (m_accumulator)
+					m_accumulator->Reset(begin, end);
+				if (m_recorder)
+					m_recorder->Reset(begin, end);
+			}
+
+			// no energy from the last simulation
+			PublishEnergy(thread, 0, 0.f);
+			PublishEnergy(thread, 1, 0.f);
+
+#pragma omp barrier
+
+			int steps;
+			if (m_timeBlockSize > 1)
+				steps = SimulateRowsBlocked(info, thread, rowBegin, rowEnd);
+			else
+				steps = SimulateRows(info, thread, rowBegin, rowEnd);
+
+			// every thread stops on the same step
+			if (thread == 0)
+				m_simulatedSteps = steps;
+
+			// cells that were culled for the first time steps were silent
+			RecordInactiveSteps(info, rowBegin, rowEnd, steps);
+		}
+
+		RestoreThreadAffinity(callerAffinity);
+		m_front->tileClasses[listenerPos / PV_TILE_SIZE] = listenerTileClass;
+
+		// the responses are in the first listener's storage
+		m_listenerSteps[0] = m_simulatedSteps;
+		m_selectedListener = 0;
+	}
 
-		// RESET all pressure and velocity, but not B fields (can't use memset)
+	// process FDTD for a listener batch, like GenerateResponseCPU with each listener's field in its own lane
+	void Grid::GenerateResponsesCPU(const vec3* listeners, unsigned count)
+	{
+		const int lanes = m_laneKernels->lanes;
+		SimulationInfo infos[PV_MAX_LISTENERS];
+		TileClass listenerTileClasses[PV_MAX_LISTENERS];
+		for (unsigned i = 0; i < count; ++i)
+		{
+			infos[i] = GetSimulationInfo(listeners[i]);
+
+			// the pressure update cancels a pulse inside a wall, which a solid tile would skip
+			listenerTileClasses[i] = m_front->tileClasses[infos[i].listenerPos / PV_TILE_SIZE];
+			m_front->tileClasses[infos[i].listenerPos / PV_TILE_SIZE] = tile_Mixed;
+		}
+
+		// the walls are shared, the fields are the interleaved planes
+		FDTDPlanes planes = infos[0].planes;
+		planes.pr = m_lanePr;
+		planes.vx = m_laneVx;
+		planes.vy = m_laneVy;
+
+		// the calling thread joins the team as thread 0, pin it only for the duration of the simulation
+		size_t callerAffinity = m_threadAffinityMask ? PinCurrentThread(GetThreadCore(0, m_threadAffinityMask)) : 0;
+
+#pragma omp parallel num_threads(m_numThreads)
 		{
-			Cell* resetPtr = m_grid;
-            const int N = loopSize;
-			for (int i = 0; i < N; ++i, ++resetPtr)
+			const int thread = omp_get_thread_num();
+			const int teamSize = omp_get_num_threads();
+			PinSimulationThread(thread, m_threadAffinityMask, m_threadPriority);
+
+			// rows are partitioned between the threads of the team
+			const int numRows = infos[0].numRows;
+			const int rowBegin = numRows * thread / teamSize;
+			const int rowEnd = numRows * (thread + 1) / teamSize;
+
+			// RESET every listener's pressure and velocity
 			{
-				resetPtr->pr = 0.f;
-				resetPtr->vx = 0.f;
-				resetPtr->vy = 0.f;
+				const int begin = rowBegin * planes.rowLength * lanes;
+				const int end = rowEnd * planes.rowLength * lanes;
+				std::memset(planes.pr + begin, 0, (end - begin) * sizeof(Real));
+				std::memset(planes.vx + begin, 0, (end - begin) * sizeof(Real));
+				std::memset(planes.vy + begin, 0, (end - begin) * sizeof(Real));
 			}
+
+			// no energy from the last simulation
+			for (unsigned i = 0; i < count; ++i)
+			{
+				PublishEnergy(thread, 0, 0.f, (int)i);
+				PublishEnergy(thread, 1, 0.f, (int)i);
+			}
+
+#pragma omp barrier
+
+			int steps[PV_MAX_LISTENERS];
+			SimulateListenerRows(infos, (int)count, planes, thread, rowBegin, rowEnd, steps);
+
+			// every thread stops each listener on the same step
+			if (thread == 0)
+				std::copy(steps, steps + count, m_listenerSteps);
+
+			// cells that were culled for a listener's first time steps were silent
+			for (unsigned i = 0; i < count; ++i)
+				RecordInactiveSteps(infos[i], rowBegin, rowEnd, steps[i], (int)i);
 		}
 
+		RestoreThreadAffinity(callerAffinity);
+		for (int i = (int)count - 1; i >= 0; --i)
+			m_front->tileClasses[infos[i].listenerPos / PV_TILE_SIZE] = listenerTileClasses[i];
+
+		SelectListener(0);
+	}
+
+	// Steps the whole grid one time step at a time, threads sync between the pressure and velocity phases
+	int Grid::SimulateRows(const SimulationInfo& info, int thread, int rowBegin, int rowEnd)
+	{
+		const FDTDPlanes& planes = info.planes;
+		const int rowLength = planes.rowLength;
+		const bool ownsListener = (info.listenerRow >= rowBegin && info.listenerRow < rowEnd);
+		Real peakEnergy = 0.f;
+		int steps = info.responseLength;
+
 		// Time-stepped FDTD simulation
-		for (int t = 0; t < responseLength; ++t)
+		for (int t = 0; t < info.responseLength; ++t)
 		{
+			// add last step's pulse to listener position pressure field
+			// deferred to here so other threads' velocity updates never see it early
+			if (ownsListener && t > 0)
+			{
+				m_pr[info.listenerPos] += m_pulse[t - 1];
+			}
+
+			// this thread's rows of the active region, processed in spans of contiguous cells,
+			// consecutive rows are one span once the region spans the whole width
+			const CellRect region = GetActiveRegion(info, t);
+			const int firstRow = std::max(rowBegin, region.rowBegin);
+			const int lastRow = std::min(rowEnd, region.rowEnd);
+			const bool fullWidth = region.colBegin == 0 && region.colEnd == rowLength;
+			const int rowsPerSpan = fullWidth ? std::max(1, lastRow - firstRow) : 1;
+
 			// process pressure grid
+			Real energy = 0.f;
+			for (int row = firstRow; row < lastRow; row += rowsPerSpan)
 			{
-                const int N = loopSize;
-                for (int i = 0; i < N; ++i)
-				{
-					Cell& thisCell = m_grid[i];
-					int B = (int)thisCell.b;
-					Real beta = (Real)B;
-					//TODO: Check outside bounds access on ends?
-					// [i + 1, j]
-					const Cell& nextCellX = m_grid[i + gridy + 1];	
-					// [i, j + 1]
-					const Cell& nextCellY = m_grid[i + 1];
-
-					const auto divergence = ((nextCellX.vx - thisCell.vx) + (nextCellY.vy - thisCell.vy));
-					thisCell.pr = beta * (thisCell.pr - Courant * divergence);
-				}
+				const int spanEnd = (std::min(row + rowsPerSpan, lastRow) - 1) * rowLength + region.colEnd;
+				energy += UpdatePressure(planes, 0, row * rowLength + region.colBegin, spanEnd);
 			}
+			PublishEnergy(thread, t & 1, energy);
 
-			// process x component of particle velocity
+			// velocity reads pressure from the neighboring rows
+#pragma omp barrier
+
+			for (int row = firstRow; row < lastRow; row += rowsPerSpan)
 			{
-				// eq to for(1 to sizex) for(0 to sizey)
-				for (int i = gridy + 1; i < loopSize; ++i)
+				const int spanBegin = row * rowLength + region.colBegin;
+				const int spanEnd = (std::min(row + rowsPerSpan, lastRow) - 1) * rowLength + region.colEnd;
+
+				// process x and y components of particle velocity
+				UpdateVelocity(planes, 0, spanBegin, spanEnd);
+
+				// process absorption on the grid edges
+				for (int r = row; r < row + rowsPerSpan && r < lastRow; ++r)
 				{
-					// [i - 1, j]
-					auto in = (i - gridy - 1);
-					const Cell& prevCell = m_grid[in];
-					Real beta_n = (Real)prevCell.b;
-					Real Rn = m_boundaries[in].absorption; 
-					Real Yn = (1.f - Rn) / (1.f + Rn);
-
-					// [i, j]
-					Cell& thisCell = m_grid[i];											
-					int B = (int)thisCell.b;
-					Real beta = (Real)B;
-					Real R = m_boundaries[i].absorption;
-					Real Y = (1.f - R) / (1.f + R);
-
-					const Real gradient_x = (thisCell.pr - prevCell.pr);
-					const Real airCellUpdate = thisCell.vx - Courant * gradient_x;
-
-					const Real Y_boundary = beta * Yn + beta_n * Y;
-					const Real wallCellUpdate = Y_boundary * (prevCell.pr * beta_n + thisCell.pr * beta);
-
-					thisCell.vx = beta*beta_n * airCellUpdate + (beta_n - beta) * wallCellUpdate;
+					ApplyAbsorbingBoundary(info, planes, 0, r);
 				}
+
+				// add results to the response cube
+				RecordResponse(planes, 0, spanBegin, spanEnd, t);
 			}
 
-			// process y component of particle velocity
+			// next pressure update reads velocity from the neighboring rows
+#pragma omp barrier
+
+			if (HasResponseDecayed(t & 1, peakEnergy))
 			{
-				// eq to for(0 to sizex) for(1 to sizey)
-				for (int i = 1; i < loopSize; ++i)
-				{
-					// [i, j - 1]
-					const auto in = i - 1;
-					const Cell& prevCell = m_grid[in];
-					Real beta_n = (Real)prevCell.b;
-					Real Rn = m_boundaries[in].absorption;
-					Real Yn = (1.f - Rn) / (1.f + Rn);
-
-					// [i, j]
-					Cell& thisCell = m_grid[i];											
-					int B = thisCell.b;
-					Real beta = (Real)B;
-					Real R = m_boundaries[i].absorption;
-					Real Y = (1.f - R) / (1.f + R);
-	
-					const Real gradient_y = (thisCell.pr - prevCell.pr);
-					const Real airCellUpdate = thisCell.vy - Courant * gradient_y;
+				steps = t + 1;
+				break;
+			}
+		}
+
+		// add the final pulse sample so the grid ends in the same state as a serial run
+		if (ownsListener && steps > 0)
+		{
+			m_pr[info.listenerPos] += m_pulse[steps - 1];
+		}
+		return steps;
+	}
 
-					const Real Y_boundary = beta * Yn + beta_n * Y;
-					const Real wallCellUpdate = Y_boundary * (prevCell.pr * beta_n + thisCell.pr * beta);
+	// Temporal blocking: each thread copies its rows plus a halo of m_timeBlockSize rows on each side,
+	// then advances m_timeBlockSize time steps without synchronizing. Rows are processed as a wavefront,
+	// pressure then velocity per row, with each time level one row behind the previous one, so only a
+	// few rows per time level are live in cache. The halo is recomputed redundantly and shrinks by one
+	// row per time step, leaving the thread's own rows exact. Threads exchange halos through the global
+	// planes between blocks. Every cell sees the same operations as SimulateRows, results are identical.
+	int Grid::SimulateRowsBlocked(const SimulationInfo& info, int thread, int rowBegin, int rowEnd)
+	{
+		const int T = m_timeBlockSize;
+		const int rowLength = info.planes.rowLength;
 
-					thisCell.vy = beta * beta_n * airCellUpdate + (beta_n - beta) * wallCellUpdate;
-				}
+		// local rows [lo, hi), the halo is clamped by the grid edges, which don't shrink
+		const int lo = std::max(0, rowBegin - T);
+		const int hi = std::min(info.numRows, rowEnd + T);
+		const bool shrinkLo = lo > 0;
+		const bool shrinkHi = hi < info.numRows;
+
+		// local index = global index - offset, offset keeps each cell on the same bit of its mask word
+		const int firstCell = lo * rowLength;
+		const int pad = firstCell & 31;
+		const int offset = firstCell - pad;
+
+		// this thread's slot in the scratch planes, see GetBlockScratchLength
+		const int slot = (rowBegin + thread * (2 * T + 1)) * rowLength + thread * (32 + PV_SIMD_MAX_LANES);
+		const int slotLength = pad + (hi - lo + 1) * rowLength + PV_SIMD_MAX_LANES;
+
+		FDTDPlanes local = info.planes;
+		local.pr = m_blockScratch + slot;
+		local.vx = m_blockScratch + m_blockScratchLength + slot;
+		local.vy = m_blockScratch + 2 * m_blockScratchLength + slot;
+		local.bMask = m_front->bMask + (offset >> 5);
+		local.admittance = m_front->admittance + offset;
+
+		// copy global rows [r0, r1) into or out of the local planes
+		auto copyRows = [&](int r0, int r1, bool toLocal)
+		{
+			if (r1 <= r0)
+				return;
+			const int first = r0 * rowLength;
+			const size_t bytes = (size_t)(r1 - r0) * rowLength * sizeof(Real);
+			Real* globalPlanes[] = { m_pr + first, m_vx + first, m_vy + first };
+			Real* localPlanes[] = { local.pr + first - offset, local.vx + first - offset, local.vy + first - offset };
+			for (int p = 0; p < 3; ++p)
+			{
+				if (toLocal)
+					std::memcpy(localPlanes[p], globalPlanes[p], bytes);
+				else
+					std::memcpy(globalPlanes[p], localPlanes[p], bytes);
 			}
+		};
 
-			// process absorption top/bottom
+		// grid starts at rest, padding past the last row must read as zero
+		std::memset(local.pr, 0, slotLength * sizeof(Real));
+		std::memset(local.vx, 0, slotLength * sizeof(Real));
+		std::memset(local.vy, 0, slotLength * sizeof(Real));
+
+		Real peakEnergy = 0.f;
+		int simulatedSteps = info.responseLength;
+		for (int blockStart = 0; blockStart < info.responseLength; blockStart += T)
+		{
+			const int steps = std::min(T, info.responseLength - blockStart);
+
+			// early termination is decided on the energy of the block's last time step
+			Real energy = 0.f;
+
+			// sweep position s processes time level k on row s - k
+			for (int s = lo; s < hi + steps; ++s)
 			{
-				for (int i = 0; i < gridy; ++i)
+				for (int k = 0; k < steps; ++k)
 				{
-					int index1 = i;
-					int index2 = gridx * (gridy + 1) + i;
+					// rows with exact results at this time level
+					const int rowLo = lo + (shrinkLo ? k + 1 : 0);
+					const int rowHi = hi - (shrinkHi ? k + 1 : 0);
+					const int row = s - k;
 
-					m_grid[index1].vx = -m_grid[index1].pr;
-					m_grid[index2].vx = m_grid[index2 - gridy - 1].pr;
+					if (row >= rowLo && row < rowHi)
+					{
+						const bool owned = row >= rowBegin && row < rowEnd;
+						const Real rowEnergy = StepRow(info, local, offset, row, blockStart + k, owned, false);
+						if (owned && k == steps - 1)
+							energy += rowEnergy;
+					}
+					// velocity of the first exact row needs this level's pressure from the row before it
+					else if (shrinkLo && row == rowLo - 1)
+					{
+						StepRow(info, local, offset, row, blockStart + k, false, true);
+					}
 				}
 			}
 
-			// process absorption left/right
+			// no more blocks, no halo exchange
+			if (blockStart + steps >= info.responseLength)
+				break;
+
+			// publish the rows other threads' halos need
+			copyRows(rowBegin, std::min(rowBegin + T, rowEnd), false);
+			copyRows(std::max(rowEnd - T, rowBegin), rowEnd, false);
+			const int parity = (blockStart / T) & 1;
+			PublishEnergy(thread, parity, energy);
+
+#pragma omp barrier
+
+			if (HasResponseDecayed(parity, peakEnergy))
 			{
-				for (int i = 0; i < gridx; ++i)
+				simulatedSteps = blockStart + steps;
+				break;
+			}
+
+			// refresh the halo from the neighbors' exact rows
+			copyRows(lo, rowBegin, true);
+			copyRows(rowEnd, hi, true);
+
+			// neighbors must finish reading before the next block publishes again
+#pragma omp barrier
+		}
+
+		// write back the thread's rows so the grid ends in the same state as a serial run
+		copyRows(rowBegin, rowEnd, false);
+		const int listenerRow = info.listenerPos / rowLength;
+		if (listenerRow >= rowBegin && listenerRow < rowEnd && simulatedSteps > 0)
+		{
+			m_pr[info.listenerPos] += m_pulse[simulatedSteps - 1];
+		}
+		return simulatedSteps;
+	}
+
+	// Steps a listener batch like SimulateRows, over the union of the listeners' active regions. A listener whose
+	// response decayed is no longer recorded or kept in the active region, the batch stops once every one has.
+	// Every lane sees the same operations as SimulateRows, each listener's responses are those of its own simulation.
+	void Grid::SimulateListenerRows(const SimulationInfo* infos, int count, const FDTDPlanes& planes, int thread, int rowBegin, int rowEnd, int* steps)
+	{
+		const int lanes = m_laneKernels->lanes;
+		const int rowLength = planes.rowLength;
+		const int responseLength = infos[0].responseLength;
+		Real peakEnergy[PV_MAX_LISTENERS] = {};
+		unsigned recording = (1u << count) - 1;
+		std::fill(steps, steps + count, responseLength);
+
+		// Time-stepped FDTD simulation
+		for (int t = 0; t < responseLength && recording != 0; ++t)
+		{
+			CellRect region = { infos[0].numRows, 0, rowLength, 0 };
+			for (int i = 0; i < count; ++i)
+			{
+				// add last step's pulse to listener position pressure field
+				// deferred to here so other threads' velocity updates never see it early
+				const SimulationInfo& info = infos[i];
+				if (t > 0 && info.listenerRow >= rowBegin && info.listenerRow < rowEnd)
+				{
+					planes.pr[info.listenerPos * lanes + i] += m_pulse[t - 1];
+				}
+
+				if (recording & (1u << i))
 				{
-					int index1 = i * (gridy + 1);
-					int index2 = i * (gridy + 1) + gridy;
+					const CellRect listenerRegion = GetActiveRegion(info, t);
+					region.rowBegin = std::min(region.rowBegin, listenerRegion.rowBegin);
+					region.rowEnd = std::max(region.rowEnd, listenerRegion.rowEnd);
+					region.colBegin = std::min(region.colBegin, listenerRegion.colBegin);
+					region.colEnd = std::max(region.colEnd, listenerRegion.colEnd);
+				}
+			}
+
+			// this thread's rows of the active region, processed in spans of contiguous cells,
+			// consecutive rows are one span once the region spans the whole width
+			const int firstRow = std::max(rowBegin, region.rowBegin);
+			const int lastRow = std::min(rowEnd, region.rowEnd);
+			const bool fullWidth = region.colBegin == 0 && region.colEnd == rowLength;
+			const int rowsPerSpan = fullWidth ? std::max(1, lastRow - firstRow) : 1;
+
+			// process pressure grid
+			Real energy[PV_MAX_LISTENERS] = {};
+			for (int row = firstRow; row < lastRow; row += rowsPerSpan)
+			{
+				const int spanEnd = (std::min(row + rowsPerSpan, lastRow) - 1) * rowLength + region.colEnd;
+				UpdatePressureLanes(planes, row * rowLength + region.colBegin, spanEnd, energy);
+			}
+			for (int i = 0; i < count; ++i)
+				PublishEnergy(thread, t & 1, energy[i], i);
+
+			// velocity reads pressure from the neighboring rows
+#pragma omp barrier
+
+			for (int row = firstRow; row < lastRow; row += rowsPerSpan)
+			{
+				const int spanBegin = row * rowLength + region.colBegin;
+				const int spanEnd = (std::min(row + rowsPerSpan, lastRow) - 1) * rowLength + region.colEnd;
 
-					m_grid[index1].vy = -m_grid[index1].pr;
-					m_grid[index2].vy = m_grid[index2 - 1].pr;
+				// process x and y components of particle velocity
+				UpdateVelocityLanes(planes, spanBegin, spanEnd);
+
+				// process absorption on the grid edges
+				for (int r = row; r < row + rowsPerSpan && r < lastRow; ++r)
+				{
+					ApplyAbsorbingBoundary(infos[0], planes, 0, r, lanes);
 				}
+
+				// add results to each listener's response cube
+				RecordListenerResponses(planes, spanBegin, spanEnd, t, recording);
 			}
 
-			// add results to the response cube
+			// next pressure update reads velocity from the neighboring rows
+#pragma omp barrier
+
+			for (int i = 0; i < count; ++i)
 			{
-				for (int i = 0; i < loopSize; ++i)
+				if ((recording & (1u << i)) && HasResponseDecayed(t & 1, peakEnergy[i], i))
 				{
-					m_pulseResponse[i][t] = m_grid[i];
+					steps[i] = t + 1;
+					recording &= ~(1u << i);
 				}
 			}
+		}
+	}
+
+	void Grid::PublishEnergy(int thread, int parity, Real energy, int listener)
+	{
+		// each thread's energy lives on its own cache line, with a slot per listener of a batch
+		const int stride = PV_SIMD_ALIGNMENT / sizeof(Real);
+		m_stepEnergy[(parity * m_numThreads + thread) * stride + listener] = energy;
+	}
+
+	// Called after a barrier that follows every thread's PublishEnergy. Publishing alternates between two
+	// parities, so a thread that runs ahead can't overwrite the energy others are still reading.
+	bool Grid::HasResponseDecayed(int parity, Real& peakEnergy, int listener) const
+	{
+		if (m_energyFloor <= 0.f)
+			return false;
+
+		// every thread sums in the same order and comes to the same decision
+		const int stride = PV_SIMD_ALIGNMENT / sizeof(Real);
+		const int teamSize = omp_get_num_threads();
+		Real energy = 0.f;
+		for (int thread = 0; thread < teamSize; ++thread)
+			energy += m_stepEnergy[(parity * m_numThreads + thread) * stride + listener];
+
+		peakEnergy = std::max(peakEnergy, energy);
+		return energy < peakEnergy * m_energyFloor;
+	}
+
+	// The stencil moves a disturbance at most one cell per time step along each axis, faster than sound
+	// and its numerical dispersion, so every cell outside this rectangle around the listener is exactly zero
+	CellRect Grid::GetActiveRegion(const SimulationInfo& info, int t) const
+	{
+		const int radius = t + ACTIVE_REGION_PAD;
+		CellRect region;
+		region.rowBegin = std::max(0, info.listenerRow - radius);
+		region.rowEnd = std::min(info.numRows, info.listenerRow + radius + 1);
+		region.colBegin = std::max(0, info.listenerCol - radius);
+		region.colEnd = std::min(info.planes.rowLength, info.listenerCol + radius + 1);
+
+		// the last cell of a row reads the y velocity of the next row's first cell,
+		// once the region reaches the left edge it also covers the right edge of the row before it
+		if (region.colBegin == 0)
+		{
+			region.colEnd = info.planes.rowLength;
+			region.rowBegin = std::max(0, region.rowBegin - 1);
+		}
+		return region;
+	}
+
+	// First time step at which a cell is inside the active region
+	int Grid::GetActivationStep(const SimulationInfo& info, int index) const
+	{
+		const int row = index / info.planes.rowLength;
+		const int col = index % info.planes.rowLength;
+
+		// inside the rectangle around the listener
+		const int distance = std::max(std::abs(row - info.listenerRow), std::abs(col - info.listenerCol));
+		const int nearStep = std::max(0, distance - ACTIVE_REGION_PAD);
+
+		// inside the full width rows once the region reaches the left edge
+		const int leftEdgeStep = std::max(0, info.listenerCol - ACTIVE_REGION_PAD);
+		const int rowStep = std::max(info.listenerRow - row - ACTIVE_REGION_PAD - 1, row - info.listenerRow - ACTIVE_REGION_PAD);
+		const int wideStep = std::max(leftEdgeStep, std::max(0, rowStep));
+
+		return std::min(nearStep, wideStep);
+	}
+
+	// Fills in the samples of cells [rowBegin, rowEnd) that were skipped before they entered the active region
+	void Grid::RecordInactiveSteps(const SimulationInfo& info, int rowBegin, int rowEnd, int steps, int listener)
+	{
+		// silence adds nothing to the running sums
+		if (m_accumulator)
+			return;
+
+		const int rowLength = info.planes.rowLength;
+		for (int i = rowBegin * rowLength; i < rowEnd * rowLength; ++i)
+		{
+			const int storageIndex = GetStorageIndex(i);
+			if (storageIndex < 0 || (m_probeCapacity > 0 && m_probeSlots[i] < 0))
+				continue;
+
+			const int inactiveSteps = std::min(GetActivationStep(info, i), steps);
+			if (inactiveSteps == 0)
+				continue;
+
+			if (m_recorder)
+			{
+				m_recorder->RecordSilence(storageIndex, inactiveSteps);
+				continue;
+			}
 
-			// add pulse to listener position pressure field
-			m_grid[listenerPos].pr += m_pulse[t];
+			const int word = i >> 5;
+			const int shift = i & 31;
+			Cell* response = m_probeResponses ? m_probeResponses + m_probeSlots[i] * m_responseLength : m_pulseResponse[listener * m_numStoredCells + storageIndex].data();
+			std::fill(response, response + inactiveSteps,
+				Cell(0.f, 0.f, 0.f, (m_front->bMask[word] >> shift) & 1, (m_front->byMask[word] >> shift) & 1));
+		}
+	}
+
+	// Advances one row by one time step: pressure, then velocity, absorption and recording
+	Real Grid::StepRow(const SimulationInfo& info, const FDTDPlanes& planes, int offset, int row, int t, bool record, bool pressureOnly)
+	{
+		// rows outside the active region are still at rest
+		const CellRect region = GetActiveRegion(info, t);
+		if (row < region.rowBegin || row >= region.rowEnd)
+			return 0.f;
+		const int begin = row * planes.rowLength + region.colBegin;
+		const int end = row * planes.rowLength + region.colEnd;
+
+		// add last step's pulse to listener position pressure field
+		if (t > 0 && row == info.listenerRow)
+		{
+			planes.pr[info.listenerPos - offset] += m_pulse[t - 1];
+		}
+
+		// process pressure grid
+		const Real energy = UpdatePressure(planes, offset, begin, end);
+		if (pressureOnly)
+			return energy;
+
+		// process x and y components of particle velocity
+		UpdateVelocity(planes, offset, begin, end);
+
+		// process absorption on the grid edges
+		ApplyAbsorbingBoundary(info, planes, offset, row);
+
+		// add results to the response cube
+		if (record)
+			RecordResponse(planes, offset, begin, end, t);
+		return energy;
+	}
+
+	// Runs each tile class's kernel over [begin, end), begin and end are global indices, solid tiles stay at rest
+	Real Grid::UpdatePressure(const FDTDPlanes& planes, int offset, int begin, int end) const
+	{
+		Real energy = 0.f;
+		while (begin < end)
+		{
+			const int runEnd = GetTileRunEnd(begin, end);
+			switch (m_front->tileClasses[begin / PV_TILE_SIZE])
+			{
+			case tile_Air:
+				energy += m_kernels->pressureAir(planes, begin - offset, runEnd - offset);
+				break;
+			case tile_Mixed:
+				energy += m_kernels->pressure(planes, begin - offset, runEnd - offset);
+				break;
+			default:
+				break;
+			}
+			begin = runEnd;
+		}
+		return energy;
+	}
+
+	void Grid::UpdateVelocity(const FDTDPlanes& planes, int offset, int begin, int end) const
+	{
+		while (begin < end)
+		{
+			const int runEnd = GetTileRunEnd(begin, end);
+			switch (m_front->tileClasses[begin / PV_TILE_SIZE])
+			{
+			case tile_Air:
+				m_kernels->velocityAir(planes, begin - offset, runEnd - offset);
+				break;
+			case tile_Mixed:
+				m_kernels->velocity(planes, begin - offset, runEnd - offset);
+				break;
+			default:
+				break;
+			}
+			begin = runEnd;
+		}
+	}
+
+	void Grid::ApplyAbsorbingBoundary(const SimulationInfo& info, const FDTDPlanes& planes, int offset, int row, int lanes)
+	{
+		const int gridx = info.gridx;
+		const int gridy = info.gridy;
+		const int rowStart = (row * (gridy + 1) - offset) * lanes;
+		Real* pr = planes.pr;
+
+		// process absorption top/bottom
+		if (row == 0)
+		{
+			for (int i = 0; i < gridy * lanes; ++i)
+			{
+				int index1 = rowStart + i;
+				planes.vx[index1] = -pr[index1];
+			}
+		}
+		else if (row == gridx)
+		{
+			for (int i = 0; i < gridy * lanes; ++i)
+			{
+				int index2 = rowStart + i;
+				planes.vx[index2] = pr[index2 - (gridy + 1) * lanes];
+			}
+		}
+
+		// process absorption left/right
+		if (row < gridx)
+		{
+			for (int lane = 0; lane < lanes; ++lane)
+			{
+				int index1 = rowStart + lane;
+				int index2 = rowStart + gridy * lanes + lane;
+
+				planes.vy[index1] = -pr[index1];
+				planes.vy[index2] = pr[index2 - lanes];
+			}
+		}
+	}
+
+	// Records cells [begin, end) at time step t, begin and end are global indices
+	void Grid::RecordResponse(const FDTDPlanes& planes, int offset, int begin, int end, int t)
+	{
+		if (m_probeCapacity == 0)
+		{
+			RecordSegments(planes, offset, begin, end, t);
+			return;
+		}
+
+		// only record probe cells, in runs of consecutive cells
+		const int* probe = std::lower_bound(m_probeCells, m_probeCells + m_numProbeCells, begin);
+		const int* probeEnd = m_probeCells + m_numProbeCells;
+		while (probe != probeEnd && *probe < end)
+		{
+			const int runBegin = *probe;
+			int runEnd = runBegin + 1;
+			++probe;
+			while (probe != probeEnd && *probe == runEnd && runEnd < end)
+			{
+				++runEnd;
+				++probe;
+			}
+			RecordSegments(planes, offset, runBegin, runEnd, t);
+		}
+	}
+
+	// Splits cells [begin, end) into segments that are contiguous in the response storage,
+	// cells outside the simulated regions aren't recorded
+	void Grid::RecordSegments(const FDTDPlanes& planes, int offset, int begin, int end, int t)
+	{
+		if (!m_blockBases)
+		{
+			RecordCells(planes, offset, begin, end, begin, t);
+			return;
+		}
+
+		const int rowLength = planes.rowLength;
+		while (begin < end)
+		{
+			// a segment ends at the end of a storage block's row
+			const int row = begin / rowLength;
+			const int blockEnd = std::min(rowLength, (begin % rowLength / PV_STORAGE_BLOCK_SIZE + 1) * PV_STORAGE_BLOCK_SIZE);
+			const int segmentEnd = std::min(end, row * rowLength + blockEnd);
+			const int storageBegin = GetStorageIndex(begin);
+			if (storageBegin >= 0)
+				RecordCells(planes, offset, begin, segmentEnd, storageBegin, t);
+			begin = segmentEnd;
+		}
+	}
+
+	// storageBegin is the storage index of cell begin, cells [begin, end) are contiguous in the storage
+	void Grid::RecordCells(const FDTDPlanes& planes, int offset, int begin, int end, int storageBegin, int t)
+	{
+		const int storageOffset = storageBegin - begin;
+
+		// streaming analysis consumes the sample right away
+		if (m_accumulator)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				const int local = i - offset;
+				m_accumulator->Accumulate(i + storageOffset, t, planes.pr[local], planes.vx[local], planes.vy[local]);
+			}
+			return;
+		}
+
+		if (m_recorder)
+		{
+			m_recorder->Record(storageBegin, end + storageOffset, t, planes.pr + (begin - offset), planes.vx + (begin - offset), planes.vy + (begin - offset));
+			return;
+		}
+
+		for (int i = begin; i < end; ++i)
+		{
+			const int word = i >> 5;
+			const int shift = i & 31;
+			const int local = i - offset;
+			Cell& sample = m_probeResponses ? m_probeResponses[m_probeSlots[i] * m_responseLength + t] : m_pulseResponse[i + storageOffset][t];
+			sample = Cell(planes.pr[local], planes.vx[local], planes.vy[local],
+				(m_front->bMask[word] >> shift) & 1, (m_front->byMask[word] >> shift) & 1);
+		}
+	}
+
+	void Grid::UpdatePressureLanes(const FDTDPlanes& planes, int begin, int end, Real* energy) const
+	{
+		while (begin < end)
+		{
+			const int runEnd = GetTileRunEnd(begin, end);
+			switch (m_front->tileClasses[begin / PV_TILE_SIZE])
+			{
+			case tile_Air:
+				m_laneKernels->pressureAir(planes, begin, runEnd, energy);
+				break;
+			case tile_Mixed:
+				m_laneKernels->pressure(planes, begin, runEnd, energy);
+				break;
+			default:
+				break;
+			}
+			begin = runEnd;
+		}
+	}
+
+	void Grid::UpdateVelocityLanes(const FDTDPlanes& planes, int begin, int end) const
+	{
+		while (begin < end)
+		{
+			const int runEnd = GetTileRunEnd(begin, end);
+			switch (m_front->tileClasses[begin / PV_TILE_SIZE])
+			{
+			case tile_Air:
+				m_laneKernels->velocityAir(planes, begin, runEnd);
+				break;
+			case tile_Mixed:
+				m_laneKernels->velocity(planes, begin, runEnd);
+				break;
+			default:
+				break;
+			}
+			begin = runEnd;
+		}
+	}
+
+	// listener batches only record full responses of the full field
+	void Grid::RecordListenerResponses(const FDTDPlanes& planes, int begin, int end, int t, unsigned listeners)
+	{
+		const int lanes = m_laneKernels->lanes;
+		for (int i = begin; i < end; ++i)
+		{
+			const int storageIndex = GetStorageIndex(i);
+			if (storageIndex < 0)
+				continue;
+
+			const int word = i >> 5;
+			const int shift = i & 31;
+			const int b = (m_front->bMask[word] >> shift) & 1;
+			const int by = (m_front->byMask[word] >> shift) & 1;
+			for (int listener = 0; listener < m_numResponseFields; ++listener)
+			{
+				if (!(listeners & (1u << listener)))
+					continue;
+				const int lane = i * lanes + listener;
+				m_pulseResponse[listener * m_numStoredCells + storageIndex][t] = Cell(planes.pr[lane], planes.vx[lane], planes.vy[lane], b, by);
+			}
 		}
 	}
 
@@ -252,4 +1065,28 @@ namespace Planeverb
 			GenerateResponseGPU(listener);
 		}
 	}
+
+	void Grid::GenerateResponses(const vec3* listeners, unsigned count)
+	{
+		if (count == 0)
+			return;
+
+		// one listener takes the single listener path, with its temporal blocking
+		if (count == 1)
+		{
+			GenerateResponse(listeners[0]);
+			return;
+		}
+
+		// only batched grids have storage for more than one listener's responses
+		if (m_executionType != PlaneverbExecutionType::pv_CPU || (int)count > m_numResponseFields)
+			throw pv_InvalidConfig;
+		GenerateResponsesCPU(listeners, count);
+	}
+
+	void Grid::SelectListener(unsigned listener)
+	{
+		m_selectedListener = (int)listener;
+		m_simulatedSteps = m_listenerSteps[listener];
+	}
 } // namespace Planeverb
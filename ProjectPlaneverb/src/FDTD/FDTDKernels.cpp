@@ -0,0 +1,123 @@
+#include <FDTD\FDTDKernels.h>
+
+namespace Planeverb
+{
+	namespace
+	{
+		Real PressureScalar(const FDTDPlanes& planes, int begin, int end)
+		{
+			Real energy = 0.f;
+			for (int i = begin; i < end; ++i)
+			{
+				const Real pr = UpdatePressureCell(planes, i);
+				energy += pr * pr;
+			}
+			return energy;
+		}
+
+		void VelocityScalar(const FDTDPlanes& planes, int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				UpdateVelocityCell(planes, i);
+			}
+		}
+
+		// open air tiles, no boundary mask or admittance
+		Real PressureAirScalar(const FDTDPlanes& planes, int begin, int end)
+		{
+			Real energy = 0.f;
+			for (int i = begin; i < end; ++i)
+			{
+				const Real pr = UpdatePressureAirCell(planes, i);
+				energy += pr * pr;
+			}
+			return energy;
+		}
+
+		void VelocityAirScalar(const FDTDPlanes& planes, int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				UpdateVelocityAirCell(planes, i);
+			}
+		}
+
+		// listener batches, every lane of a cell shares its boundary bit and admittance
+		template <int CELL_LANES>
+		void PressureLanesScalar(const FDTDPlanes& planes, int begin, int end, Real* energy)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				UpdatePressureLanesCell(planes, i, CELL_LANES, energy);
+			}
+		}
+
+		template <int CELL_LANES>
+		void VelocityLanesScalar(const FDTDPlanes& planes, int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				UpdateVelocityLanesCell(planes, i, CELL_LANES);
+			}
+		}
+
+		template <int CELL_LANES>
+		void PressureAirLanesScalar(const FDTDPlanes& planes, int begin, int end, Real* energy)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				UpdatePressureAirLanesCell(planes, i, CELL_LANES, energy);
+			}
+		}
+
+		template <int CELL_LANES>
+		void VelocityAirLanesScalar(const FDTDPlanes& planes, int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				UpdateVelocityAirLanesCell(planes, i, CELL_LANES);
+			}
+		}
+	} // namespace <>
+
+	const FDTDKernels g_FDTDKernelsScalar = { PressureScalar, VelocityScalar, PressureAirScalar, VelocityAirScalar, "Scalar" };
+
+	const FDTDLaneKernels g_FDTDLaneKernelsScalar[3] =
+	{
+		{ PressureLanesScalar<2>, VelocityLanesScalar<2>, PressureAirLanesScalar<2>, VelocityAirLanesScalar<2>, 2, "Scalar" },
+		{ PressureLanesScalar<4>, VelocityLanesScalar<4>, PressureAirLanesScalar<4>, VelocityAirLanesScalar<4>, 4, "Scalar" },
+		{ PressureLanesScalar<8>, VelocityLanesScalar<8>, PressureAirLanesScalar<8>, VelocityAirLanesScalar<8>, 8, "Scalar" }
+	};
+
+	const FDTDKernels& GetFDTDKernels(SimdLevel level)
+	{
+		switch (level)
+		{
+		case simd_AVX512:
+			return g_FDTDKernelsAVX512;
+		case simd_AVX2:
+			return g_FDTDKernelsAVX2;
+		case simd_SSE:
+			return g_FDTDKernelsSSE;
+		default:
+			return g_FDTDKernelsScalar;
+		}
+	}
+
+	const FDTDLaneKernels& GetFDTDLaneKernels(SimdLevel level, int lanes)
+	{
+		// tables are for 2, 4 and 8 lanes, a batch of 8 already fills an AVX2 register per cell
+		const int table = lanes <= 2 ? 0 : lanes <= 4 ? 1 : 2;
+		switch (level)
+		{
+		case simd_AVX512:
+		case simd_AVX2:
+			return g_FDTDLaneKernelsAVX2[table];
+		case simd_SSE:
+			return g_FDTDLaneKernelsSSE[table];
+		default:
+			return g_FDTDLaneKernelsScalar[table];
+		}
+	}
+} // namespace Planeverb
@@ -0,0 +1,212 @@
+#pragma once
+#include <PvTypes.h>
+#include <PvDefinitions.h>
+#include <Util\CPUFeatures.h>
+
+namespace Planeverb
+{
+	// alignment of every SIMD plane in the grid pool, one cache line
+	const constexpr unsigned PV_SIMD_ALIGNMENT = 64;
+
+	// widest kernel, planes are padded by at least this many cells
+	const constexpr int PV_SIMD_MAX_LANES = 16;
+
+	// Structure-of-arrays view of the grid used by the FDTD kernels
+	// every plane is indexed by the same flat cell index, row * rowLength + col
+	struct FDTDPlanes
+	{
+		Real* pr;					// air pressure
+		Real* vx;					// x component of particle velocity
+		Real* vy;					// y component of particle velocity
+		const unsigned* bMask;		// B field, one bit per cell, 1 for air and 0 for walls
+		const Real* admittance;		// precomputed (1 - R) / (1 + R) per cell
+		int rowLength;				// number of cells per row
+		Real courant;				// pressure and velocity update constant
+	};
+
+	// Processes the flat cell range [begin, end)
+	using FDTDKernel = void(*)(const FDTDPlanes& planes, int begin, int end);
+
+	// Processes the flat cell range [begin, end), returns the sum of the squared new pressures
+	using FDTDPressureKernel = Real(*)(const FDTDPlanes& planes, int begin, int end);
+
+	// One set of kernels per instruction set
+	struct FDTDKernels
+	{
+		FDTDPressureKernel pressure;	// pressure from the velocity divergence, and its energy
+		FDTDKernel velocity;		// x and y particle velocity from the pressure gradient
+		FDTDPressureKernel pressureAir;	// pressure of cells that are all air
+		FDTDKernel velocityAir;		// velocity of cells that are air, along with their x and y neighbors
+		const char* name;			// instruction set name for debug output
+	};
+
+	// Retrieve the kernels for a given instruction set
+	const FDTDKernels& GetFDTDKernels(SimdLevel level);
+
+	// Per instruction set kernel tables, each is defined in its own translation unit
+	extern const FDTDKernels g_FDTDKernelsScalar;
+	extern const FDTDKernels g_FDTDKernelsSSE;
+	extern const FDTDKernels g_FDTDKernelsAVX2;
+	extern const FDTDKernels g_FDTDKernelsAVX512;
+
+	// Listener batches step the fields of several listeners together, interleaved per cell, so pr, vx and vy
+	// are indexed by cell index * lanes + listener, the walls are shared and indexed by cell index as usual
+	// Processes the flat cell range [begin, end), adds the sum of each lane's squared new pressures to energy
+	using FDTDLanePressureKernel = void(*)(const FDTDPlanes& planes, int begin, int end, Real* energy);
+
+	// One set of kernels per instruction set and lane count, a register holds every lane of one or more cells,
+	// whose boundary bits and admittances are loaded once and spread over their lanes
+	struct FDTDLaneKernels
+	{
+		FDTDLanePressureKernel pressure;
+		FDTDKernel velocity;
+		FDTDLanePressureKernel pressureAir;
+		FDTDKernel velocityAir;
+		int lanes;					// interleaved fields per cell, 2, 4 or 8
+		const char* name;			// instruction set name for debug output
+	};
+
+	// Retrieve the kernels for a given instruction set and at least the given number of lanes, up to 8
+	const FDTDLaneKernels& GetFDTDLaneKernels(SimdLevel level, int lanes);
+
+	// Per instruction set lane kernel tables for 2, 4 and 8 lanes
+	extern const FDTDLaneKernels g_FDTDLaneKernelsScalar[3];
+	extern const FDTDLaneKernels g_FDTDLaneKernelsSSE[3];
+	extern const FDTDLaneKernels g_FDTDLaneKernelsAVX2[3];
+
+	// Scalar cell updates, shared by every kernel for heads and tails
+	PV_FORCEINLINE Real GetBoundaryBit(const unsigned* mask, int index)
+	{
+		return (Real)((mask[index >> 5] >> (index & 31)) & 1u);
+	}
+
+	PV_FORCEINLINE Real UpdatePressureCell(const FDTDPlanes& planes, int i)
+	{
+		Real beta = GetBoundaryBit(planes.bMask, i);
+		// [i + 1, j] and [i, j + 1]
+		const Real divergence = ((planes.vx[i + planes.rowLength] - planes.vx[i]) + (planes.vy[i + 1] - planes.vy[i]));
+		const Real pr = beta * (planes.pr[i] - planes.courant * divergence);
+		planes.pr[i] = pr;
+		return pr;
+	}
+
+	PV_FORCEINLINE Real UpdateVelocityCell(Real v, Real pr, Real prn, Real beta, Real beta_n, Real Y, Real Yn, Real courant)
+	{
+		const Real gradient = (pr - prn);
+		const Real airCellUpdate = v - courant * gradient;
+
+		const Real Y_boundary = beta * Yn + beta_n * Y;
+		const Real wallCellUpdate = Y_boundary * (prn * beta_n + pr * beta);
+
+		return beta * beta_n * airCellUpdate + (beta_n - beta) * wallCellUpdate;
+	}
+
+	PV_FORCEINLINE void UpdateVelocityCell(const FDTDPlanes& planes, int i)
+	{
+		const Real pr = planes.pr[i];
+		const Real beta = GetBoundaryBit(planes.bMask, i);
+		const Real Y = planes.admittance[i];
+
+		// x component, [i - 1, j], first row has no x neighbor
+		if (i >= planes.rowLength)
+		{
+			const int in = i - planes.rowLength;
+			planes.vx[i] = UpdateVelocityCell(planes.vx[i], pr, planes.pr[in], beta, GetBoundaryBit(planes.bMask, in),
+				Y, planes.admittance[in], planes.courant);
+		}
+
+		// y component, [i, j - 1]
+		if (i >= 1)
+		{
+			const int in = i - 1;
+			planes.vy[i] = UpdateVelocityCell(planes.vy[i], pr, planes.pr[in], beta, GetBoundaryBit(planes.bMask, in),
+				Y, planes.admittance[in], planes.courant);
+		}
+	}
+
+	// Open air cell updates, beta is 1 for the cell and its neighbors so the wall terms vanish
+	PV_FORCEINLINE Real UpdatePressureAirCell(const FDTDPlanes& planes, int i)
+	{
+		const Real divergence = ((planes.vx[i + planes.rowLength] - planes.vx[i]) + (planes.vy[i + 1] - planes.vy[i]));
+		const Real pr = planes.pr[i] - planes.courant * divergence;
+		planes.pr[i] = pr;
+		return pr;
+	}
+
+	PV_FORCEINLINE void UpdateVelocityAirCell(const FDTDPlanes& planes, int i)
+	{
+		const Real pr = planes.pr[i];
+		if (i >= planes.rowLength)
+			planes.vx[i] = planes.vx[i] - planes.courant * (pr - planes.pr[i - planes.rowLength]);
+		if (i >= 1)
+			planes.vy[i] = planes.vy[i] - planes.courant * (pr - planes.pr[i - 1]);
+	}
+
+	// Listener batch cell updates, lanes interleaved fields per cell, shared by every lane kernel for heads and tails
+	// each lane sees the same operations as the cell updates above
+	PV_FORCEINLINE void UpdatePressureLanesCell(const FDTDPlanes& planes, int i, int lanes, Real* energy)
+	{
+		const Real beta = GetBoundaryBit(planes.bMask, i);
+		const int rowStride = planes.rowLength * lanes;
+		for (int lane = 0; lane < lanes; ++lane)
+		{
+			// [i + 1, j] and [i, j + 1]
+			const int f = i * lanes + lane;
+			const Real divergence = ((planes.vx[f + rowStride] - planes.vx[f]) + (planes.vy[f + lanes] - planes.vy[f]));
+			const Real pr = beta * (planes.pr[f] - planes.courant * divergence);
+			planes.pr[f] = pr;
+			energy[lane] += pr * pr;
+		}
+	}
+
+	PV_FORCEINLINE void UpdateVelocityLanesCell(const FDTDPlanes& planes, int i, int lanes)
+	{
+		const Real beta = GetBoundaryBit(planes.bMask, i);
+		const Real Y = planes.admittance[i];
+
+		// x component, [i - 1, j], first row has no x neighbor
+		if (i >= planes.rowLength)
+		{
+			const int in = i - planes.rowLength;
+			const Real beta_n = GetBoundaryBit(planes.bMask, in);
+			const Real Yn = planes.admittance[in];
+			for (int f = i * lanes; f < (i + 1) * lanes; ++f)
+				planes.vx[f] = UpdateVelocityCell(planes.vx[f], planes.pr[f], planes.pr[f - planes.rowLength * lanes], beta, beta_n, Y, Yn, planes.courant);
+		}
+
+		// y component, [i, j - 1]
+		if (i >= 1)
+		{
+			const int in = i - 1;
+			const Real beta_n = GetBoundaryBit(planes.bMask, in);
+			const Real Yn = planes.admittance[in];
+			for (int f = i * lanes; f < (i + 1) * lanes; ++f)
+				planes.vy[f] = UpdateVelocityCell(planes.vy[f], planes.pr[f], planes.pr[f - lanes], beta, beta_n, Y, Yn, planes.courant);
+		}
+	}
+
+	PV_FORCEINLINE void UpdatePressureAirLanesCell(const FDTDPlanes& planes, int i, int lanes, Real* energy)
+	{
+		const int rowStride = planes.rowLength * lanes;
+		for (int lane = 0; lane < lanes; ++lane)
+		{
+			const int f = i * lanes + lane;
+			const Real divergence = ((planes.vx[f + rowStride] - planes.vx[f]) + (planes.vy[f + lanes] - planes.vy[f]));
+			const Real pr = planes.pr[f] - planes.courant * divergence;
+			planes.pr[f] = pr;
+			energy[lane] += pr * pr;
+		}
+	}
+
+	PV_FORCEINLINE void UpdateVelocityAirLanesCell(const FDTDPlanes& planes, int i, int lanes)
+	{
+		for (int f = i * lanes; f < (i + 1) * lanes; ++f)
+		{
+			const Real pr = planes.pr[f];
+			if (i >= planes.rowLength)
+				planes.vx[f] = planes.vx[f] - planes.courant * (pr - planes.pr[f - planes.rowLength * lanes]);
+			if (i >= 1)
+				planes.vy[f] = planes.vy[f] - planes.courant * (pr - planes.pr[f - lanes]);
+		}
+	}
+} // namespace Planeverb
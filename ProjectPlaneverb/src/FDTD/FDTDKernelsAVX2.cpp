@@ -0,0 +1,356 @@
+#include <FDTD\FDTDKernels.h>
+
+#include <immintrin.h>
+#include <cstring>
+
+namespace Planeverb
+{
+	namespace
+	{
+		const constexpr int LANES = 8;
+
+		// expand 8 bits of the B field mask into 0.f/1.f lanes
+		PV_FORCEINLINE __m256 LoadBoundary(const unsigned* mask, int index)
+		{
+			unsigned long long bits;
+			std::memcpy(&bits, mask + (index >> 5), sizeof(bits));
+			const __m256i lanes = _mm256_set1_epi32((int)(bits >> (index & 31)));
+			const __m256i select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+			const __m256i isSet = _mm256_cmpeq_epi32(_mm256_and_si256(lanes, select), select);
+			return _mm256_and_ps(_mm256_castsi256_ps(isSet), _mm256_set1_ps(1.f));
+		}
+
+		PV_FORCEINLINE __m256 UpdateVelocity(__m256 v, __m256 pr, __m256 prn, __m256 beta, __m256 beta_n, __m256 Y, __m256 Yn, __m256 courant)
+		{
+			const __m256 gradient = _mm256_sub_ps(pr, prn);
+			const __m256 airCellUpdate = _mm256_sub_ps(v, _mm256_mul_ps(courant, gradient));
+
+			const __m256 Y_boundary = _mm256_add_ps(_mm256_mul_ps(beta, Yn), _mm256_mul_ps(beta_n, Y));
+			const __m256 wallCellUpdate = _mm256_mul_ps(Y_boundary, _mm256_add_ps(_mm256_mul_ps(prn, beta_n), _mm256_mul_ps(pr, beta)));
+
+			return _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(beta, beta_n), airCellUpdate), _mm256_mul_ps(_mm256_sub_ps(beta_n, beta), wallCellUpdate));
+		}
+
+		Real PressureAVX2(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m256 courant = _mm256_set1_ps(planes.courant);
+			__m256 energy = _mm256_setzero_ps();
+
+			int i = begin;
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m256 beta = LoadBoundary(planes.bMask, i);
+				const __m256 vx = _mm256_loadu_ps(planes.vx + i);
+				const __m256 vy = _mm256_loadu_ps(planes.vy + i);
+				const __m256 nextVx = _mm256_loadu_ps(planes.vx + i + rowLength);
+				const __m256 nextVy = _mm256_loadu_ps(planes.vy + i + 1);
+				const __m256 divergence = _mm256_add_ps(_mm256_sub_ps(nextVx, vx), _mm256_sub_ps(nextVy, vy));
+				const __m256 pr = _mm256_loadu_ps(planes.pr + i);
+				const __m256 next = _mm256_mul_ps(beta, _mm256_sub_ps(pr, _mm256_mul_ps(courant, divergence)));
+				_mm256_storeu_ps(planes.pr + i, next);
+				energy = _mm256_add_ps(energy, _mm256_mul_ps(next, next));
+			}
+
+			// sum the lanes, then add the scalar tail
+			alignas(32) float lanes[LANES];
+			_mm256_store_ps(lanes, energy);
+			Real sum = 0.f;
+			for (int lane = 0; lane < LANES; ++lane)
+				sum += lanes[lane];
+			for (; i < end; ++i)
+			{
+				const Real pr = UpdatePressureCell(planes, i);
+				sum += pr * pr;
+			}
+			return sum;
+		}
+
+		void VelocityAVX2(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m256 courant = _mm256_set1_ps(planes.courant);
+
+			// first row has no x neighbor, handled by the scalar path
+			int i = begin;
+			for (; i < end && i < rowLength; ++i)
+			{
+				UpdateVelocityCell(planes, i);
+			}
+
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m256 pr = _mm256_loadu_ps(planes.pr + i);
+				const __m256 beta = LoadBoundary(planes.bMask, i);
+				const __m256 Y = _mm256_loadu_ps(planes.admittance + i);
+
+				// [i - 1, j]
+				const int inx = i - rowLength;
+				const __m256 vx = UpdateVelocity(_mm256_loadu_ps(planes.vx + i), pr, _mm256_loadu_ps(planes.pr + inx),
+					beta, LoadBoundary(planes.bMask, inx), Y, _mm256_loadu_ps(planes.admittance + inx), courant);
+				_mm256_storeu_ps(planes.vx + i, vx);
+
+				// [i, j - 1]
+				const int iny = i - 1;
+				const __m256 vy = UpdateVelocity(_mm256_loadu_ps(planes.vy + i), pr, _mm256_loadu_ps(planes.pr + iny),
+					beta, LoadBoundary(planes.bMask, iny), Y, _mm256_loadu_ps(planes.admittance + iny), courant);
+				_mm256_storeu_ps(planes.vy + i, vy);
+			}
+
+			for (; i < end; ++i)
+			{
+				UpdateVelocityCell(planes, i);
+			}
+		}
+
+		// open air tiles, no boundary mask or admittance
+		Real PressureAirAVX2(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m256 courant = _mm256_set1_ps(planes.courant);
+			__m256 energy = _mm256_setzero_ps();
+
+			int i = begin;
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m256 vx = _mm256_loadu_ps(planes.vx + i);
+				const __m256 vy = _mm256_loadu_ps(planes.vy + i);
+				const __m256 nextVx = _mm256_loadu_ps(planes.vx + i + rowLength);
+				const __m256 nextVy = _mm256_loadu_ps(planes.vy + i + 1);
+				const __m256 divergence = _mm256_add_ps(_mm256_sub_ps(nextVx, vx), _mm256_sub_ps(nextVy, vy));
+				const __m256 next = _mm256_sub_ps(_mm256_loadu_ps(planes.pr + i), _mm256_mul_ps(courant, divergence));
+				_mm256_storeu_ps(planes.pr + i, next);
+				energy = _mm256_add_ps(energy, _mm256_mul_ps(next, next));
+			}
+
+			// sum the lanes, then add the scalar tail
+			alignas(32) float lanes[LANES];
+			_mm256_store_ps(lanes, energy);
+			Real sum = 0.f;
+			for (int lane = 0; lane < LANES; ++lane)
+				sum += lanes[lane];
+			for (; i < end; ++i)
+			{
+				const Real pr = UpdatePressureAirCell(planes, i);
+				sum += pr * pr;
+			}
+			return sum;
+		}
+
+		void VelocityAirAVX2(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m256 courant = _mm256_set1_ps(planes.courant);
+
+			// first row has no x neighbor, handled by the scalar path
+			int i = begin;
+			for (; i < end && i < rowLength; ++i)
+			{
+				UpdateVelocityAirCell(planes, i);
+			}
+
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m256 pr = _mm256_loadu_ps(planes.pr + i);
+
+				// [i - 1, j]
+				const __m256 gradientX = _mm256_sub_ps(pr, _mm256_loadu_ps(planes.pr + i - rowLength));
+				_mm256_storeu_ps(planes.vx + i, _mm256_sub_ps(_mm256_loadu_ps(planes.vx + i), _mm256_mul_ps(courant, gradientX)));
+
+				// [i, j - 1]
+				const __m256 gradientY = _mm256_sub_ps(pr, _mm256_loadu_ps(planes.pr + i - 1));
+				_mm256_storeu_ps(planes.vy + i, _mm256_sub_ps(_mm256_loadu_ps(planes.vy + i), _mm256_mul_ps(courant, gradientY)));
+			}
+
+			for (; i < end; ++i)
+			{
+				UpdateVelocityAirCell(planes, i);
+			}
+		}
+
+		// listener batches, a register holds every lane of LANES / CELL_LANES cells
+		// f is the index of a register's first lane in the interleaved planes, f / CELL_LANES its cell
+
+		// expand the B field bits of the register's cells into 0.f/1.f lanes, each cell's bit over its lanes
+		template <int CELL_LANES>
+		PV_FORCEINLINE __m256 LoadBoundaryLanes(const unsigned* mask, int f)
+		{
+			const int index = f / CELL_LANES;
+			unsigned long long bits;
+			std::memcpy(&bits, mask + (index >> 5), sizeof(bits));
+			const __m256i lanes = _mm256_set1_epi32((int)(bits >> (index & 31)));
+			const __m256i select = _mm256_setr_epi32(1 << (0 / CELL_LANES), 1 << (1 / CELL_LANES), 1 << (2 / CELL_LANES), 1 << (3 / CELL_LANES),
+				1 << (4 / CELL_LANES), 1 << (5 / CELL_LANES), 1 << (6 / CELL_LANES), 1 << (7 / CELL_LANES));
+			const __m256i isSet = _mm256_cmpeq_epi32(_mm256_and_si256(lanes, select), select);
+			return _mm256_and_ps(_mm256_castsi256_ps(isSet), _mm256_set1_ps(1.f));
+		}
+
+		// the admittance of the register's cells, each cell's over its lanes
+		template <int CELL_LANES>
+		PV_FORCEINLINE __m256 LoadAdmittanceLanes(const Real* admittance, int f)
+		{
+			const __m256i cells = _mm256_setr_epi32(0 / CELL_LANES, 1 / CELL_LANES, 2 / CELL_LANES, 3 / CELL_LANES,
+				4 / CELL_LANES, 5 / CELL_LANES, 6 / CELL_LANES, 7 / CELL_LANES);
+			return _mm256_permutevar8x32_ps(_mm256_loadu_ps(admittance + f / CELL_LANES), cells);
+		}
+
+		// sums of each lane's squared pressures, registers hold the same lanes unless a cell has more lanes than a register
+		template <int CELL_LANES>
+		PV_FORCEINLINE void AddLaneEnergy(const __m256* sums, Real* energy)
+		{
+			const constexpr int SUMS = CELL_LANES > LANES ? CELL_LANES / LANES : 1;
+			alignas(32) float lanes[SUMS * LANES];
+			for (int sum = 0; sum < SUMS; ++sum)
+				_mm256_store_ps(lanes + sum * LANES, sums[sum]);
+			for (int lane = 0; lane < SUMS * LANES; ++lane)
+				energy[lane % CELL_LANES] += lanes[lane];
+		}
+
+		template <int CELL_LANES>
+		void PressureLanesAVX2(const FDTDPlanes& planes, int begin, int end, Real* energy)
+		{
+			const constexpr int SUMS = CELL_LANES > LANES ? CELL_LANES / LANES : 1;
+			const int rowStride = planes.rowLength * CELL_LANES;
+			const __m256 courant = _mm256_set1_ps(planes.courant);
+			__m256 sums[SUMS];
+			for (int sum = 0; sum < SUMS; ++sum)
+				sums[sum] = _mm256_setzero_ps();
+
+			int f = begin * CELL_LANES;
+			for (; f + LANES <= end * CELL_LANES; f += LANES)
+			{
+				const __m256 beta = LoadBoundaryLanes<CELL_LANES>(planes.bMask, f);
+				const __m256 vx = _mm256_loadu_ps(planes.vx + f);
+				const __m256 vy = _mm256_loadu_ps(planes.vy + f);
+				const __m256 nextVx = _mm256_loadu_ps(planes.vx + f + rowStride);
+				const __m256 nextVy = _mm256_loadu_ps(planes.vy + f + CELL_LANES);
+				const __m256 divergence = _mm256_add_ps(_mm256_sub_ps(nextVx, vx), _mm256_sub_ps(nextVy, vy));
+				const __m256 pr = _mm256_loadu_ps(planes.pr + f);
+				const __m256 next = _mm256_mul_ps(beta, _mm256_sub_ps(pr, _mm256_mul_ps(courant, divergence)));
+				_mm256_storeu_ps(planes.pr + f, next);
+				__m256& sum = sums[(f / LANES) % SUMS];
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(next, next));
+			}
+
+			// sum the lanes, then add the scalar tail
+			AddLaneEnergy<CELL_LANES>(sums, energy);
+			for (int i = f / CELL_LANES; i < end; ++i)
+			{
+				UpdatePressureLanesCell(planes, i, CELL_LANES, energy);
+			}
+		}
+
+		template <int CELL_LANES>
+		void VelocityLanesAVX2(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowStride = planes.rowLength * CELL_LANES;
+			const __m256 courant = _mm256_set1_ps(planes.courant);
+
+			// first row has no x neighbor, handled by the scalar path
+			int i = begin;
+			for (; i < end && i < planes.rowLength; ++i)
+			{
+				UpdateVelocityLanesCell(planes, i, CELL_LANES);
+			}
+
+			int f = i * CELL_LANES;
+			for (; f + LANES <= end * CELL_LANES; f += LANES)
+			{
+				const __m256 pr = _mm256_loadu_ps(planes.pr + f);
+				const __m256 beta = LoadBoundaryLanes<CELL_LANES>(planes.bMask, f);
+				const __m256 Y = LoadAdmittanceLanes<CELL_LANES>(planes.admittance, f);
+
+				// [i - 1, j]
+				const int inx = f - rowStride;
+				const __m256 vx = UpdateVelocity(_mm256_loadu_ps(planes.vx + f), pr, _mm256_loadu_ps(planes.pr + inx),
+					beta, LoadBoundaryLanes<CELL_LANES>(planes.bMask, inx), Y, LoadAdmittanceLanes<CELL_LANES>(planes.admittance, inx), courant);
+				_mm256_storeu_ps(planes.vx + f, vx);
+
+				// [i, j - 1]
+				const int iny = f - CELL_LANES;
+				const __m256 vy = UpdateVelocity(_mm256_loadu_ps(planes.vy + f), pr, _mm256_loadu_ps(planes.pr + iny),
+					beta, LoadBoundaryLanes<CELL_LANES>(planes.bMask, iny), Y, LoadAdmittanceLanes<CELL_LANES>(planes.admittance, iny), courant);
+				_mm256_storeu_ps(planes.vy + f, vy);
+			}
+
+			for (i = f / CELL_LANES; i < end; ++i)
+			{
+				UpdateVelocityLanesCell(planes, i, CELL_LANES);
+			}
+		}
+
+		// open air tiles, no boundary mask or admittance
+		template <int CELL_LANES>
+		void PressureAirLanesAVX2(const FDTDPlanes& planes, int begin, int end, Real* energy)
+		{
+			const constexpr int SUMS = CELL_LANES > LANES ? CELL_LANES / LANES : 1;
+			const int rowStride = planes.rowLength * CELL_LANES;
+			const __m256 courant = _mm256_set1_ps(planes.courant);
+			__m256 sums[SUMS];
+			for (int sum = 0; sum < SUMS; ++sum)
+				sums[sum] = _mm256_setzero_ps();
+
+			int f = begin * CELL_LANES;
+			for (; f + LANES <= end * CELL_LANES; f += LANES)
+			{
+				const __m256 vx = _mm256_loadu_ps(planes.vx + f);
+				const __m256 vy = _mm256_loadu_ps(planes.vy + f);
+				const __m256 nextVx = _mm256_loadu_ps(planes.vx + f + rowStride);
+				const __m256 nextVy = _mm256_loadu_ps(planes.vy + f + CELL_LANES);
+				const __m256 divergence = _mm256_add_ps(_mm256_sub_ps(nextVx, vx), _mm256_sub_ps(nextVy, vy));
+				const __m256 next = _mm256_sub_ps(_mm256_loadu_ps(planes.pr + f), _mm256_mul_ps(courant, divergence));
+				_mm256_storeu_ps(planes.pr + f, next);
+				__m256& sum = sums[(f / LANES) % SUMS];
+				sum = _mm256_add_ps(sum, _mm256_mul_ps(next, next));
+			}
+
+			// sum the lanes, then add the scalar tail
+			AddLaneEnergy<CELL_LANES>(sums, energy);
+			for (int i = f / CELL_LANES; i < end; ++i)
+			{
+				UpdatePressureAirLanesCell(planes, i, CELL_LANES, energy);
+			}
+		}
+
+		template <int CELL_LANES>
+		void VelocityAirLanesAVX2(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowStride = planes.rowLength * CELL_LANES;
+			const __m256 courant = _mm256_set1_ps(planes.courant);
+
+			// first row has no x neighbor, handled by the scalar path
+			int i = begin;
+			for (; i < end && i < planes.rowLength; ++i)
+			{
+				UpdateVelocityAirLanesCell(planes, i, CELL_LANES);
+			}
+
+			int f = i * CELL_LANES;
+			for (; f + LANES <= end * CELL_LANES; f += LANES)
+			{
+				const __m256 pr = _mm256_loadu_ps(planes.pr + f);
+
+				// [i - 1, j]
+				const __m256 gradientX = _mm256_sub_ps(pr, _mm256_loadu_ps(planes.pr + f - rowStride));
+				_mm256_storeu_ps(planes.vx + f, _mm256_sub_ps(_mm256_loadu_ps(planes.vx + f), _mm256_mul_ps(courant, gradientX)));
+
+				// [i, j - 1]
+				const __m256 gradientY = _mm256_sub_ps(pr, _mm256_loadu_ps(planes.pr + f - CELL_LANES));
+				_mm256_storeu_ps(planes.vy + f, _mm256_sub_ps(_mm256_loadu_ps(planes.vy + f), _mm256_mul_ps(courant, gradientY)));
+			}
+
+			for (i = f / CELL_LANES; i < end; ++i)
+			{
+				UpdateVelocityAirLanesCell(planes, i, CELL_LANES);
+			}
+		}
+	} // namespace <>
+
+	const FDTDKernels g_FDTDKernelsAVX2 = { PressureAVX2, VelocityAVX2, PressureAirAVX2, VelocityAirAVX2, "AVX2" };
+	const FDTDLaneKernels g_FDTDLaneKernelsAVX2[3] =
+	{
+		{ PressureLanesAVX2<2>, VelocityLanesAVX2<2>, PressureAirLanesAVX2<2>, VelocityAirLanesAVX2<2>, 2, "AVX2" },
+		{ PressureLanesAVX2<4>, VelocityLanesAVX2<4>, PressureAirLanesAVX2<4>, VelocityAirLanesAVX2<4>, 4, "AVX2" },
+		{ PressureLanesAVX2<8>, VelocityLanesAVX2<8>, PressureAirLanesAVX2<8>, VelocityAirLanesAVX2<8>, 8, "AVX2" }
+	};
+} // namespace Planeverb
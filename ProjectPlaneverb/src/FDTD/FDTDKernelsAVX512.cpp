@@ -0,0 +1,163 @@
+#include <FDTD\FDTDKernels.h>
+
+#include <immintrin.h>
+#include <cstring>
+
+namespace Planeverb
+{
+	namespace
+	{
+		const constexpr int LANES = 16;
+
+		// expand 16 bits of the B field mask into 0.f/1.f lanes
+		PV_FORCEINLINE __m512 LoadBoundary(const unsigned* mask, int index)
+		{
+			unsigned long long bits;
+			std::memcpy(&bits, mask + (index >> 5), sizeof(bits));
+			const __mmask16 isSet = (__mmask16)(bits >> (index & 31));
+			return _mm512_maskz_mov_ps(isSet, _mm512_set1_ps(1.f));
+		}
+
+		PV_FORCEINLINE __m512 UpdateVelocity(__m512 v, __m512 pr, __m512 prn, __m512 beta, __m512 beta_n, __m512 Y, __m512 Yn, __m512 courant)
+		{
+			const __m512 gradient = _mm512_sub_ps(pr, prn);
+			const __m512 airCellUpdate = _mm512_sub_ps(v, _mm512_mul_ps(courant, gradient));
+
+			const __m512 Y_boundary = _mm512_add_ps(_mm512_mul_ps(beta, Yn), _mm512_mul_ps(beta_n, Y));
+			const __m512 wallCellUpdate = _mm512_mul_ps(Y_boundary, _mm512_add_ps(_mm512_mul_ps(prn, beta_n), _mm512_mul_ps(pr, beta)));
+
+			return _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(beta, beta_n), airCellUpdate), _mm512_mul_ps(_mm512_sub_ps(beta_n, beta), wallCellUpdate));
+		}
+
+		Real PressureAVX512(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m512 courant = _mm512_set1_ps(planes.courant);
+			__m512 energy = _mm512_setzero_ps();
+
+			int i = begin;
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m512 beta = LoadBoundary(planes.bMask, i);
+				const __m512 vx = _mm512_loadu_ps(planes.vx + i);
+				const __m512 vy = _mm512_loadu_ps(planes.vy + i);
+				const __m512 nextVx = _mm512_loadu_ps(planes.vx + i + rowLength);
+				const __m512 nextVy = _mm512_loadu_ps(planes.vy + i + 1);
+				const __m512 divergence = _mm512_add_ps(_mm512_sub_ps(nextVx, vx), _mm512_sub_ps(nextVy, vy));
+				const __m512 pr = _mm512_loadu_ps(planes.pr + i);
+				const __m512 next = _mm512_mul_ps(beta, _mm512_sub_ps(pr, _mm512_mul_ps(courant, divergence)));
+				_mm512_storeu_ps(planes.pr + i, next);
+				energy = _mm512_add_ps(energy, _mm512_mul_ps(next, next));
+			}
+
+			// sum the lanes, then add the scalar tail
+			Real sum = _mm512_reduce_add_ps(energy);
+			for (; i < end; ++i)
+			{
+				const Real pr = UpdatePressureCell(planes, i);
+				sum += pr * pr;
+			}
+			return sum;
+		}
+
+		void VelocityAVX512(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m512 courant = _mm512_set1_ps(planes.courant);
+
+			// first row has no x neighbor, handled by the scalar path
+			int i = begin;
+			for (; i < end && i < rowLength; ++i)
+			{
+				UpdateVelocityCell(planes, i);
+			}
+
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m512 pr = _mm512_loadu_ps(planes.pr + i);
+				const __m512 beta = LoadBoundary(planes.bMask, i);
+				const __m512 Y = _mm512_loadu_ps(planes.admittance + i);
+
+				// [i - 1, j]
+				const int inx = i - rowLength;
+				const __m512 vx = UpdateVelocity(_mm512_loadu_ps(planes.vx + i), pr, _mm512_loadu_ps(planes.pr + inx),
+					beta, LoadBoundary(planes.bMask, inx), Y, _mm512_loadu_ps(planes.admittance + inx), courant);
+				_mm512_storeu_ps(planes.vx + i, vx);
+
+				// [i, j - 1]
+				const int iny = i - 1;
+				const __m512 vy = UpdateVelocity(_mm512_loadu_ps(planes.vy + i), pr, _mm512_loadu_ps(planes.pr + iny),
+					beta, LoadBoundary(planes.bMask, iny), Y, _mm512_loadu_ps(planes.admittance + iny), courant);
+				_mm512_storeu_ps(planes.vy + i, vy);
+			}
+
+			for (; i < end; ++i)
+			{
+				UpdateVelocityCell(planes, i);
+			}
+		}
+
+		// open air tiles, no boundary mask or admittance
+		Real PressureAirAVX512(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m512 courant = _mm512_set1_ps(planes.courant);
+			__m512 energy = _mm512_setzero_ps();
+
+			int i = begin;
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m512 vx = _mm512_loadu_ps(planes.vx + i);
+				const __m512 vy = _mm512_loadu_ps(planes.vy + i);
+				const __m512 nextVx = _mm512_loadu_ps(planes.vx + i + rowLength);
+				const __m512 nextVy = _mm512_loadu_ps(planes.vy + i + 1);
+				const __m512 divergence = _mm512_add_ps(_mm512_sub_ps(nextVx, vx), _mm512_sub_ps(nextVy, vy));
+				const __m512 next = _mm512_sub_ps(_mm512_loadu_ps(planes.pr + i), _mm512_mul_ps(courant, divergence));
+				_mm512_storeu_ps(planes.pr + i, next);
+				energy = _mm512_add_ps(energy, _mm512_mul_ps(next, next));
+			}
+
+			// sum the lanes, then add the scalar tail
+			Real sum = _mm512_reduce_add_ps(energy);
+			for (; i < end; ++i)
+			{
+				const Real pr = UpdatePressureAirCell(planes, i);
+				sum += pr * pr;
+			}
+			return sum;
+		}
+
+		void VelocityAirAVX512(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m512 courant = _mm512_set1_ps(planes.courant);
+
+			// first row has no x neighbor, handled by the scalar path
+			int i = begin;
+			for (; i < end && i < rowLength; ++i)
+			{
+				UpdateVelocityAirCell(planes, i);
+			}
+
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m512 pr = _mm512_loadu_ps(planes.pr + i);
+
+				// [i - 1, j]
+				const __m512 gradientX = _mm512_sub_ps(pr, _mm512_loadu_ps(planes.pr + i - rowLength));
+				_mm512_storeu_ps(planes.vx + i, _mm512_sub_ps(_mm512_loadu_ps(planes.vx + i), _mm512_mul_ps(courant, gradientX)));
+
+				// [i, j - 1]
+				const __m512 gradientY = _mm512_sub_ps(pr, _mm512_loadu_ps(planes.pr + i - 1));
+				_mm512_storeu_ps(planes.vy + i, _mm512_sub_ps(_mm512_loadu_ps(planes.vy + i), _mm512_mul_ps(courant, gradientY)));
+			}
+
+			for (; i < end; ++i)
+			{
+				UpdateVelocityAirCell(planes, i);
+			}
+		}
+	} // namespace <>
+
+	const FDTDKernels g_FDTDKernelsAVX512 = { PressureAVX512, VelocityAVX512, PressureAirAVX512, VelocityAirAVX512, "AVX-512" };
+} // namespace Planeverb
@@ -0,0 +1,350 @@
+#include <FDTD\FDTDKernels.h>
+
+#include <emmintrin.h>
+#include <cstring>
+
+namespace Planeverb
+{
+	namespace
+	{
+		const constexpr int LANES = 4;
+
+		// expand 4 bits of the B field mask into 0.f/1.f lanes
+		PV_FORCEINLINE __m128 LoadBoundary(const unsigned* mask, int index)
+		{
+			unsigned long long bits;
+			std::memcpy(&bits, mask + (index >> 5), sizeof(bits));
+			const __m128i lanes = _mm_set1_epi32((int)(bits >> (index & 31)));
+			const __m128i select = _mm_setr_epi32(1, 2, 4, 8);
+			const __m128i isSet = _mm_cmpeq_epi32(_mm_and_si128(lanes, select), select);
+			return _mm_and_ps(_mm_castsi128_ps(isSet), _mm_set1_ps(1.f));
+		}
+
+		PV_FORCEINLINE __m128 UpdateVelocity(__m128 v, __m128 pr, __m128 prn, __m128 beta, __m128 beta_n, __m128 Y, __m128 Yn, __m128 courant)
+		{
+			const __m128 gradient = _mm_sub_ps(pr, prn);
+			const __m128 airCellUpdate = _mm_sub_ps(v, _mm_mul_ps(courant, gradient));
+
+			const __m128 Y_boundary = _mm_add_ps(_mm_mul_ps(beta, Yn), _mm_mul_ps(beta_n, Y));
+			const __m128 wallCellUpdate = _mm_mul_ps(Y_boundary, _mm_add_ps(_mm_mul_ps(prn, beta_n), _mm_mul_ps(pr, beta)));
+
+			return _mm_add_ps(_mm_mul_ps(_mm_mul_ps(beta, beta_n), airCellUpdate), _mm_mul_ps(_mm_sub_ps(beta_n, beta), wallCellUpdate));
+		}
+
+		Real PressureSSE(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m128 courant = _mm_set1_ps(planes.courant);
+			__m128 energy = _mm_setzero_ps();
+
+			int i = begin;
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m128 beta = LoadBoundary(planes.bMask, i);
+				const __m128 vx = _mm_loadu_ps(planes.vx + i);
+				const __m128 vy = _mm_loadu_ps(planes.vy + i);
+				const __m128 nextVx = _mm_loadu_ps(planes.vx + i + rowLength);
+				const __m128 nextVy = _mm_loadu_ps(planes.vy + i + 1);
+				const __m128 divergence = _mm_add_ps(_mm_sub_ps(nextVx, vx), _mm_sub_ps(nextVy, vy));
+				const __m128 pr = _mm_loadu_ps(planes.pr + i);
+				const __m128 next = _mm_mul_ps(beta, _mm_sub_ps(pr, _mm_mul_ps(courant, divergence)));
+				_mm_storeu_ps(planes.pr + i, next);
+				energy = _mm_add_ps(energy, _mm_mul_ps(next, next));
+			}
+
+			// sum the lanes, then add the scalar tail
+			alignas(16) float lanes[LANES];
+			_mm_store_ps(lanes, energy);
+			Real sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+			for (; i < end; ++i)
+			{
+				const Real pr = UpdatePressureCell(planes, i);
+				sum += pr * pr;
+			}
+			return sum;
+		}
+
+		void VelocitySSE(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m128 courant = _mm_set1_ps(planes.courant);
+
+			// first row has no x neighbor, handled by the scalar path
+			int i = begin;
+			for (; i < end && i < rowLength; ++i)
+			{
+				UpdateVelocityCell(planes, i);
+			}
+
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m128 pr = _mm_loadu_ps(planes.pr + i);
+				const __m128 beta = LoadBoundary(planes.bMask, i);
+				const __m128 Y = _mm_loadu_ps(planes.admittance + i);
+
+				// [i - 1, j]
+				const int inx = i - rowLength;
+				const __m128 vx = UpdateVelocity(_mm_loadu_ps(planes.vx + i), pr, _mm_loadu_ps(planes.pr + inx),
+					beta, LoadBoundary(planes.bMask, inx), Y, _mm_loadu_ps(planes.admittance + inx), courant);
+				_mm_storeu_ps(planes.vx + i, vx);
+
+				// [i, j - 1]
+				const int iny = i - 1;
+				const __m128 vy = UpdateVelocity(_mm_loadu_ps(planes.vy + i), pr, _mm_loadu_ps(planes.pr + iny),
+					beta, LoadBoundary(planes.bMask, iny), Y, _mm_loadu_ps(planes.admittance + iny), courant);
+				_mm_storeu_ps(planes.vy + i, vy);
+			}
+
+			for (; i < end; ++i)
+			{
+				UpdateVelocityCell(planes, i);
+			}
+		}
+
+		// open air tiles, no boundary mask or admittance
+		Real PressureAirSSE(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m128 courant = _mm_set1_ps(planes.courant);
+			__m128 energy = _mm_setzero_ps();
+
+			int i = begin;
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m128 vx = _mm_loadu_ps(planes.vx + i);
+				const __m128 vy = _mm_loadu_ps(planes.vy + i);
+				const __m128 nextVx = _mm_loadu_ps(planes.vx + i + rowLength);
+				const __m128 nextVy = _mm_loadu_ps(planes.vy + i + 1);
+				const __m128 divergence = _mm_add_ps(_mm_sub_ps(nextVx, vx), _mm_sub_ps(nextVy, vy));
+				const __m128 next = _mm_sub_ps(_mm_loadu_ps(planes.pr + i), _mm_mul_ps(courant, divergence));
+				_mm_storeu_ps(planes.pr + i, next);
+				energy = _mm_add_ps(energy, _mm_mul_ps(next, next));
+			}
+
+			// sum the lanes, then add the scalar tail
+			alignas(16) float lanes[LANES];
+			_mm_store_ps(lanes, energy);
+			Real sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+			for (; i < end; ++i)
+			{
+				const Real pr = UpdatePressureAirCell(planes, i);
+				sum += pr * pr;
+			}
+			return sum;
+		}
+
+		void VelocityAirSSE(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowLength = planes.rowLength;
+			const __m128 courant = _mm_set1_ps(planes.courant);
+
+			// first row has no x neighbor, handled by the scalar path
+			int i = begin;
+			for (; i < end && i < rowLength; ++i)
+			{
+				UpdateVelocityAirCell(planes, i);
+			}
+
+			for (; i + LANES <= end; i += LANES)
+			{
+				const __m128 pr = _mm_loadu_ps(planes.pr + i);
+
+				// [i - 1, j]
+				const __m128 gradientX = _mm_sub_ps(pr, _mm_loadu_ps(planes.pr + i - rowLength));
+				_mm_storeu_ps(planes.vx + i, _mm_sub_ps(_mm_loadu_ps(planes.vx + i), _mm_mul_ps(courant, gradientX)));
+
+				// [i, j - 1]
+				const __m128 gradientY = _mm_sub_ps(pr, _mm_loadu_ps(planes.pr + i - 1));
+				_mm_storeu_ps(planes.vy + i, _mm_sub_ps(_mm_loadu_ps(planes.vy + i), _mm_mul_ps(courant, gradientY)));
+			}
+
+			for (; i < end; ++i)
+			{
+				UpdateVelocityAirCell(planes, i);
+			}
+		}
+
+		// listener batches, a register holds every lane of LANES / CELL_LANES cells, or half of a cell's 8 lanes
+		// f is the index of a register's first lane in the interleaved planes, f / CELL_LANES its cell
+
+		// expand the B field bits of the register's cells into 0.f/1.f lanes, each cell's bit over its lanes
+		template <int CELL_LANES>
+		PV_FORCEINLINE __m128 LoadBoundaryLanes(const unsigned* mask, int f)
+		{
+			const int index = f / CELL_LANES;
+			unsigned long long bits;
+			std::memcpy(&bits, mask + (index >> 5), sizeof(bits));
+			const __m128i lanes = _mm_set1_epi32((int)(bits >> (index & 31)));
+			const __m128i select = _mm_setr_epi32(1 << (0 / CELL_LANES), 1 << (1 / CELL_LANES), 1 << (2 / CELL_LANES), 1 << (3 / CELL_LANES));
+			const __m128i isSet = _mm_cmpeq_epi32(_mm_and_si128(lanes, select), select);
+			return _mm_and_ps(_mm_castsi128_ps(isSet), _mm_set1_ps(1.f));
+		}
+
+		// the admittance of the register's cells, each cell's over its lanes
+		template <int CELL_LANES>
+		PV_FORCEINLINE __m128 LoadAdmittanceLanes(const Real* admittance, int f)
+		{
+			const Real* cells = admittance + f / CELL_LANES;
+			return _mm_setr_ps(cells[0 / CELL_LANES], cells[1 / CELL_LANES], cells[2 / CELL_LANES], cells[3 / CELL_LANES]);
+		}
+
+		// sums of each lane's squared pressures, registers hold the same lanes unless a cell has more lanes than a register
+		template <int CELL_LANES>
+		PV_FORCEINLINE void AddLaneEnergy(const __m128* sums, Real* energy)
+		{
+			const constexpr int SUMS = CELL_LANES > LANES ? CELL_LANES / LANES : 1;
+			alignas(16) float lanes[SUMS * LANES];
+			for (int sum = 0; sum < SUMS; ++sum)
+				_mm_store_ps(lanes + sum * LANES, sums[sum]);
+			for (int lane = 0; lane < SUMS * LANES; ++lane)
+				energy[lane % CELL_LANES] += lanes[lane];
+		}
+
+		template <int CELL_LANES>
+		void PressureLanesSSE(const FDTDPlanes& planes, int begin, int end, Real* energy)
+		{
+			const constexpr int SUMS = CELL_LANES > LANES ? CELL_LANES / LANES : 1;
+			const int rowStride = planes.rowLength * CELL_LANES;
+			const __m128 courant = _mm_set1_ps(planes.courant);
+			__m128 sums[SUMS];
+			for (int sum = 0; sum < SUMS; ++sum)
+				sums[sum] = _mm_setzero_ps();
+
+			int f = begin * CELL_LANES;
+			for (; f + LANES <= end * CELL_LANES; f += LANES)
+			{
+				const __m128 beta = LoadBoundaryLanes<CELL_LANES>(planes.bMask, f);
+				const __m128 vx = _mm_loadu_ps(planes.vx + f);
+				const __m128 vy = _mm_loadu_ps(planes.vy + f);
+				const __m128 nextVx = _mm_loadu_ps(planes.vx + f + rowStride);
+				const __m128 nextVy = _mm_loadu_ps(planes.vy + f + CELL_LANES);
+				const __m128 divergence = _mm_add_ps(_mm_sub_ps(nextVx, vx), _mm_sub_ps(nextVy, vy));
+				const __m128 pr = _mm_loadu_ps(planes.pr + f);
+				const __m128 next = _mm_mul_ps(beta, _mm_sub_ps(pr, _mm_mul_ps(courant, divergence)));
+				_mm_storeu_ps(planes.pr + f, next);
+				__m128& sum = sums[(f / LANES) % SUMS];
+				sum = _mm_add_ps(sum, _mm_mul_ps(next, next));
+			}
+
+			// sum the lanes, then add the scalar tail
+			AddLaneEnergy<CELL_LANES>(sums, energy);
+			for (int i = f / CELL_LANES; i < end; ++i)
+			{
+				UpdatePressureLanesCell(planes, i, CELL_LANES, energy);
+			}
+		}
+
+		template <int CELL_LANES>
+		void VelocityLanesSSE(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowStride = planes.rowLength * CELL_LANES;
+			const __m128 courant = _mm_set1_ps(planes.courant);
+
+			// first row has no x neighbor, handled by the scalar path
+			int i = begin;
+			for (; i < end && i < planes.rowLength; ++i)
+			{
+				UpdateVelocityLanesCell(planes, i, CELL_LANES);
+			}
+
+			int f = i * CELL_LANES;
+			for (; f + LANES <= end * CELL_LANES; f += LANES)
+			{
+				const __m128 pr = _mm_loadu_ps(planes.pr + f);
+				const __m128 beta = LoadBoundaryLanes<CELL_LANES>(planes.bMask, f);
+				const __m128 Y = LoadAdmittanceLanes<CELL_LANES>(planes.admittance, f);
+
+				// [i - 1, j]
+				const int inx = f - rowStride;
+				const __m128 vx = UpdateVelocity(_mm_loadu_ps(planes.vx + f), pr, _mm_loadu_ps(planes.pr + inx),
+					beta, LoadBoundaryLanes<CELL_LANES>(planes.bMask, inx), Y, LoadAdmittanceLanes<CELL_LANES>(planes.admittance, inx), courant);
+				_mm_storeu_ps(planes.vx + f, vx);
+
+				// [i, j - 1]
+				const int iny = f - CELL_LANES;
+				const __m128 vy = UpdateVelocity(_mm_loadu_ps(planes.vy + f), pr, _mm_loadu_ps(planes.pr + iny),
+					beta, LoadBoundaryLanes<CELL_LANES>(planes.bMask, iny), Y, LoadAdmittanceLanes<CELL_LANES>(planes.admittance, iny), courant);
+				_mm_storeu_ps(planes.vy + f, vy);
+			}
+
+			for (i = f / CELL_LANES; i < end; ++i)
+			{
+				UpdateVelocityLanesCell(planes, i, CELL_LANES);
+			}
+		}
+
+		// open air tiles, no boundary mask or admittance
+		template <int CELL_LANES>
+		void PressureAirLanesSSE(const FDTDPlanes& planes, int begin, int end, Real* energy)
+		{
+			const constexpr int SUMS = CELL_LANES > LANES ? CELL_LANES / LANES : 1;
+			const int rowStride = planes.rowLength * CELL_LANES;
+			const __m128 courant = _mm_set1_ps(planes.courant);
+			__m128 sums[SUMS];
+			for (int sum = 0; sum < SUMS; ++sum)
+				sums[sum] = _mm_setzero_ps();
+
+			int f = begin * CELL_LANES;
+			for (; f + LANES <= end * CELL_LANES; f += LANES)
+			{
+				const __m128 vx = _mm_loadu_ps(planes.vx + f);
+				const __m128 vy = _mm_loadu_ps(planes.vy + f);
+				const __m128 nextVx = _mm_loadu_ps(planes.vx + f + rowStride);
+				const __m128 nextVy = _mm_loadu_ps(planes.vy + f + CELL_LANES);
+				const __m128 divergence = _mm_add_ps(_mm_sub_ps(nextVx, vx), _mm_sub_ps(nextVy, vy));
+				const __m128 next = _mm_sub_ps(_mm_loadu_ps(planes.pr + f), _mm_mul_ps(courant, divergence));
+				_mm_storeu_ps(planes.pr + f, next);
+				__m128& sum = sums[(f / LANES) % SUMS];
+				sum = _mm_add_ps(sum, _mm_mul_ps(next, next));
+			}
+
+			// sum the lanes, then add the scalar tail
+			AddLaneEnergy<CELL_LANES>(sums, energy);
+			for (int i = f / CELL_LANES; i < end; ++i)
+			{
+				UpdatePressureAirLanesCell(planes, i, CELL_LANES, energy);
+			}
+		}
+
+		template <int CELL_LANES>
+		void VelocityAirLanesSSE(const FDTDPlanes& planes, int begin, int end)
+		{
+			const int rowStride = planes.rowLength * CELL_LANES;
+			const __m128 courant = _mm_set1_ps(planes.courant);
+
+			// first row has no x neighbor, handled by the scalar path
+			int i = begin;
+			for (; i < end && i < planes.rowLength; ++i)
+			{
+				UpdateVelocityAirLanesCell(planes, i, CELL_LANES);
+			}
+
+			int f = i * CELL_LANES;
+			for (; f + LANES <= end * CELL_LANES; f += LANES)
+			{
+				const __m128 pr = _mm_loadu_ps(planes.pr + f);
+
+				// [i - 1, j]
+				const __m128 gradientX = _mm_sub_ps(pr, _mm_loadu_ps(planes.pr + f - rowStride));
+				_mm_storeu_ps(planes.vx + f, _mm_sub_ps(_mm_loadu_ps(planes.vx + f), _mm_mul_ps(courant, gradientX)));
+
+				// [i, j - 1]
+				const __m128 gradientY = _mm_sub_ps(pr, _mm_loadu_ps(planes.pr + f - CELL_LANES));
+				_mm_storeu_ps(planes.vy + f, _mm_sub_ps(_mm_loadu_ps(planes.vy + f), _mm_mul_ps(courant, gradientY)));
+			}
+
+			for (i = f / CELL_LANES; i < end; ++i)
+			{
+				UpdateVelocityAirLanesCell(planes, i, CELL_LANES);
+			}
+		}
+	} // namespace <>
+
+	const FDTDKernels g_FDTDKernelsSSE = { PressureSSE, VelocitySSE, PressureAirSSE, VelocityAirSSE, "SSE2" };
+	const FDTDLaneKernels g_FDTDLaneKernelsSSE[3] =
+	{
+		{ PressureLanesSSE<2>, VelocityLanesSSE<2>, PressureAirLanesSSE<2>, VelocityAirLanesSSE<2>, 2, "SSE2" },
+		{ PressureLanesSSE<4>, VelocityLanesSSE<4>, PressureAirLanesSSE<4>, VelocityAirLanesSSE<4>, 4, "SSE2" },
+		{ PressureLanesSSE<8>, VelocityLanesSSE<8>, PressureAirLanesSSE<8>, VelocityAirLanesSSE<8>, 8, "SSE2" }
+	};
+} // namespace Planeverb
@@ -8,14 +8,24 @@ namespace Planeverb
         m_dx(0),
 		m_EFree(0.f)
 	{
+		// free field energy is read from an impulse response recorded like the grid's,
+		// streaming analysis sums at the full sampling rate so it can use a full response
+		PlaneverbConfig freeConfig = *config;
+		if (freeConfig.analysisMode == pv_StreamingAnalysis)
+			freeConfig.analysisMode = pv_FullResponseAnalysis;
+		freeConfig.recordingMode = pv_FullFieldRecording;
+		freeConfig.responseEnergyFloorDB = 0.f;
+		freeConfig.simulatedRegions = nullptr;
+		freeConfig.numSimulatedRegions = 0;
+
 		// make a new temporary grid
-		unsigned size = Grid::GetMemoryRequirement(config);
+		unsigned size = Grid::GetMemoryRequirement(&freeConfig);
 		char* temporaryPool = new char[size];
 		if (!temporaryPool)
 		{
 			throw pv_NotEnoughMemory;
 		}
-		m_grid = new Grid(config, temporaryPool);
+		m_grid = new Grid(&freeConfig, temporaryPool);
 		if (!m_grid)
 		{
 			throw pv_NotEnoughMemory;
@@ -83,7 +93,7 @@ namespace Planeverb
 		// generate a set of IRs in the grid, calculate the free energy
 		m_grid->GenerateResponse(vec3(listenerX * m_dx, 0, listenerY * m_dx));
 		const Cell* response = m_grid->GetResponse(vec2((float)emitterX, (float)emitterY));
-        Real freeFieldEnergy = CalculateEFree(response, m_grid->GetResponseSize(), (int)m_grid->GetSamplingRate());
+        Real freeFieldEnergy = CalculateEFree(response, m_grid->GetResponseSize(), (int)m_grid->GetResponseSamplingRate());
 
         // discrete distance on grid
         const Real r = Real(emitterX - listenerX) * m_dx;
@@ -1,8 +1,12 @@
 #include <FDTD\Grid.h>
+#include <Geometry\ShapeRasterizer.h>
 #include <PvDefinitions.h>
+#include <Util\ThreadUtil.h>
+#include <climits>
 #include <cmath>
 #include <cstring>
 #include <iostream>
+#include <algorithm>
 
 namespace Planeverb
 {
@@ -25,20 +29,241 @@ namespace Planeverb
 				*out++ = val;
 			}
 		}
+
+		// planes are padded by one row and the widest SIMD width so the stencil
+		// can read the row past the end of the grid, rounded to a cache line
+		unsigned GetPlaneLength(unsigned lengthPerGrid, unsigned rowLength)
+		{
+			const unsigned realsPerLine = PV_SIMD_ALIGNMENT / sizeof(Real);
+			unsigned length = lengthPerGrid + rowLength + PV_SIMD_MAX_LANES;
+			return (length + realsPerLine - 1) / realsPerLine * realsPerLine;
+		}
+
+		// one bit per cell, padded by two words so SIMD kernels can read 64 bits at any cell
+		unsigned GetMaskLength(unsigned planeLength)
+		{
+			return planeLength / 32 + 2;
+		}
+
+		// temporal blocking gives each thread its rows plus a halo of timeBlockSize rows on each side,
+		// a padding row, and room to keep its first cell on the same mask bit as in the global planes
+		unsigned GetBlockScratchLength(unsigned numRows, unsigned rowLength, int numThreads, int timeBlockSize)
+		{
+			if (timeBlockSize <= 1)
+				return 0;
+			return (numRows + numThreads * (2 * timeBlockSize + 1)) * rowLength + numThreads * (32 + PV_SIMD_MAX_LANES);
+		}
+
+		int GetSimulationThreads(const PlaneverbConfig* config, unsigned numRows)
+		{
+			return std::max(1, std::min(GetThreadCount(config->maxThreadUsage), (int)numRows));
+		}
+
+		// max number of cells recorded in probe mode, 0 for full field recording
+		unsigned GetProbeCapacity(const PlaneverbConfig* config, unsigned lengthPerGrid)
+		{
+			if (config->recordingMode != pv_ProbeRecording)
+				return 0;
+			return std::max(1u, std::min(config->maxProbeCells, lengthPerGrid));
+		}
+
+		// interleaved fields per cell when the listeners are simulated together, 0 if one at a time
+		int GetListenerLanes(const PlaneverbConfig* config)
+		{
+			if (!config->batchListeners || config->numListeners < 2 || config->threadExecutionType != pv_CPU ||
+				config->analysisMode != pv_FullResponseAnalysis || config->recordingMode == pv_ProbeRecording)
+				return 0;
+			return config->numListeners <= 2 ? 2 : config->numListeners <= 4 ? 4 : 8;
+		}
+
+		// full analysis keeps a vector of cells per stored cell, or a response per probe cell,
+		// streaming analysis only running sums per stored cell
+		unsigned GetResponseStorageSize(const PlaneverbConfig* config, unsigned lengthPerGrid, unsigned lengthPerStorage, unsigned lengthPerResponse, unsigned samplingRate)
+		{
+			if (config->analysisMode == pv_StreamingAnalysis)
+			{
+				return sizeof(ResponseAccumulator) +
+					ResponseAccumulator::GetMemoryRequirement(lengthPerStorage, lengthPerResponse, samplingRate);
+			}
+			if (config->analysisMode == pv_CompressedAnalysis)
+			{
+				return sizeof(ResponseRecorder) +
+					ResponseRecorder::GetMemoryRequirement(lengthPerStorage, lengthPerResponse, samplingRate) +
+					ResponseRecorder::GetDecimatedLength(lengthPerResponse) * sizeof(Cell);
+			}
+			if (config->recordingMode == pv_ProbeRecording)
+			{
+				return GetProbeCapacity(config, lengthPerGrid) * lengthPerResponse * sizeof(Cell);
+			}
+			// batched listeners each keep their own responses
+			const unsigned numFields = GetListenerLanes(config) > 0 ? config->numListeners : 1;
+			return numFields * lengthPerStorage * sizeof(std::vector<Cell>);
+		}
+
+		bool HasSimulatedRegions(const PlaneverbConfig* config)
+		{
+			return config->simulatedRegions && config->numSimulatedRegions > 0;
+		}
+
+		int GetNumStorageBlocks(int numCells)
+		{
+			return (numCells + PV_STORAGE_BLOCK_SIZE - 1) / PV_STORAGE_BLOCK_SIZE;
+		}
+
+		// block table of the storage, only kept with simulated regions
+		unsigned GetStorageTableSize(const PlaneverbConfig* config, int numRows, int rowLength)
+		{
+			if (!HasSimulatedRegions(config))
+				return 0;
+			return GetNumStorageBlocks(numRows) * GetNumStorageBlocks(rowLength) * sizeof(int);
+		}
+
+		// Lays out the response storage, blocks overlapping a simulated region are stored one after the other,
+		// row by row within each block. Fills blockBases with each block's first storage index or -1 if it isn't
+		// stored, blockBases may be nullptr to only count. Returns the number of stored cells.
+		unsigned GetStorageLayout(const PlaneverbConfig* config, Real dx, int numRows, int rowLength, int* blockBases)
+		{
+			if (!HasSimulatedRegions(config))
+				return (unsigned)(numRows * rowLength);
+
+			const int numBlockRows = GetNumStorageBlocks(numRows);
+			const int numBlockCols = GetNumStorageBlocks(rowLength);
+			std::vector<char> stored(numBlockRows * numBlockCols, 0);
+			for (unsigned r = 0; r < config->numSimulatedRegions; ++r)
+			{
+				// x runs along the rows, y along the columns
+				const AABB& region = config->simulatedRegions[r];
+				const int rowBegin = std::max(0, (int)std::floor((region.position.x - region.width / (Real)2.f + config->gridWorldOffset.x) / dx));
+				const int rowEnd = std::min(numRows, (int)std::ceil((region.position.x + region.width / (Real)2.f + config->gridWorldOffset.x) / dx) + 1);
+				const int colBegin = std::max(0, (int)std::floor((region.position.y - region.height / (Real)2.f + config->gridWorldOffset.y) / dx));
+				const int colEnd = std::min(rowLength, (int)std::ceil((region.position.y + region.height / (Real)2.f + config->gridWorldOffset.y) / dx) + 1);
+				for (int blockRow = rowBegin / PV_STORAGE_BLOCK_SIZE; blockRow * PV_STORAGE_BLOCK_SIZE < rowEnd; ++blockRow)
+					for (int blockCol = colBegin / PV_STORAGE_BLOCK_SIZE; blockCol * PV_STORAGE_BLOCK_SIZE < colEnd; ++blockCol)
+						stored[blockRow * numBlockCols + blockCol] = 1;
+			}
+
+			unsigned numStored = 0;
+			for (int block = 0; block < numBlockRows * numBlockCols; ++block)
+			{
+				const int blockRow = block / numBlockCols;
+				const int blockCol = block % numBlockCols;
+				const int height = std::min(PV_STORAGE_BLOCK_SIZE, numRows - blockRow * PV_STORAGE_BLOCK_SIZE);
+				const int width = std::min(PV_STORAGE_BLOCK_SIZE, rowLength - blockCol * PV_STORAGE_BLOCK_SIZE);
+				if (blockBases)
+					blockBases[block] = stored[block] ? (int)numStored : -1;
+				if (stored[block])
+					numStored += height * width;
+			}
+			return numStored;
+		}
+
+		// probe cell list and per cell slots
+		unsigned GetProbeTableSize(const PlaneverbConfig* config, unsigned lengthPerGrid)
+		{
+			if (config->recordingMode != pv_ProbeRecording)
+				return 0;
+			return (GetProbeCapacity(config, lengthPerGrid) + lengthPerGrid) * sizeof(int);
+		}
+
+		// one copy of the walls, admittance and occupancy aligned
+		unsigned GetGeometrySize(unsigned lengthPerGrid, unsigned lengthPerPlane, unsigned lengthPerMask)
+		{
+			return lengthPerPlane * sizeof(Real) + lengthPerGrid * sizeof(CellOccupancy) + 2 * PV_SIMD_ALIGNMENT +
+				2 * lengthPerMask * sizeof(unsigned) + lengthPerGrid * sizeof(BoundaryInfo) + lengthPerMask * sizeof(TileClass);
+		}
+
+		char* AlignPointer(char* ptr)
+		{
+			size_t address = reinterpret_cast<size_t>(ptr);
+			address = (address + PV_SIMD_ALIGNMENT - 1) & ~(size_t)(PV_SIMD_ALIGNMENT - 1);
+			return reinterpret_cast<char*>(address);
+		}
+
+		// occupancy absorption units, 2^-40, exact for any absorption of a normal material so add and
+		// remove cancel out and a cell covered by one object gets its absorption back unchanged
+		const constexpr double OCCUPANCY_UNITS_PER_ABSORPTION = 1099511627776.0;
+
+		long long ToOccupancyUnits(Real absorption)
+		{
+			return std::llround((double)absorption * OCCUPANCY_UNITS_PER_ABSORPTION);
+		}
+
+		Real FromOccupancyUnits(long long absorptionSum, unsigned count)
+		{
+			return (Real)((double)absorptionSum / OCCUPANCY_UNITS_PER_ABSORPTION / (double)count);
+		}
+
+		// cells of a that aren't in b as up to 4 rectangles, returns their count
+		int SubtractCellRect(const CellRect& a, const CellRect& b, CellRect out[4])
+		{
+			if (a.rowBegin >= a.rowEnd || a.colBegin >= a.colEnd)
+				return 0;
+			if (b.rowBegin >= a.rowEnd || b.rowEnd <= a.rowBegin || b.colBegin >= a.colEnd || b.colEnd <= a.colBegin ||
+				b.rowBegin >= b.rowEnd || b.colBegin >= b.colEnd)
+			{
+				out[0] = a;
+				return 1;
+			}
+
+			// rows above and below b span a's columns, the rest of a's rows are cut left and right of b
+			int count = 0;
+			const int rowBegin = std::max(a.rowBegin, b.rowBegin);
+			const int rowEnd = std::min(a.rowEnd, b.rowEnd);
+			if (a.rowBegin < rowBegin)
+				out[count++] = CellRect{ a.rowBegin, rowBegin, a.colBegin, a.colEnd };
+			if (rowEnd < a.rowEnd)
+				out[count++] = CellRect{ rowEnd, a.rowEnd, a.colBegin, a.colEnd };
+			if (a.colBegin < b.colBegin)
+				out[count++] = CellRect{ rowBegin, rowEnd, a.colBegin, b.colBegin };
+			if (b.colEnd < a.colEnd)
+				out[count++] = CellRect{ rowBegin, rowEnd, b.colEnd, a.colEnd };
+			return count;
+		}
 	} // namespace <>
 
 	Grid::Grid(const PlaneverbConfig* config, char* mem) :
 		m_mem(mem),
-		m_grid(nullptr),
-		m_boundaries(nullptr),
+		m_pr(nullptr), m_vx(nullptr), m_vy(nullptr),
+		m_geometry(),
+		m_front(&m_geometry[0]),
+		m_back(config->voxelizeConcurrently ? &m_geometry[1] : &m_geometry[0]),
+		m_lastGeometryVersion(0),
+		m_kernels(&GetFDTDKernels(GetSupportedSimdLevel())),
+		m_blockScratch(nullptr),
+		m_blockScratchLength(0),
+		m_laneKernels(nullptr),
+		m_lanePr(nullptr), m_laneVx(nullptr), m_laneVy(nullptr),
+		m_numResponseFields(1),
+		m_selectedListener(0),
+		m_listenerSteps(),
 		m_pulseResponse(nullptr),
+		m_blockBases(nullptr),
+		m_numBlockCols(0),
+		m_numStoredCells(0),
+		m_accumulator(nullptr),
+		m_recorder(nullptr),
+		m_decodedResponse(nullptr),
+		m_probeCells(nullptr),
+		m_probeSlots(nullptr),
+		m_probeResponses(nullptr),
+		m_numProbeCells(0),
+		m_probeCapacity(0),
 		m_pulse(nullptr),
 		m_dx(), m_dt(),
-		m_gridSize(), m_gridDimensions(config->gridSizeInMeters), m_gridOffset(), m_responseLength(),
+		m_gridSize(), m_gridDimensions(config->gridSizeInMeters), m_gridOffset(), m_initialOffset(config->gridWorldOffset),
+		m_shiftRows(0), m_shiftCols(0), m_recenterDistance((Real)config->gridRecenterDistance), m_responseLength(),
+		m_simulatedSteps(0),
+		m_energyFloor(config->responseEnergyFloorDB < 0.f ? std::pow((Real)10.f, (Real)config->responseEnergyFloorDB / (Real)10.f) : (Real)0.f),
+		m_stepEnergy(nullptr),
 		m_samplingRate(),
 		m_resolution(config->gridResolution),
 		m_executionType(config->threadExecutionType),
-		m_maxThreads(config->maxThreadUsage)
+		m_analysisMode(config->analysisMode),
+		m_maxThreads(config->maxThreadUsage),
+		m_threadAffinityMask(config->threadAffinityMask),
+		m_threadPriority(config->threadPriority),
+		m_numThreads(1),
+		m_timeBlockSize(std::max(1, (int)config->timeStepsPerBlock))
 	{
 		// calculate internals
 		m_gridOffset = config->gridWorldOffset;
@@ -51,17 +276,34 @@ namespace Planeverb
 		// calculate total memory size
 		// length per grid uses gridsize + 1 for extended velocity fields
 		unsigned lengthPerGrid = (unsigned)(m_gridSize.x + 1) * (unsigned)(m_gridSize.y + 1);
+		unsigned lengthPerPlane = GetPlaneLength(lengthPerGrid, (unsigned)(m_gridSize.y + 1));
+		unsigned lengthPerMask = GetMaskLength(lengthPerPlane);
 		unsigned sizePerBoundary = sizeof(BoundaryInfo) * lengthPerGrid;
-		unsigned lengthPerResponse = (unsigned)(m_samplingRate * PV_IMPULSE_RESPONSE_S); 
+		unsigned lengthPerResponse = (unsigned)(m_samplingRate * CalculateResponseDuration(config->gridSizeInMeters)); 
+		unsigned numRows = (unsigned)(m_gridSize.x + 1);
+		int numThreads = GetSimulationThreads(config, numRows);
+		int timeBlockSize = std::max(1, (int)config->timeStepsPerBlock);
+		unsigned lengthPerScratch = GetBlockScratchLength(numRows, (unsigned)(m_gridSize.y + 1), numThreads, timeBlockSize);
+		unsigned lengthPerStorage = GetStorageLayout(config, m_dx, (int)numRows, (int)(m_gridSize.y + 1), nullptr);
 		unsigned size =
 			lengthPerResponse * sizeof(Real) +	// memory for Gaussian pulse values
-			lengthPerGrid * sizeof(Cell) +		// memory for Cell grid
+			4 * (lengthPerPlane * sizeof(Real) + PV_SIMD_ALIGNMENT) +	// memory for pr, vx, vy and admittance planes
+			3 * lengthPerScratch * sizeof(Real) + PV_SIMD_ALIGNMENT +	// memory for temporal blocking scratch planes
+			3 * lengthPerPlane * GetListenerLanes(config) * sizeof(Real) + PV_SIMD_ALIGNMENT +	// memory for the interleaved planes of listener batches
+			(2 * numThreads + 1) * PV_SIMD_ALIGNMENT +	// memory for per thread energy of early termination
+			lengthPerGrid * sizeof(CellOccupancy) +	// memory for cell occupancy
+			2 * lengthPerMask * sizeof(unsigned) +	// memory for B and By masks
 			sizePerBoundary +	// memory for boundary information
+			GetProbeTableSize(config, lengthPerGrid) +	// memory for probe cell tables
+			GetStorageTableSize(config, (int)numRows, (int)(m_gridSize.y + 1)) +	// memory for the storage block table
+			lengthPerMask * sizeof(TileClass) +	// memory for tile classes
+			(config->voxelizeConcurrently ? GetGeometrySize(lengthPerGrid, lengthPerPlane, lengthPerMask) : 0) +	// memory for the back copy of the walls
+			PV_SIMD_ALIGNMENT +	// alignment of the response storage
 
 			/// memory for pulse response Cell[x][y][t]
 			///sizePerGrid * lengthPerResponse;
-			// memory for pulse response std::vector<Cell>[x][y]
-			lengthPerGrid * sizeof(std::vector<Cell>);
+			// memory for pulse response std::vector<Cell>[x][y], or the streaming accumulator
+			GetResponseStorageSize(config, lengthPerGrid, lengthPerStorage, lengthPerResponse, m_samplingRate);
 
 		// allocate memory pool, throw for operator new fails. set memory to zero
 		if (!m_mem)
@@ -73,17 +315,82 @@ namespace Planeverb
 		// set grids and arrays offset into pool
 		char* temp = m_mem;
 		m_pulse = reinterpret_cast<Real*>(temp);				temp += lengthPerResponse * sizeof(Real);
-		m_grid = reinterpret_cast<Cell*>(temp);					temp += lengthPerGrid * sizeof(Cell);
-		m_boundaries = reinterpret_cast<BoundaryInfo*>(temp);	temp += sizePerBoundary;
-		m_pulseResponse = reinterpret_cast<std::vector<Cell>*>(temp);
+		m_pr = reinterpret_cast<Real*>(AlignPointer(temp));		temp = reinterpret_cast<char*>(m_pr + lengthPerPlane);
+		m_vx = reinterpret_cast<Real*>(AlignPointer(temp));		temp = reinterpret_cast<char*>(m_vx + lengthPerPlane);
+		m_vy = reinterpret_cast<Real*>(AlignPointer(temp));		temp = reinterpret_cast<char*>(m_vy + lengthPerPlane);
+		m_front->admittance = reinterpret_cast<Real*>(AlignPointer(temp));	temp = reinterpret_cast<char*>(m_front->admittance + lengthPerPlane);
+		m_blockScratch = reinterpret_cast<Real*>(AlignPointer(temp));	temp = reinterpret_cast<char*>(m_blockScratch + 3 * lengthPerScratch);
+		const int listenerLanes = GetListenerLanes(config);
+		if (listenerLanes > 0)
+		{
+			m_laneKernels = &GetFDTDLaneKernels(GetSupportedSimdLevel(), listenerLanes);
+			m_lanePr = reinterpret_cast<Real*>(AlignPointer(temp));
+			m_laneVx = m_lanePr + lengthPerPlane * listenerLanes;
+			m_laneVy = m_laneVx + lengthPerPlane * listenerLanes;
+			temp = reinterpret_cast<char*>(m_laneVy + lengthPerPlane * listenerLanes);
+			m_numResponseFields = (int)config->numListeners;
+		}
+		m_stepEnergy = reinterpret_cast<Real*>(AlignPointer(temp));		temp = reinterpret_cast<char*>(m_stepEnergy) + 2 * numThreads * PV_SIMD_ALIGNMENT;
+		m_front->occupancy = reinterpret_cast<CellOccupancy*>(temp);	temp += lengthPerGrid * sizeof(CellOccupancy);
+		m_front->bMask = reinterpret_cast<unsigned*>(temp);			temp += lengthPerMask * sizeof(unsigned);
+		m_front->byMask = reinterpret_cast<unsigned*>(temp);			temp += lengthPerMask * sizeof(unsigned);
+		m_front->boundaries = reinterpret_cast<BoundaryInfo*>(temp);	temp += sizePerBoundary;
+		m_probeCapacity = (int)GetProbeCapacity(config, lengthPerGrid);
+		if (m_probeCapacity > 0)
+		{
+			m_probeCells = reinterpret_cast<int*>(temp);		temp += m_probeCapacity * sizeof(int);
+			m_probeSlots = reinterpret_cast<int*>(temp);		temp += lengthPerGrid * sizeof(int);
+			for (unsigned i = 0; i < lengthPerGrid; ++i)
+				m_probeSlots[i] = -1;
+		}
+		if (HasSimulatedRegions(config))
+		{
+			m_blockBases = reinterpret_cast<int*>(temp);		temp += GetStorageTableSize(config, (int)numRows, (int)(m_gridSize.y + 1));
+			GetStorageLayout(config, m_dx, (int)numRows, (int)(m_gridSize.y + 1), m_blockBases);
+		}
+		m_numBlockCols = GetNumStorageBlocks((int)(m_gridSize.y + 1));
+		m_numStoredCells = (int)lengthPerStorage;
+		m_front->tileClasses = reinterpret_cast<TileClass*>(temp);		temp += lengthPerMask * sizeof(TileClass);
+		if (m_back != m_front)
+		{
+			m_back->admittance = reinterpret_cast<Real*>(AlignPointer(temp));	temp = reinterpret_cast<char*>(m_back->admittance + lengthPerPlane);
+			m_back->occupancy = reinterpret_cast<CellOccupancy*>(AlignPointer(temp));	temp = reinterpret_cast<char*>(m_back->occupancy + lengthPerGrid);
+			m_back->bMask = reinterpret_cast<unsigned*>(temp);			temp += lengthPerMask * sizeof(unsigned);
+			m_back->byMask = reinterpret_cast<unsigned*>(temp);			temp += lengthPerMask * sizeof(unsigned);
+			m_back->boundaries = reinterpret_cast<BoundaryInfo*>(temp);	temp += sizePerBoundary;
+			m_back->tileClasses = reinterpret_cast<TileClass*>(temp);		temp += lengthPerMask * sizeof(TileClass);
+		}
+		temp = AlignPointer(temp);
+		if (m_analysisMode == pv_StreamingAnalysis)
+		{
+			m_accumulator = new (temp) ResponseAccumulator(lengthPerStorage, lengthPerResponse, m_samplingRate, config->decayFitRange, temp + sizeof(ResponseAccumulator));
+		}
+		else if (m_analysisMode == pv_CompressedAnalysis)
+		{
+			m_decodedResponse = reinterpret_cast<Cell*>(temp);
+			temp += ResponseRecorder::GetDecimatedLength(lengthPerResponse) * sizeof(Cell);
+			m_recorder = new (temp) ResponseRecorder(lengthPerStorage, lengthPerResponse, m_samplingRate, temp + sizeof(ResponseRecorder));
+		}
+		else if (m_probeCapacity > 0)
+		{
+			m_probeResponses = reinterpret_cast<Cell*>(temp);
+		}
+		else
+		{
+			m_pulseResponse = reinterpret_cast<std::vector<Cell>*>(temp);
+		}
 
 		vec2 incGridSize(m_gridSize.x + 1, m_gridSize.y + 1);
 		m_responseLength = lengthPerResponse;
+		m_simulatedSteps = (int)lengthPerResponse;
+		std::fill(m_listenerSteps, m_listenerSteps + PV_MAX_LISTENERS, (int)lengthPerResponse);
+		m_numThreads = numThreads;
+		m_blockScratchLength = lengthPerScratch;
 
 		// init the boundary layer
 		for (int i = 0; i < (int)incGridSize.x; ++i)
 			for (int j = 0; j < (int)incGridSize.y; ++j)
-				m_boundaries[INDEX(i, j, incGridSize)] = BoundaryInfo{ vec2((Real)0.f, (Real)0.f), PV_ABSORPTION_FREE_SPACE };
+				m_back->boundaries[INDEX(i, j, incGridSize)] = BoundaryInfo{ vec2((Real)0.f, (Real)0.f), PV_ABSORPTION_FREE_SPACE };
 
 		// init the b and by field
 		int numBIterations = (int)incGridSize.x * (int)incGridSize.y;
@@ -93,25 +400,41 @@ namespace Planeverb
 			int col = i % (int)incGridSize.y;
 			if (row == (int)m_gridSize.x || col == (int)m_gridSize.y)
 			{
-				m_grid[i].b = 0;
-				m_grid[i].by = 0;
+				SetCellBoundary(i, 0, 0, PV_ABSORPTION_FREE_SPACE);
 			}
 			else if (col == 0)
 			{
-				m_grid[i].b = 1;
-				m_grid[i].by = 0;
+				SetCellBoundary(i, 1, 0, PV_ABSORPTION_FREE_SPACE);
 			}
 			else
 			{
-				m_grid[i].b = 1;
-				m_grid[i].by = 1;
+				SetCellBoundary(i, 1, 1, PV_ABSORPTION_FREE_SPACE);
+			}
+
+			// everything outside the simulated regions is solid
+			if (!IsCellSimulated(i))
+			{
+				SetCellBoundary(i, 0, 0, PV_ABSORPTION_DEFAULT);
 			}
+		}
 
-			// initialize pulseResponse
+		// initialize pulseResponse
+		for (int i = 0; m_pulseResponse && i < m_numResponseFields * m_numStoredCells; ++i)
+		{
 			new (&m_pulseResponse[i]) std::vector<Cell>(); // placement new to call ctor
 			m_pulseResponse[i].resize(lengthPerResponse, Cell());
 		}
 
+		// every tile is classified once, then only where geometry changes
+		ClassifyTiles(0, numBIterations);
+
+		// both copies of the walls start out the same
+		if (m_back != m_front)
+		{
+			SwapGeometry();
+			CopyFrontGeometry();
+		}
+
 		// precompute Gaussian pulse
 		GaussianPulse(config, m_samplingRate, m_pulse, m_responseLength);
 	}
@@ -120,12 +443,19 @@ namespace Planeverb
 	{
 		if (m_mem)
 		{
-			int loopSize = (int)(m_gridSize.x + 1) * (int)(m_gridSize.y + 1);
 			// destruct each vector
-			for (int i = 0; i < loopSize; ++i)
+			for (int i = 0; m_pulseResponse && i < m_numResponseFields * m_numStoredCells; ++i)
 			{
 				m_pulseResponse[i].~vector();
 			}
+			if (m_accumulator)
+			{
+				m_accumulator->~ResponseAccumulator();
+			}
+			if (m_recorder)
+			{
+				m_recorder->~ResponseRecorder();
+			}
 
 			// delete the pool
 			//delete[] m_mem;
@@ -135,171 +465,543 @@ namespace Planeverb
 
 	void Grid::AddAABB(const AABB * transform)
 	{
-		// define edges of the AABB
-		const int startY = (int)((transform->position.y - transform->height / (Real)2.f + m_gridOffset.x) * ((Real)1.f / m_dx));
-		const int startX = (int)((transform->position.x - transform->width  / (Real)2.f + m_gridOffset.y) * ((Real)1.f / m_dx));
-		const int endY   = (int)((transform->position.y + transform->height / (Real)2.f + m_gridOffset.x) * ((Real)1.f / m_dx));
-		const int endX   = (int)((transform->position.x + transform->width  / (Real)2.f + m_gridOffset.y) * ((Real)1.f / m_dx));
-		
-		const vec2 newGridSize(m_gridSize.x + 1, m_gridSize.y + 1);
+		const CellRect wholeGrid = { 0, (int)m_gridSize.x + 1, 0, (int)m_gridSize.y + 1 };
+		AddAABB(transform, wholeGrid);
+	}
+
+	void Grid::AddAABB(const AABB * transform, const CellRect& clip)
+	{
+		const CellRect cells = GetCellRect(transform);
+		const CellRect rect =
+		{
+			std::max(cells.rowBegin, clip.rowBegin), std::min(cells.rowEnd, clip.rowEnd),
+			std::max(cells.colBegin, clip.colBegin), std::min(cells.colEnd, clip.colEnd)
+		};
+		if (ChangeOccupancy(rect, 1, ToOccupancyUnits(transform->absorption)))
+			m_back->version = ++m_lastGeometryVersion;
+	}
+
+	void Grid::RemoveAABB(const AABB * transform)
+	{
+		// cells other objects still cover stay walls
+		if (ChangeOccupancy(GetCellRect(transform), -1, -ToOccupancyUnits(transform->absorption)))
+			m_back->version = ++m_lastGeometryVersion;
+	}
+
+	void Grid::UpdateAABB(const AABB * oldTransform, const AABB * newTransform)
+	{
+		const CellRect oldCells = GetCellRect(oldTransform);
+		const CellRect newCells = GetCellRect(newTransform);
+		const long long oldUnits = ToOccupancyUnits(oldTransform->absorption);
+		const long long newUnits = ToOccupancyUnits(newTransform->absorption);
 
-		/*
-		// top
-		if (startY >= 0 && startY < m_gridSize.y)
+		// cells only the old transform covers, then cells only the new one covers
+		bool changed = false;
+		CellRect parts[4];
+		int numParts = SubtractCellRect(oldCells, newCells, parts);
+		for (int i = 0; i < numParts; ++i)
+			changed = ChangeOccupancy(parts[i], -1, -oldUnits) || changed;
+		numParts = SubtractCellRect(newCells, oldCells, parts);
+		for (int i = 0; i < numParts; ++i)
+			changed = ChangeOccupancy(parts[i], 1, newUnits) || changed;
+
+		// cells both cover keep their count
+		if (newUnits != oldUnits)
 		{
-			for (int i = startX; i < endX - 1; ++i)
+			const CellRect both =
 			{
-				if (i >= 0 && i < m_gridSize.x)
-				{
-					int index = INDEX(i, startY, newGridSize);
-					m_boundaries[index].normal = vec2(-1, 0);
-					m_boundaries[index].absorption = transform->absorption;
-					m_grid[index].b = 0;
-					m_grid[index].by = 0;
-				}
-			}
+				std::max(oldCells.rowBegin, newCells.rowBegin), std::min(oldCells.rowEnd, newCells.rowEnd),
+				std::max(oldCells.colBegin, newCells.colBegin), std::min(oldCells.colEnd, newCells.colEnd)
+			};
+			changed = ChangeOccupancy(both, 0, newUnits - oldUnits) || changed;
+		}
+		if (changed)
+			m_back->version = ++m_lastGeometryVersion;
+	}
+
+	CellRect Grid::GetCellRect(const AABB * transform) const
+	{
+		// define edges of the AABB, rows run along x
+		const int startY = (int)std::floor((transform->position.y - transform->height / (Real)2.f + m_gridOffset.y) * ((Real)1.f / m_dx));
+		const int startX = (int)std::floor((transform->position.x - transform->width  / (Real)2.f + m_gridOffset.x) * ((Real)1.f / m_dx));
+		const int endY   = (int)std::floor((transform->position.y + transform->height / (Real)2.f + m_gridOffset.y) * ((Real)1.f / m_dx));
+		const int endX   = (int)std::floor((transform->position.x + transform->width  / (Real)2.f + m_gridOffset.x) * ((Real)1.f / m_dx));
+
+		// the last row and column are included, objects covering them set their absorption
+		return CellRect
+		{
+			std::max(startX, 0), std::min(endX, (int)m_gridSize.x + 1),
+			std::max(startY, 0), std::min(endY, (int)m_gridSize.y + 1)
+		};
+	}
+
+	void Grid::AddShape(const PlaneShape* shape)
+	{
+		const CellRect wholeGrid = { 0, (int)m_gridSize.x + 1, 0, (int)m_gridSize.y + 1 };
+		AddShape(shape, wholeGrid);
+	}
+
+	void Grid::AddShape(const PlaneShape* shape, const CellRect& clip)
+	{
+		if (shape->type == pv_ShapeAABB)
+		{
+			const AABB box = { shape->position, shape->width, shape->height, shape->absorption };
+			AddAABB(&box, clip);
+			return;
+		}
+
+		ShapeRasterizer raster = GetShapeRasterizer(shape, clip);
+		if (ChangeOccupancy(raster, 1, ToOccupancyUnits(shape->absorption)))
+			m_back->version = ++m_lastGeometryVersion;
+	}
+
+	void Grid::RemoveShape(const PlaneShape* shape)
+	{
+		const CellRect wholeGrid = { 0, (int)m_gridSize.x + 1, 0, (int)m_gridSize.y + 1 };
+		ShapeRasterizer raster = GetShapeRasterizer(shape, wholeGrid);
+		if (ChangeOccupancy(raster, -1, -ToOccupancyUnits(shape->absorption)))
+			m_back->version = ++m_lastGeometryVersion;
+	}
+
+	void Grid::UpdateShape(const PlaneShape* oldShape, const PlaneShape* newShape)
+	{
+		if (oldShape->type == pv_ShapeAABB && newShape->type == pv_ShapeAABB)
+		{
+			const AABB oldBox = { oldShape->position, oldShape->width, oldShape->height, oldShape->absorption };
+			const AABB newBox = { newShape->position, newShape->width, newShape->height, newShape->absorption };
+			UpdateAABB(&oldBox, &newBox);
+			return;
 		}
-		// bottom
-		if (endY >= 0 && endY < m_gridSize.y)
+
+		const CellRect wholeGrid = { 0, (int)m_gridSize.x + 1, 0, (int)m_gridSize.y + 1 };
+		ShapeRasterizer oldRaster = GetShapeRasterizer(oldShape, wholeGrid);
+		ShapeRasterizer newRaster = GetShapeRasterizer(newShape, wholeGrid);
+		const long long oldUnits = ToOccupancyUnits(oldShape->absorption);
+		const long long newUnits = ToOccupancyUnits(newShape->absorption);
+		const int rowBegin = std::min(oldRaster.GetRowBegin(), newRaster.GetRowBegin());
+		const int rowEnd = std::max(oldRaster.GetRowEnd(), newRaster.GetRowEnd());
+
+		bool changed = false;
+		for (int row = rowBegin; row < rowEnd; ++row)
 		{
-			for (int i = startX; i < endX; ++i)
+			CellSpan oldSpans[PV_MAX_ROW_SPANS], newSpans[PV_MAX_ROW_SPANS];
+			const int numOld = oldRaster.GetRowSpans(row, oldSpans);
+			const int numNew = newRaster.GetRowSpans(row, newSpans);
+			if (numOld == 0 && numNew == 0)
+				continue;
+
+			// the row's span ends split it into stretches the old shape, the new one, both or neither cover
+			int ends[4 * PV_MAX_ROW_SPANS];
+			int numEnds = 0;
+			for (int i = 0; i < numOld; ++i)
 			{
-				if (i >= 0 && i < m_gridSize.x)
-				{
-					int index = INDEX(i, endY - 1, newGridSize);
-					m_boundaries[index].normal = vec2(1, 0);
-					m_boundaries[index].absorption = transform->absorption;
-					m_grid[index].b = 0;
-					m_grid[index].by = 0;
-				}
+				ends[numEnds++] = oldSpans[i].colBegin;
+				ends[numEnds++] = oldSpans[i].colEnd;
+			}
+			for (int i = 0; i < numNew; ++i)
+			{
+				ends[numEnds++] = newSpans[i].colBegin;
+				ends[numEnds++] = newSpans[i].colEnd;
+			}
+			std::sort(ends, ends + numEnds);
+
+			int firstChanged = INT_MAX, lastChanged = -1;
+			int nextOld = 0, nextNew = 0;
+			for (int i = 0; i + 1 < numEnds; ++i)
+			{
+				const int colBegin = ends[i];
+				const int colEnd = ends[i + 1];
+				if (colBegin == colEnd)
+					continue;
+				for (; nextOld < numOld && oldSpans[nextOld].colEnd <= colBegin; ++nextOld);
+				for (; nextNew < numNew && newSpans[nextNew].colEnd <= colBegin; ++nextNew);
+				const bool inOld = nextOld < numOld && oldSpans[nextOld].colBegin <= colBegin;
+				const bool inNew = nextNew < numNew && newSpans[nextNew].colBegin <= colBegin;
+
+				if (inOld && !inNew)
+					ChangeRowOccupancy(row, colBegin, colEnd, -1, -oldUnits, firstChanged, lastChanged);
+				else if (inNew && !inOld)
+					ChangeRowOccupancy(row, colBegin, colEnd, 1, newUnits, firstChanged, lastChanged);
+				else if (inOld && inNew && newUnits != oldUnits)
+					ChangeRowOccupancy(row, colBegin, colEnd, 0, newUnits - oldUnits, firstChanged, lastChanged);
 			}
+			ClassifyTiles(firstChanged, lastChanged + 1);
+			changed = changed || lastChanged >= 0;
 		}
+		if (changed)
+			m_back->version = ++m_lastGeometryVersion;
+	}
+
+	ShapeRasterizer Grid::GetShapeRasterizer(const PlaneShape* shape, const CellRect& clip) const
+	{
+		const CellRect bounds =
+		{
+			std::max(clip.rowBegin, 0), std::min(clip.rowEnd, (int)m_gridSize.x + 1),
+			std::max(clip.colBegin, 0), std::min(clip.colEnd, (int)m_gridSize.y + 1)
+		};
 
-		// left
-		if (startX >= 0 && startX < m_gridSize.x)
+		vec2 vertices[PV_MAX_SHAPE_VERTICES];
+		unsigned numVertices = 0;
+		switch (shape->type)
+		{
+		case pv_ShapeAABB:
 		{
-			for (int i = startY; i < endY; ++i)
+			const AABB box = { shape->position, shape->width, shape->height, shape->absorption };
+			const CellRect cells = GetCellRect(&box);
+			return ShapeRasterizer(CellRect
 			{
-				if (i >= 0 && i < m_gridSize.y)
-				{
-					int index = INDEX(startX, i, newGridSize);
-					m_boundaries[index].normal = vec2(0, -1);
-					m_boundaries[index].absorption = transform->absorption;
-					m_grid[index].b = 0;
-					m_grid[index].by = 0;
-				}
+				std::max(cells.rowBegin, bounds.rowBegin), std::min(cells.rowEnd, bounds.rowEnd),
+				std::max(cells.colBegin, bounds.colBegin), std::min(cells.colEnd, bounds.colEnd)
+			});
+		}
+		case pv_ShapeOrientedBox:
+		{
+			const Real c = std::cos(shape->rotation);
+			const Real s = std::sin(shape->rotation);
+			const Real hx = shape->width / (Real)2.f;
+			const Real hy = shape->height / (Real)2.f;
+			const Real corners[4][2] = { { -hx, -hy }, { hx, -hy }, { hx, hy }, { -hx, hy } };
+			for (const auto& corner : corners)
+			{
+				vertices[numVertices++] = vec2(shape->position.x + corner[0] * c - corner[1] * s,
+					shape->position.y + corner[0] * s + corner[1] * c);
 			}
+			break;
+		}
+		case pv_ShapePolygon:
+			numVertices = std::min(shape->numVertices, PV_MAX_SHAPE_VERTICES);
+			for (unsigned i = 0; i < numVertices; ++i)
+				vertices[i] = shape->vertices[i];
+			break;
+		case pv_ShapeSegment:
+		{
+			const vec2& a = shape->vertices[0];
+			const vec2& b = shape->vertices[1];
+			const Real length = std::sqrt((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+			const vec2 dir = length > (Real)0.f ? vec2((b.x - a.x) / length, (b.y - a.y) / length) : vec2(1.f, 0.f);
+
+			// at least dx * (|dir.x| + |dir.y|) thick the wall's cells stay edge connected and sound can't leak
+			// between them, square caps close the joints of consecutive segments
+			const Real half = std::max(shape->width, m_dx * (std::abs(dir.x) + std::abs(dir.y))) / (Real)2.f;
+			const vec2 along(dir.x * half, dir.y * half);
+			const vec2 across(-dir.y * half, dir.x * half);
+			vertices[numVertices++] = vec2(a.x - along.x - across.x, a.y - along.y - across.y);
+			vertices[numVertices++] = vec2(b.x + along.x - across.x, b.y + along.y - across.y);
+			vertices[numVertices++] = vec2(b.x + along.x + across.x, b.y + along.y + across.y);
+			vertices[numVertices++] = vec2(a.x - along.x + across.x, a.y - along.y + across.y);
+			break;
+		}
+		}
+
+		// to cell units the same way GetCellRect converts AABBs
+		for (unsigned i = 0; i < numVertices; ++i)
+		{
+			vertices[i].x = (vertices[i].x + m_gridOffset.x) * ((Real)1.f / m_dx);
+			vertices[i].y = (vertices[i].y + m_gridOffset.y) * ((Real)1.f / m_dx);
+		}
+		return ShapeRasterizer(vertices, numVertices, bounds);
+	}
+
+	bool Grid::ChangeOccupancy(const CellRect& rect, int countDelta, long long absorptionDelta)
+	{
+		bool changed = false;
+		for (int row = rect.rowBegin; row < rect.rowEnd; ++row)
+		{
+			int firstChanged = INT_MAX, lastChanged = -1;
+			ChangeRowOccupancy(row, rect.colBegin, rect.colEnd, countDelta, absorptionDelta, firstChanged, lastChanged);
+
+			// tiles are reclassified per row so a thin change doesn't reclassify every row in between
+			ClassifyTiles(firstChanged, lastChanged + 1);
+			changed = changed || lastChanged >= 0;
 		}
-		// right
-		if (endX >= 0 && endX < m_gridSize.x)
+		return changed;
+	}
+
+	bool Grid::ChangeOccupancy(ShapeRasterizer& raster, int countDelta, long long absorptionDelta)
+	{
+		bool changed = false;
+		for (int row = raster.GetRowBegin(); row < raster.GetRowEnd(); ++row)
+		{
+			CellSpan spans[PV_MAX_ROW_SPANS];
+			const int numSpans = raster.GetRowSpans(row, spans);
+			int firstChanged = INT_MAX, lastChanged = -1;
+			for (int i = 0; i < numSpans; ++i)
+				ChangeRowOccupancy(row, spans[i].colBegin, spans[i].colEnd, countDelta, absorptionDelta, firstChanged, lastChanged);
+			ClassifyTiles(firstChanged, lastChanged + 1);
+			changed = changed || lastChanged >= 0;
+		}
+		return changed;
+	}
+
+	void Grid::ChangeRowOccupancy(int row, int colBegin, int colEnd, int countDelta, long long absorptionDelta,
+		int& firstChanged, int& lastChanged)
+	{
+		const int rowLength = (int)m_gridSize.y + 1;
+		for (int col = colBegin; col < colEnd; ++col)
 		{
-			for (int i = startY; i < endY; ++i)
+			const int index = row * rowLength + col;
+			if (!IsCellSimulated(index))
+				continue;
+
+			// removing an object that was never added leaves the cell alone
+			CellOccupancy& occupancy = m_back->occupancy[index];
+			if (countDelta <= 0 && occupancy.count == 0)
+				continue;
+			occupancy.count += countDelta;
+			occupancy.absorptionSum += absorptionDelta;
+			if (occupancy.count == 0)
+				occupancy.absorptionSum = 0;
+
+			if (RefreshCellBoundary(index))
 			{
-				if (i >= 0 && i < m_gridSize.y)
-				{
-					int index = INDEX(endX - 1, i, newGridSize);
-					m_boundaries[index].normal = vec2(0, 1);
-					m_boundaries[index].absorption = transform->absorption;
-					m_grid[index].b = 0;
-					m_grid[index].by = 0;
-				}
+				firstChanged = std::min(firstChanged, index);
+				lastChanged = index;
 			}
 		}
+	}
+
+	bool Grid::RefreshCellBoundary(int index)
+	{
+		const int rowLength = (int)m_gridSize.y + 1;
+		const int row = index / rowLength;
+		const int col = index % rowLength;
+		const CellOccupancy& occupancy = m_back->occupancy[index];
+
+		// covered cells are walls, the rest air, except the grid's rigid edge
+		int b = 0, by = 0;
+		Real absorption = PV_ABSORPTION_FREE_SPACE;
+		if (occupancy.count > 0)
+		{
+			absorption = FromOccupancyUnits(occupancy.absorptionSum, occupancy.count);
+		}
+		else if (row != (int)m_gridSize.x && col != (int)m_gridSize.y)
+		{
+			b = 1;
+			by = col != 0;
+		}
+
+		const int wasB = (m_back->bMask[index >> 5] >> (index & 31)) & 1;
+		const int wasBy = (m_back->byMask[index >> 5] >> (index & 31)) & 1;
+		if (b == wasB && by == wasBy && absorption == m_back->boundaries[index].absorption)
+			return false;
+
+		m_back->boundaries[index].normal = vec2(0, 0);
+		SetCellBoundary(index, b, by, absorption);
+		return true;
+	}
+
+	bool Grid::GetRecenterShift(const vec3& listener, int& rows, int& cols) const
+	{
+		// listener relative to the grid's center, world z runs along the columns
+		const Real x = listener.x + m_gridOffset.x - m_gridDimensions.x / (Real)2.f;
+		const Real y = listener.z + m_gridOffset.y - m_gridDimensions.y / (Real)2.f;
+		if (std::abs(x) <= m_recenterDistance && std::abs(y) <= m_recenterDistance)
+			return false;
+
+		rows = (int)std::round(x / m_dx);
+		cols = (int)std::round(y / m_dx);
+		return rows != 0 || cols != 0;
+	}
+
+	int Grid::MoveGrid(int rows, int cols, CellRect exposed[PV_MAX_EXPOSED_RECTS])
+	{
+		const int gridx = (int)m_gridSize.x;
+		const int gridy = (int)m_gridSize.y;
+		const int rowLength = gridy + 1;
+
+		// recomputed from the total shift so moving back and forth doesn't drift
+		m_shiftRows += rows;
+		m_shiftCols += cols;
+		m_gridOffset.x = m_initialOffset.x - (Real)m_shiftRows * m_dx;
+		m_gridOffset.y = m_initialOffset.y - (Real)m_shiftCols * m_dx;
 
-		// inside
-		for (int i = startY + 1; i < endY - 1; ++i)
+		// walk away from the cells being read so every source is copied before it's overwritten
+		for (int r = 0; r <= gridx; ++r)
 		{
-			if (i >= 0 && i < m_gridSize.y)
+			const int row = rows >= 0 ? r : gridx - r;
+			for (int c = 0; c <= gridy; ++c)
 			{
-				for (int j = startX + 1; j < endX - 1; ++j)
+				const int col = cols >= 0 ? c : gridy - c;
+				const int index = row * rowLength + col;
+				const int sourceRow = row + rows;
+				const int sourceCol = col + cols;
+				m_back->boundaries[index].normal = vec2(0, 0);
+
+				// the last row and column are the grid's rigid edge, they don't move with the geometry
+				if (row == gridx || col == gridy)
 				{
-					if (j >= 0 && j < m_gridSize.x)
-					{
-						int index = INDEX(j, i, newGridSize);
-						m_boundaries[index].normal = vec2(0, 0);
-						m_boundaries[index].absorption = PV_ABSORPTION_FREE_SPACE;
-						m_grid[index].b = 0;
-						m_grid[index].by = 0;
-					}
+					m_back->occupancy[index] = CellOccupancy{ 0, 0 };
+					SetCellBoundary(index, 0, 0, PV_ABSORPTION_FREE_SPACE);
+				}
+				// cells that came in from outside are air until voxelized
+				else if (sourceRow < 0 || sourceRow >= gridx || sourceCol < 0 || sourceCol >= gridy)
+				{
+					m_back->occupancy[index] = CellOccupancy{ 0, 0 };
+					SetCellBoundary(index, 1, col != 0, PV_ABSORPTION_FREE_SPACE);
+				}
+				else
+				{
+					const int source = sourceRow * rowLength + sourceCol;
+					const int isAir = (m_back->bMask[source >> 5] >> (source & 31)) & 1;
+					m_back->occupancy[index] = m_back->occupancy[source];
+					m_back->boundaries[index].normal = m_back->boundaries[source].normal;
+					SetCellBoundary(index, isAir, isAir && col != 0, m_back->boundaries[source].absorption);
 				}
 			}
 		}
-		*/
+		ClassifyTiles(0, (gridx + 1) * rowLength);
+		m_back->version = ++m_lastGeometryVersion;
 
-		for (int i = startY; i < endY; ++i)
+		// the edge row and column, the rows that came in, then the columns that came in across the other rows
+		int numExposed = 0;
+		exposed[numExposed++] = CellRect{ gridx, gridx + 1, 0, gridy + 1 };
+		exposed[numExposed++] = CellRect{ 0, gridx, gridy, gridy + 1 };
+		CellRect remaining = { 0, gridx, 0, gridy };
+		if (rows != 0)
 		{
-			if (i >= 0 && i <= m_gridSize.y)
+			const int count = std::min(std::abs(rows), gridx);
+			if (rows > 0)
 			{
-				for (int j = startX; j < endX; ++j)
-				{
-					if (j >= 0 && j <= m_gridSize.x)
-					{
-						int index = INDEX(j, i, newGridSize);
-						m_boundaries[index].normal = vec2(0, 0);
-						m_boundaries[index].absorption = transform->absorption;
-
-						m_grid[index].b = 0;
-						m_grid[index].by = 0;
-					}
-				}
+				exposed[numExposed++] = CellRect{ gridx - count, gridx, 0, gridy };
+				remaining.rowEnd = gridx - count;
+			}
+			else
+			{
+				exposed[numExposed++] = CellRect{ 0, count, 0, gridy };
+				remaining.rowBegin = count;
 			}
 		}
+		if (cols != 0 && remaining.rowBegin < remaining.rowEnd)
+		{
+			const int count = std::min(std::abs(cols), gridy);
+			remaining.colBegin = cols > 0 ? gridy - count : 0;
+			remaining.colEnd = cols > 0 ? gridy : count;
+			exposed[numExposed++] = remaining;
+		}
+		return numExposed;
 	}
 
-	void Grid::RemoveAABB(const AABB * transform)
+	void Grid::SwapGeometry()
+	{
+		std::swap(m_front, m_back);
+	}
+
+	void Grid::CopyFrontGeometry()
+	{
+		if (m_back == m_front)
+			return;
+
+		const unsigned rowLength = (unsigned)m_gridSize.y + 1;
+		const unsigned lengthPerGrid = (unsigned)(m_gridSize.x + 1) * rowLength;
+		const unsigned lengthPerPlane = GetPlaneLength(lengthPerGrid, rowLength);
+		const unsigned lengthPerMask = GetMaskLength(lengthPerPlane);
+		std::memcpy(m_back->bMask, m_front->bMask, lengthPerMask * sizeof(unsigned));
+		std::memcpy(m_back->byMask, m_front->byMask, lengthPerMask * sizeof(unsigned));
+		std::memcpy(m_back->tileClasses, m_front->tileClasses, lengthPerMask * sizeof(TileClass));
+		std::memcpy(m_back->admittance, m_front->admittance, lengthPerPlane * sizeof(Real));
+		std::memcpy(m_back->boundaries, m_front->boundaries, lengthPerGrid * sizeof(BoundaryInfo));
+		std::memcpy(m_back->occupancy, m_front->occupancy, lengthPerGrid * sizeof(CellOccupancy));
+		m_back->version = m_front->version;
+	}
+
+	void Grid::SetCellBoundary(int index, int b, int by, Real absorption)
 	{
-		// define edges of the AABB
-		int startY = (int)((transform->position.y - transform->height / (Real)2.f + m_gridOffset.y) * ((Real)1.f / m_dx));
-		int startX = (int)((transform->position.x - transform->width  / (Real)2.f + m_gridOffset.x) * ((Real)1.f / m_dx));
-		int endY   = (int)((transform->position.y + transform->height / (Real)2.f + m_gridOffset.y) * ((Real)1.f / m_dx));
-		int endX   = (int)((transform->position.x + transform->width  / (Real)2.f + m_gridOffset.x) * ((Real)1.f / m_dx));
+		const unsigned bit = 1u << (index & 31);
+		const int word = index >> 5;
+		m_back->bMask[word] = b ? (m_back->bMask[word] | bit) : (m_back->bMask[word] & ~bit);
+		m_back->byMask[word] = by ? (m_back->byMask[word] | bit) : (m_back->byMask[word] & ~bit);
 
-		vec2 newGridSize(m_gridSize.x + 1, m_gridSize.y + 1);
+		// keep the admittance plane in sync so the kernels never recompute it
+		m_back->boundaries[index].absorption = absorption;
+		m_back->admittance[index] = (1.f - absorption) / (1.f + absorption);
+	}
+
+	void Grid::ClassifyTiles(int begin, int end)
+	{
+		const int rowLength = (int)m_gridSize.y + 1;
+		const int numCells = (int)(m_gridSize.x + 1) * rowLength;
+		if (end <= begin)
+			return;
 
-		// reset area of the AABB
-		for (int i = startY; i < endY; ++i)
+		// a cell's velocity reads the cell before it and the cell a row before it
+		const int firstTile = begin / PV_TILE_SIZE;
+		const int lastTile = (std::min(end + rowLength, numCells) - 1) / PV_TILE_SIZE;
+		for (int tile = firstTile; tile <= lastTile; ++tile)
 		{
-			if (i >= 0 && i <= m_gridSize.y)
+			const int tileEnd = std::min((tile + 1) * PV_TILE_SIZE, numCells);
+			bool allAir = true;
+			bool allSolid = true;
+			for (int i = tile * PV_TILE_SIZE; i < tileEnd; ++i)
 			{
-				for (int j = startX; j < endX; ++j)
-				{
-					if (j >= 0 && j <= m_gridSize.x)
-					{
-						int index = INDEX(j, i, newGridSize);
-						m_boundaries[index].normal = vec2(0, 0);
-						m_boundaries[index].absorption = PV_ABSORPTION_FREE_SPACE;
-						
-						m_grid[index].b = 1;
-						m_grid[index].by = 1;
-
-						
-						if (i == (int)m_gridSize.x || j == (int)m_gridSize.y)
-						{
-							m_grid[index].b = 0;
-							m_grid[index].by = 0;
-						}
-						else if (j == 0)
-						{
-							m_grid[index].b = 1;
-							m_grid[index].by = 0;
-						}
-						else
-						{
-							m_grid[index].b = 1;
-							m_grid[index].by = 1;
-						}
-						
-					}
-				}
+				// first row and first cell have no neighbor to read
+				const unsigned b = (m_back->bMask[i >> 5] >> (i & 31)) & 1;
+				const unsigned bx = i >= rowLength ? (m_back->bMask[(i - rowLength) >> 5] >> ((i - rowLength) & 31)) & 1 : b;
+				const unsigned by = i >= 1 ? (m_back->bMask[(i - 1) >> 5] >> ((i - 1) & 31)) & 1 : b;
+				allAir = allAir && (b & bx & by);
+				allSolid = allSolid && !(b | bx | by);
 			}
+			m_back->tileClasses[tile] = allAir ? tile_Air : (allSolid ? tile_Solid : tile_Mixed);
 		}
 	}
 
-	void Grid::UpdateAABB(const AABB * oldTransform, const AABB * newTransform)
+	int Grid::GetStorageIndex(int index) const
+	{
+		if (!m_blockBases)
+			return index;
+
+		const int rowLength = (int)m_gridSize.y + 1;
+		const int row = index / rowLength;
+		const int col = index % rowLength;
+		const int blockCol = col / PV_STORAGE_BLOCK_SIZE;
+		const int base = m_blockBases[(row / PV_STORAGE_BLOCK_SIZE) * m_numBlockCols + blockCol];
+		if (base < 0)
+			return -1;
+
+		// blocks on the last column of blocks are narrower
+		const int width = std::min(PV_STORAGE_BLOCK_SIZE, rowLength - blockCol * PV_STORAGE_BLOCK_SIZE);
+		return base + (row % PV_STORAGE_BLOCK_SIZE) * width + col % PV_STORAGE_BLOCK_SIZE;
+	}
+
+	int Grid::GetTileRunEnd(int begin, int end) const
+	{
+		const TileClass tileClass = m_front->tileClasses[begin / PV_TILE_SIZE];
+		int runEnd = (begin / PV_TILE_SIZE + 1) * PV_TILE_SIZE;
+		while (runEnd < end && m_front->tileClasses[runEnd / PV_TILE_SIZE] == tileClass)
+			runEnd += PV_TILE_SIZE;
+		return std::min(runEnd, end);
+	}
+
+	void Grid::SetProbeCells(const int * cells, int count)
+	{
+		if (m_probeCapacity == 0)
+			return;
+
+		// release the last set
+		for (int i = 0; i < m_numProbeCells; ++i)
+			m_probeSlots[m_probeCells[i]] = -1;
+
+		const int numCells = (int)(m_gridSize.x + 1) * (int)(m_gridSize.y + 1);
+		m_numProbeCells = 0;
+		for (int i = 0; i < count && m_numProbeCells < m_probeCapacity; ++i)
+		{
+			const int cell = cells[i];
+			if (cell < 0 || cell >= numCells || m_probeSlots[cell] >= 0 || !IsCellSimulated(cell))
+				continue;
+			m_probeSlots[cell] = m_numProbeCells;
+			m_probeCells[m_numProbeCells++] = cell;
+		}
+
+		// recording finds each row's probes with a binary search
+		std::sort(m_probeCells, m_probeCells + m_numProbeCells);
+		for (int i = 0; i < m_numProbeCells; ++i)
+			m_probeSlots[m_probeCells[i]] = i;
+	}
+
+	Cell Grid::GetCell(int index) const
 	{
-		// remove then re-add the new AABB
-		RemoveAABB(oldTransform);
-		AddAABB(newTransform);
+		const int word = index >> 5;
+		const int shift = index & 31;
+		return Cell(m_pr[index], m_vx[index], m_vy[index], (m_front->bMask[word] >> shift) & 1, (m_front->byMask[word] >> shift) & 1);
 	}
 
 	// Debug print the grid
@@ -316,29 +1018,29 @@ namespace Planeverb
 				int index = INDEX(i, j, newGridSize);
 
 				/* old version based off of normal
-				if(m_boundaries[index].normal.x == m_boundaries[index].normal.y && m_boundaries[index].normal.x == 0)
+				if(m_front->boundaries[index].normal.x == m_front->boundaries[index].normal.y && m_front->boundaries[index].normal.x == 0)
 				{
 					std::cout << " .";
 				}
 				else
 				{
-					if (m_boundaries[index].normal.x != 0.f)
+					if (m_front->boundaries[index].normal.x != 0.f)
 					{
-						if (m_boundaries[index].normal.x > 0)
+						if (m_front->boundaries[index].normal.x > 0)
 							std::cout << "x>";
 						else
 							std::cout << "<x";
 					}
 					else
 					{
-						if (m_boundaries[index].normal.y > 0)
+						if (m_front->boundaries[index].normal.y > 0)
 							std::cout << "yv";
 						else
 							std::cout << "y^";
 					}
 				}*/
 
-				const Cell& cell = m_grid[index];
+				const Cell cell = GetCell(index);
 				if (cell.b || cell.by)
 				{
 					std::cout << " .";
@@ -372,21 +1074,57 @@ namespace Planeverb
 		// calculate total memory size
 		// length per grid uses gridsize + 1 for extended velocity fields
 		unsigned lengthPerGrid = (unsigned)(m_gridSize.x + 1) * (unsigned)(m_gridSize.y + 1);
+		unsigned lengthPerPlane = GetPlaneLength(lengthPerGrid, (unsigned)(m_gridSize.y + 1));
+		unsigned lengthPerMask = GetMaskLength(lengthPerPlane);
 		unsigned sizePerBoundary = sizeof(BoundaryInfo) * lengthPerGrid;
-		unsigned lengthPerResponse = (unsigned)(m_samplingRate * PV_IMPULSE_RESPONSE_S);
+		unsigned lengthPerResponse = (unsigned)(m_samplingRate * CalculateResponseDuration(config->gridSizeInMeters));
+		unsigned numRows = (unsigned)(m_gridSize.x + 1);
+		int numThreads = GetSimulationThreads(config, numRows);
+		int timeBlockSize = std::max(1, (int)config->timeStepsPerBlock);
+		unsigned lengthPerScratch = GetBlockScratchLength(numRows, (unsigned)(m_gridSize.y + 1), numThreads, timeBlockSize);
+		unsigned lengthPerStorage = GetStorageLayout(config, m_dx, (int)numRows, (int)(m_gridSize.y + 1), nullptr);
 		unsigned size =
 			lengthPerResponse * sizeof(Real) +	// memory for Gaussian pulse values
-			lengthPerGrid * sizeof(Cell) +		// memory for Cell grid
+			4 * (lengthPerPlane * sizeof(Real) + PV_SIMD_ALIGNMENT) +	// memory for pr, vx, vy and admittance planes
+			3 * lengthPerScratch * sizeof(Real) + PV_SIMD_ALIGNMENT +	// memory for temporal blocking scratch planes
+			3 * lengthPerPlane * GetListenerLanes(config) * sizeof(Real) + PV_SIMD_ALIGNMENT +	// memory for the interleaved planes of listener batches
+			(2 * numThreads + 1) * PV_SIMD_ALIGNMENT +	// memory for per thread energy of early termination
+			lengthPerGrid * sizeof(CellOccupancy) +	// memory for cell occupancy
+			2 * lengthPerMask * sizeof(unsigned) +	// memory for B and By masks
 			sizePerBoundary +	// memory for boundary information
+			GetProbeTableSize(config, lengthPerGrid) +	// memory for probe cell tables
+			GetStorageTableSize(config, (int)numRows, (int)(m_gridSize.y + 1)) +	// memory for the storage block table
+			lengthPerMask * sizeof(TileClass) +	// memory for tile classes
+			(config->voxelizeConcurrently ? GetGeometrySize(lengthPerGrid, lengthPerPlane, lengthPerMask) : 0) +	// memory for the back copy of the walls
+			PV_SIMD_ALIGNMENT +	// alignment of the response storage
 
 			/// memory for pulse response Cell[x][y][t]
 			///sizePerGrid * lengthPerResponse;
-			// memory for pulse response std::vector<Cell>[x][y]
-			lengthPerGrid * sizeof(std::vector<Cell>);
+			// memory for pulse response std::vector<Cell>[x][y], or the streaming accumulator
+			GetResponseStorageSize(config, lengthPerGrid, lengthPerStorage, lengthPerResponse, m_samplingRate);
 
 		return size;
 	}
 
+	unsigned Grid::GetDecodedResponseLength(const PlaneverbConfig* config)
+	{
+		if (config->analysisMode != pv_CompressedAnalysis)
+			return 0;
+
+		Real dx, dt;
+		unsigned samplingRate;
+		CalculateGridParameters(config->gridResolution, dx, dt, samplingRate);
+		const unsigned lengthPerResponse = (unsigned)(samplingRate * CalculateResponseDuration(config->gridSizeInMeters));
+		return ResponseRecorder::GetDecimatedLength(lengthPerResponse);
+	}
+
+	Real CalculateResponseDuration(const vec2& gridSizeInMeters)
+	{
+		// sound travels across half the grid's diagonal, then the reverb tail is collected
+		const Real halfDiagonal = (Real)0.5f * std::sqrt(gridSizeInMeters.x * gridSizeInMeters.x + gridSizeInMeters.y * gridSizeInMeters.y);
+		return halfDiagonal / PV_C + PV_RESPONSE_TAIL_S;
+	}
+
 	void CalculateGridParameters(int resolution, Real & dx, Real & dt, unsigned & samplingRate)
 	{
 		Real minWavelength = PV_C / (Real)resolution;
@@ -1,12 +1,20 @@
 #pragma once
 #include "PvTypes.h"
+#include "FDTDKernels.h"
+#include <DSP\ResponseAccumulator.h>
+#include <DSP\ResponseRecorder.h>
 #include <vector>
 #include <mutex>
 
 namespace Planeverb
 {
+	class ShapeRasterizer;
+
 	void CalculateGridParameters(int resolution, Real& dx, Real& dt, unsigned& samplingRate);
 
+	// seconds of impulse response for a grid, long enough for sound to cross half its diagonal plus a reverb tail
+	Real CalculateResponseDuration(const vec2& gridSizeInMeters);
+
 	// struct to represent wall information
 	// 12 bytes
 	struct BoundaryInfo
@@ -21,6 +29,48 @@ namespace Planeverb
 		BoundaryInfo& operator=(const BoundaryInfo&) = default;
 	};
 
+	// objects covering a cell, the cell is a wall while any does, with their mean absorption
+	// 16 bytes
+	struct CellOccupancy
+	{
+		long long absorptionSum;	// sum of the covering objects' absorptions, fixed point
+		unsigned count;				// number of covering objects
+	};
+
+	// tiles are the 32 cells of one B field mask word, classified by the cells and the neighbors their velocity reads
+	const constexpr int PV_TILE_SIZE = 32;
+	enum TileClass : unsigned char
+	{
+		tile_Mixed,		// walls and air, full boundary update
+		tile_Air,		// all air, plain stencil
+		tile_Solid		// all walls, stays at rest and is skipped
+	};
+
+	// one copy of the walls, every plane is indexed by the flat cell index
+	struct GridGeometry
+	{
+		unsigned* bMask;			// B field, one bit per cell
+		unsigned* byMask;			// By field, one bit per cell
+		TileClass* tileClasses;		// class of each tile, one per mask word
+		Real* admittance;			// (1 - R) / (1 + R) from the absorption of each cell
+		BoundaryInfo* boundaries;	// wall information
+		CellOccupancy* occupancy;	// objects covering each cell
+		unsigned version;			// geometry version of this copy
+	};
+
+	// response storage is allocated in square blocks of cells, only for blocks overlapping a simulated region
+	const constexpr int PV_STORAGE_BLOCK_SIZE = 32;
+
+	// cells [rowBegin, rowEnd) x [colBegin, colEnd)
+	struct CellRect
+	{
+		int rowBegin, rowEnd;
+		int colBegin, colEnd;
+	};
+
+	// most rectangles of cells a grid move leaves to voxelize
+	const constexpr int PV_MAX_EXPOSED_RECTS = 4;
+
 	// Grid system
 	class Grid
 	{
@@ -32,32 +82,199 @@ namespace Planeverb
 		void GenerateResponseCPU(const vec3& listener);
 		void GenerateResponseGPU(const vec3& listener);
 		void GenerateResponse(const vec3& listener);
+
+		// listener batches, with PlaneverbConfig::batchListeners up to GetMaxBatchedListeners() listeners are
+		// simulated at once, their fields interleaved across the lanes of each cell, into their own responses
+		// SelectListener picks the listener of the last batch GetResponse and GetResponseSize return,
+		// GenerateResponse selects its listener
+		void GenerateResponses(const vec3* listeners, unsigned count);
+		void SelectListener(unsigned listener);
+		// 1 unless listeners are batched
+		unsigned GetMaxBatchedListeners() const { return (unsigned)m_numResponseFields; }
+
 		Cell* GetResponse(const vec2& gridPosition);
+		// compressed responses are decoded into decodeBuffer, GetDecodedResponseLength cells, so threads can decode concurrently
+		Cell* GetResponse(const vec2& gridPosition, Cell* decodeBuffer);
 		unsigned GetResponseSize() const;
 
+		// streaming analysis results, nullptr unless the grid was created with pv_StreamingAnalysis
+		const ResponseAccumulator* GetAccumulator() const { return m_accumulator; }
+		int GetCellIndex(const vec2& gridPosition) const;
+
+		// flat index of the cell a listener's pulse starts from
+		int GetListenerCell(const vec3& listener) const;
+
+		// bumped by every change to the walls the simulation uses and every move of the grid
+		unsigned GetGeometryVersion() const { return m_front->version; }
+
+		// index of a cell's response in the response storage, -1 if the cell is outside the simulated regions
+		int GetStorageIndex(int index) const;
+		bool IsCellSimulated(int index) const { return GetStorageIndex(index) >= 0; }
+		PlaneverbAnalysisMode GetAnalysisMode() const { return m_analysisMode; }
+
+		// probe recording, cells are flat grid indices, duplicates are ignored
+		// must not be called while a response is being generated
+		void SetProbeCells(const int* cells, int count);
+		bool IsProbeRecording() const { return m_probeCapacity > 0; }
+		const int* GetProbeCells() const { return m_probeCells; }
+		int GetNumProbeCells() const { return m_numProbeCells; }
+
 		unsigned GetSamplingRate() const { return m_samplingRate; }
+		unsigned GetResponseSamplingRate() const;
 		unsigned GetMaxThreads() const { return m_maxThreads; }
 		const vec2& GetGridSize() const { return m_gridSize; }
 		const vec2& GetGridOffset() const { return m_gridOffset; }
 		Real GetDX() const { return m_dx; }
 		int GetResolution() const { return m_resolution; }
 
+		// every object is counted in the cells it covers, so overlapping objects can be removed in any order
 		void AddAABB(const AABB* transform);
+		void AddAABB(const AABB* transform, const CellRect& clip);
 		void RemoveAABB(const AABB* transform);
+		// only touches the cells one of the two transforms covers, and the others if the absorption changed
 		void UpdateAABB(const AABB* oldTransform, const AABB* newTransform);
 
+		// rotated boxes, polygons and segments are scanline rasterized, AABB shapes take the AABB path
+		void AddShape(const PlaneShape* shape);
+		void AddShape(const PlaneShape* shape, const CellRect& clip);
+		void RemoveShape(const PlaneShape* shape);
+		// row by row, only touches the cells one of the two shapes covers, and the others if the absorption changed
+		void UpdateShape(const PlaneShape* oldShape, const PlaneShape* newShape);
+
+		// listener following, the grid moves by whole cells, must not be called while a response is being generated
+		// GetRecenterShift returns false while the listener is close enough to the grid's center
+		bool GetRecenterShift(const vec3& listener, int& rows, int& cols) const;
+		// cell (r, c) takes the geometry of cell (r + rows, c + cols), cells that were outside the grid and
+		// the grid's edge become air and are returned as rectangles to voxelize, returns their count
+		int MoveGrid(int rows, int cols, CellRect exposed[PV_MAX_EXPOSED_RECTS]);
+
+		// concurrent voxelization, with PlaneverbConfig::voxelizeConcurrently the simulation reads the front copy
+		// of the walls while geometry changes and moves edit the back copy, otherwise both are the same copy
+		// none of these may be called while a response is being generated or the back copy is edited
+		bool HasBackGeometry() const { return m_back != m_front; }
+		// the back copy becomes the one simulated
+		void SwapGeometry();
+		// copies the front walls into the back copy
+		void CopyFrontGeometry();
+		// the back copy has the front's walls again after replaying the front's changes, it takes the front's version
+		void MatchFrontVersion() { m_back->version = m_front->version; }
+
 		void PrintGrid();
 		static unsigned GetMemoryRequirement(const struct PlaneverbConfig* config);
+		// cells of a decode buffer for GetResponse, 0 unless the grid is created with pv_CompressedAnalysis
+		static unsigned GetDecodedResponseLength(const struct PlaneverbConfig* config);
 	private:
+		// constants shared by every thread during one simulation
+		struct SimulationInfo
+		{
+			FDTDPlanes planes;		// global planes
+			int gridx, gridy;		// grid size in cells
+			int numRows;			// rows of gridy + 1 cells, partitioned between threads
+			int listenerPos;		// flat index of the pulse source
+			int listenerRow;		// row of the pulse source
+			int listenerCol;		// column of the pulse source
+			int responseLength;		// number of time steps
+		};
+
+		SimulationInfo GetSimulationInfo(const vec3& listener) const;
+		void GenerateResponsesCPU(const vec3* listeners, unsigned count);
+
+		// per thread stepping, called from inside the simulation's parallel region
+		// both return the number of time steps simulated
+		int SimulateRows(const SimulationInfo& info, int thread, int rowBegin, int rowEnd);
+		int SimulateRowsBlocked(const SimulationInfo& info, int thread, int rowBegin, int rowEnd);
+		// a listener batch, planes are the interleaved planes, fills in the time steps simulated for each listener
+		void SimulateListenerRows(const SimulationInfo* infos, int count, const FDTDPlanes& planes, int thread, int rowBegin, int rowEnd, int* steps);
+
+		// early termination, every thread publishes the energy of its rows, then all threads make the same decision
+		// listener batches publish and decide for each listener of the batch
+		void PublishEnergy(int thread, int parity, Real energy, int listener = 0);
+		bool HasResponseDecayed(int parity, Real& peakEnergy, int listener = 0) const;
+
+		// light cone culling, every cell outside the active region is still at rest and isn't stepped or recorded
+		// the active region is the cells that may be non-zero at a time step
+		CellRect GetActiveRegion(const SimulationInfo& info, int t) const;
+		int GetActivationStep(const SimulationInfo& info, int index) const;
+		void RecordInactiveSteps(const SimulationInfo& info, int rowBegin, int rowEnd, int steps, int listener = 0);
+
+		// single row operations, planes may be a thread's local copy where global index = local index + offset
+		// StepRow returns the energy of the row's new pressure
+		Real StepRow(const SimulationInfo& info, const FDTDPlanes& planes, int offset, int row, int t, bool record, bool pressureOnly);
+		Real UpdatePressure(const FDTDPlanes& planes, int offset, int begin, int end) const;
+		void UpdateVelocity(const FDTDPlanes& planes, int offset, int begin, int end) const;
+		// lanes is the number of interleaved fields per cell of the planes
+		void ApplyAbsorbingBoundary(const SimulationInfo& info, const FDTDPlanes& planes, int offset, int row, int lanes = 1);
+		void RecordResponse(const FDTDPlanes& planes, int offset, int begin, int end, int t);
+		void RecordSegments(const FDTDPlanes& planes, int offset, int begin, int end, int t);
+		void RecordCells(const FDTDPlanes& planes, int offset, int begin, int end, int storageBegin, int t);
+
+		// listener batches, the same on interleaved planes, energy has one sum per lane
+		void UpdatePressureLanes(const FDTDPlanes& planes, int begin, int end, Real* energy) const;
+		void UpdateVelocityLanes(const FDTDPlanes& planes, int begin, int end) const;
+		// records cells [begin, end) of the listeners whose bit is set in listeners
+		void RecordListenerResponses(const FDTDPlanes& planes, int begin, int end, int t, unsigned listeners);
+
+		void SetCellBoundary(int index, int b, int by, Real absorption);
+
+		// occupancy, cells of an object clipped to the grid, and a change to the count and absorption sum of a
+		// rectangle's cells, both return true if any cell's boundary changed
+		CellRect GetCellRect(const AABB* transform) const;
+		bool ChangeOccupancy(const CellRect& rect, int countDelta, long long absorptionDelta);
+		bool ChangeOccupancy(ShapeRasterizer& raster, int countDelta, long long absorptionDelta);
+		// cells [colBegin, colEnd) of a row, widens [firstChanged, lastChanged] by the cells whose boundary changed
+		void ChangeRowOccupancy(int row, int colBegin, int colEnd, int countDelta, long long absorptionDelta,
+			int& firstChanged, int& lastChanged);
+		// the cells of a shape in cell units, clipped to clip
+		ShapeRasterizer GetShapeRasterizer(const PlaneShape* shape, const CellRect& clip) const;
+		bool RefreshCellBoundary(int index);
+
+		// reclassify the tiles of cells [begin, end) and of the cells reading them
+		void ClassifyTiles(int begin, int end);
+		int GetTileRunEnd(int begin, int end) const;
+		Cell GetCell(int index) const;
+
 		char* m_mem;								// memory pool
-		Cell* m_grid;								// cell grid
-		BoundaryInfo* m_boundaries;					// wall information
+
+		// cell grid, stored as one aligned plane per field
+		Real* m_pr;									// air pressure
+		Real* m_vx;									// x component of particle velocity
+		Real* m_vy;									// y component of particle velocity
+		GridGeometry m_geometry[2];					// walls, the second copy is only used with concurrent voxelization
+		GridGeometry* m_front;						// walls the simulation reads
+		GridGeometry* m_back;						// walls geometry changes edit, the front copy unless voxelizing concurrently
+		unsigned m_lastGeometryVersion;				// last version given to a copy of the walls
+		const FDTDKernels* m_kernels;				// kernels for the widest instruction set the CPU supports
+		Real* m_blockScratch;						// per thread pr, vx and vy row copies for temporal blocking
+		unsigned m_blockScratchLength;				// length of each of the three scratch planes
+
+		// listener batches
+		const FDTDLaneKernels* m_laneKernels;		// interleaved kernels, nullptr unless listeners are batched
+		Real* m_lanePr;								// pressure of every listener of a batch, lanes per cell
+		Real* m_laneVx;								// x velocity of every listener of a batch
+		Real* m_laneVy;								// y velocity of every listener of a batch
+		int m_numResponseFields;					// listeners with their own response storage, 1 unless batched
+		int m_selectedListener;						// listener GetResponse returns the responses of
+		int m_listenerSteps[PV_MAX_LISTENERS];		// time steps simulated for each listener of the last batch
 
 		// originally used a 3D array of Cells for pulse response, 
 		// but each access to it was probably a cache miss because of the length
 		// of each response anyway, so 
 		// it has been converted to being a 2D array of std::vectors
+		// batched listeners each have m_numStoredCells of them, one after the other
 		std::vector<Cell>* m_pulseResponse;
+		int* m_blockBases;							// first storage index of each storage block, -1 if not stored, nullptr if dense
+		int m_numBlockCols;							// storage blocks per row of blocks
+		int m_numStoredCells;						// cells with response storage
+		ResponseAccumulator* m_accumulator;			// running analysis per cell, replaces m_pulseResponse when streaming
+		ResponseRecorder* m_recorder;				// compressed responses, replaces m_pulseResponse in compressed mode
+		Cell* m_decodedResponse;					// one decoded compressed response, returned by GetResponse
+
+		// probe recording
+		int* m_probeCells;							// sorted flat indices of the recorded cells
+		int* m_probeSlots;							// per cell index into m_probeCells, -1 if not recorded
+		Cell* m_probeResponses;						// full responses of the probe cells, replaces m_pulseResponse
+		int m_numProbeCells;						// number of recorded cells
+		int m_probeCapacity;						// max number of recorded cells, 0 records the full field
 
 		Real* m_pulse;								// precomputed Gaussian pulse
 
@@ -65,11 +282,22 @@ namespace Planeverb
 		Real m_dt;									// seconds per sample
 		vec2 m_gridSize;							// grid size (in cells)
 		vec2 m_gridDimensions;						// grid size (in meters)
-		vec2 m_gridOffset;							// our grid uses only first quadrant, user uses all four, not currently implemented fully
-		unsigned m_responseLength;					// number of samples for an IR
+		vec2 m_gridOffset;							// our grid uses only first quadrant, user uses all four, world + offset is the grid position
+		vec2 m_initialOffset;						// offset the grid was created with
+		int m_shiftRows, m_shiftCols;				// cells the grid has moved from its initial offset
+		Real m_recenterDistance;					// listener distance from the center that moves the grid
+		unsigned m_responseLength;					// max number of samples for an IR
+		int m_simulatedSteps;						// number of samples of the last simulation, less with early termination
+		Real m_energyFloor;							// early termination energy ratio to the peak, 0 disables it
+		Real* m_stepEnergy;							// per thread energy of the last two time steps, a cache line each
 		unsigned m_samplingRate;					// samples per second
 		PlaneverbExecutionType m_executionType;		// use CPU or GPU (only CPU implemented so far)
+		PlaneverbAnalysisMode m_analysisMode;		// keep full responses or analyze them while simulating
 		unsigned m_maxThreads;						// thread usage
+		unsigned long long m_threadAffinityMask;	// cores the simulation threads are pinned to, 0 to not pin them
+		int m_threadPriority;						// priority of the simulation threads
+		int m_numThreads;							// resolved thread count used to partition the rows
+		int m_timeBlockSize;						// time steps per block, 1 disables temporal blocking
 		int m_resolution;							// grid resolution
 	};
 } // namespace Planeverb
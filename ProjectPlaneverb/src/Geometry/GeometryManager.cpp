@@ -3,9 +3,29 @@
 #include <FDTD\Grid.h>
 #include <Planeverb.h>
 #include <Context\PvContext.h>
+#include <Context\CommandQueue.h>
+#include <Util\ThreadUtil.h>
+
+#include <cstring>
 
 namespace Planeverb
 {
+	namespace
+	{
+		// AABBs are tracked as shapes of type pv_ShapeAABB, which the grid voxelizes as AABBs
+		PlaneShape ToShape(const AABB& box)
+		{
+			PlaneShape shape;
+			std::memset(&shape, 0, sizeof(PlaneShape));
+			shape.type = pv_ShapeAABB;
+			shape.position = box.position;
+			shape.width = box.width;
+			shape.height = box.height;
+			shape.absorption = box.absorption;
+			return shape;
+		}
+	} // namespace
+
 #pragma region ClientInterface
 	PlaneObjectID AddGeometry(const AABB* transform)
 	{
@@ -21,6 +41,20 @@ namespace Planeverb
 		}
 	}
 
+	PlaneObjectID AddGeometry(const PlaneShape* shape)
+	{
+		auto* context = GetContext();
+		if (context)
+		{
+			auto* man = context->GetGeometryManager();
+			return man->AddObject(shape);
+		}
+		else
+		{
+			return PV_INVALID_PLANE_OBJECT_ID;
+		}
+	}
+
 	void UpdateGeometry(PlaneObjectID id, const AABB* newTransform)
 	{
 		auto* context = GetContext();
@@ -31,6 +65,16 @@ namespace Planeverb
 		}
 	}
 
+	void UpdateGeometry(PlaneObjectID id, const PlaneShape* newShape)
+	{
+		auto* context = GetContext();
+		if (context)
+		{
+			auto* man = context->GetGeometryManager();
+			man->UpdateObject(id, newShape);
+		}
+	}
+
 	void RemoveGeometry(PlaneObjectID id)
 	{
 		auto* context = GetContext();
@@ -43,56 +87,96 @@ namespace Planeverb
 
 #pragma endregion
 
-	GeometryManager::GeometryManager(Grid * grid, char* mem) :
+	GeometryManager::GeometryManager(const PlaneverbConfig* config, Grid * grid, CommandQueue* commands, char* mem) :
 		m_geometry(), 
 		m_openSlots(), 
 		m_highestID(),
+		m_commands(commands),
+		m_gridGeometry(),
 		m_geometryChanges(),
-		m_mutex(),
-		m_gridPtr(grid)
+		m_gridPtr(grid),
+		m_voxelizer(),
+		m_voxelizerMutex(),
+		m_voxelizerSignal(),
+		m_voxelizing(false),
+		m_stopVoxelizer(false),
+		m_jobReplay(),
+		m_jobChanges()
 	{
 		// reserve some memory to avoid vector resizing
 		m_geometryChanges.reserve(20);
+
+		// the grid only has a back copy of the walls when voxelizing concurrently
+		if (m_gridPtr->HasBackGeometry())
+		{
+			m_jobReplay.reserve(20);
+			m_jobChanges.reserve(20);
+			const unsigned long long coreMask = config->threadAffinityMask;
+			const int priority = config->threadPriority;
+			m_voxelizer = std::thread([this, coreMask, priority]()
+			{
+				SetThreadCores(coreMask);
+				SetThreadPriorityLevel(priority);
+				VoxelizerProcessor();
+			});
+		}
 	}
 
 	GeometryManager::~GeometryManager()
 	{
+		// stop the voxelizer thread
+		if (m_voxelizer.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_voxelizerMutex);
+				m_stopVoxelizer = true;
+			}
+			m_voxelizerSignal.notify_all();
+			m_voxelizer.join();
+		}
+
 		// reset information
 		m_geometry.clear();
 		m_openSlots.clear();
+		m_gridGeometry.clear();
 		m_highestID = 0;
 		m_gridPtr = nullptr;
 	}
 
 	PlaneObjectID GeometryManager::AddObject(const AABB * box)
 	{
+		const PlaneShape shape = ToShape(*box);
+		return AddObject(&shape);
+	}
+
+	PlaneObjectID GeometryManager::AddObject(const PlaneShape * shape)
+	{
+		PlaneObjectID id;
+
 		// case no reusable slots left
 		if (m_openSlots.empty())
 		{
-			// add to list of current geometry
-			m_geometry.push_back(*box);
-
-			// lock to add to change queue
-			GLock lock(m_mutex);
-			m_geometryChanges.push_back({ ct_Add, *box });
-			return m_highestID++;
+			m_geometry.push_back(*shape);
+			id = m_highestID++;
 		}
 		// case reusable slot is available
 		else
 		{
-			// add to list of current geometry
-			auto id = m_openSlots.back();
+			id = m_openSlots.back();
 			m_openSlots.pop_back();
-			m_geometry[id] = *box;
-
-			// lock to add to change queue
-			GLock lock(m_mutex);
-			m_geometryChanges.push_back({ ct_Add, *box });
-			return id;
+			m_geometry[id] = *shape;
 		}
+
+		// add to list of current geometry and the change queue
+		Command command;
+		command.type = cmd_AddGeometry;
+		command.id = id;
+		command.shape = *shape;
+		m_commands->Push(command);
+		return id;
 	}
 
-	const AABB * GeometryManager::GetPlaneObject(PlaneObjectID id) const
+	const PlaneShape * GeometryManager::GetPlaneObject(PlaneObjectID id) const
 	{
 		PV_ASSERT(id != PV_INVALID_PLANE_OBJECT_ID);
 		return &(m_geometry[id]);
@@ -102,46 +186,143 @@ namespace Planeverb
 	{
 		PV_ASSERT(id != PV_INVALID_PLANE_OBJECT_ID);
 
-		// lock to add change to change queue
-		GLock lock(m_mutex);
-		m_geometryChanges.push_back({ ct_Remove, m_geometry[id] });
-		std::memset(&(m_geometry[id]), 0, sizeof(AABB));
+		// the background thread removes the object as the grid has it
+		Command command;
+		command.type = cmd_RemoveGeometry;
+		command.id = id;
+		m_commands->Push(command);
+		std::memset(&(m_geometry[id]), 0, sizeof(PlaneShape));
 		m_openSlots.push_back(id);
 	}
 
 	void GeometryManager::UpdateObject(PlaneObjectID id, const AABB * transform)
+	{
+		const PlaneShape shape = ToShape(*transform);
+		UpdateObject(id, &shape);
+	}
+
+	void GeometryManager::UpdateObject(PlaneObjectID id, const PlaneShape * shape)
 	{
 		PV_ASSERT(id != PV_INVALID_PLANE_OBJECT_ID);
 
-		// lock to add a remove and add to change queue
-		GLock lock(m_mutex);
-		m_geometryChanges.push_back({ ct_Remove, m_geometry[id] });
-		m_geometry[id] = *transform;
-		m_geometryChanges.push_back({ ct_Add, m_geometry[id] });
+		// queued as one command, the background thread moves the object as the grid has it
+		m_geometry[id] = *shape;
+		Command command;
+		command.type = cmd_UpdateGeometry;
+		command.id = id;
+		command.shape = *shape;
+		m_commands->Push(command);
 	}
 
-	void GeometryManager::PushGeometryChanges()
+	void GeometryManager::ApplyCommand(const Command& command)
 	{
-		// lock to process change queue
-		GLock lock(m_mutex);
-		size_t size = m_geometryChanges.size();
+		const PlaneObjectID id = command.id;
+		if (id >= m_gridGeometry.size())
+		{
+			m_gridGeometry.resize(id + 1);
+			std::memset(&m_gridGeometry[id], 0, sizeof(PlaneShape));
+		}
 
-		// for each change in the queue
-		for (size_t i = 0; i < size; ++i)
+		// removed objects are zero sized AABBs and add nothing
+		PlaneShape& shape = m_gridGeometry[id];
+		switch (command.type)
+		{
+		case cmd_AddGeometry:
+			shape = command.shape;
+			m_geometryChanges.push_back({ ct_Add, shape, shape });
+			break;
+		case cmd_UpdateGeometry:
+			// the grid only revoxelizes the cells that differ
+			m_geometryChanges.push_back({ ct_Update, command.shape, shape });
+			shape = command.shape;
+			break;
+		case cmd_RemoveGeometry:
+			m_geometryChanges.push_back({ ct_Remove, shape, shape });
+			std::memset(&shape, 0, sizeof(PlaneShape));
+			break;
+		default:
+			break;
+		}
+	}
+
+	void GeometryManager::ApplyChange(const GeometryChange& change)
+	{
+		// process change in the grid handle
+		switch (change.type)
 		{
-			// process change in the grid handle
-			GeometryChange& next = m_geometryChanges[i];
-			switch (next.type)
+		case ct_Add:
+			m_gridPtr->AddShape(&change.shape);
+			break;
+		case ct_Remove:
+			m_gridPtr->RemoveShape(&change.shape);
+			break;
+		case ct_Update:
+			m_gridPtr->UpdateShape(&change.previous, &change.shape);
+			break;
+		}
+	}
+
+	void GeometryManager::VoxelizerProcessor()
+	{
+		std::unique_lock<std::mutex> lock(m_voxelizerMutex);
+		while (true)
+		{
+			m_voxelizerSignal.wait(lock, [this]() { return m_voxelizing || m_stopVoxelizer; });
+			if (m_stopVoxelizer)
+				return;
+			lock.unlock();
+
+			// the back copy was simulated before the last swap, it catches up with the front copy first
+			for (const GeometryChange& change : m_jobReplay)
+				ApplyChange(change);
+			m_gridPtr->MatchFrontVersion();
+			for (const GeometryChange& change : m_jobChanges)
+				ApplyChange(change);
+
+			lock.lock();
+			m_voxelizing = false;
+			m_voxelizerSignal.notify_all();
+		}
+	}
+
+	void GeometryManager::WaitForVoxelizer()
+	{
+		std::unique_lock<std::mutex> lock(m_voxelizerMutex);
+		m_voxelizerSignal.wait(lock, [this]() { return !m_voxelizing; });
+	}
+
+	void GeometryManager::PushGeometryChanges()
+	{
+		if (m_gridPtr->HasBackGeometry())
+		{
+			{
+				// changes keep queueing while the last job is still running rather than stalling the simulation
+				std::lock_guard<std::mutex> lock(m_voxelizerMutex);
+				if (m_voxelizing)
+					return;
+			}
+
+			// the back copy matches the front copy unless the last job had changes
+			if (m_jobChanges.empty() && m_geometryChanges.empty())
+				return;
+
+			// the last job's changes are simulated from now on, the old front copy replays them before the new ones
+			m_gridPtr->SwapGeometry();
+			m_jobReplay.swap(m_jobChanges);
+			m_jobChanges.swap(m_geometryChanges);
+			m_geometryChanges.clear();
 			{
-			case ct_Add:
-				m_gridPtr->AddAABB(&next.aabb);
-				break;
-			case ct_Remove:
-				m_gridPtr->RemoveAABB(&next.aabb);
-				break;
+				std::lock_guard<std::mutex> lock(m_voxelizerMutex);
+				m_voxelizing = true;
 			}
+			m_voxelizerSignal.notify_all();
+			return;
 		}
 
+		// for each change in the queue
+		for (const GeometryChange& change : m_geometryChanges)
+			ApplyChange(change);
+
 		// clear change queue
 		m_geometryChanges.clear();
 
@@ -150,6 +331,59 @@ namespace Planeverb
 			m_gridPtr->PrintGrid();
 		#endif
 	}
+
+	void GeometryManager::FollowListener(const vec3& listenerPos)
+	{
+		int rows, cols;
+		if (!m_gridPtr->GetRecenterShift(listenerPos, rows, cols))
+			return;
+
+		// the moved walls are the back copy's, which needs every change the mirror has before it moves
+		const bool concurrent = m_gridPtr->HasBackGeometry();
+		if (concurrent)
+		{
+			WaitForVoxelizer();
+			for (const GeometryChange& change : m_geometryChanges)
+				ApplyChange(change);
+			m_geometryChanges.clear();
+		}
+
+		// objects are tracked in world space, so every object overlapping the new cells is added again
+		CellRect exposed[PV_MAX_EXPOSED_RECTS];
+		const int numExposed = m_gridPtr->MoveGrid(rows, cols, exposed);
+		for (const PlaneShape& shape : m_gridGeometry)
+		{
+			for (int i = 0; i < numExposed; ++i)
+			{
+				m_gridPtr->AddShape(&shape, exposed[i]);
+			}
+		}
+
+		// the move is simulated right away, both copies then have every change
+		if (concurrent)
+		{
+			m_gridPtr->SwapGeometry();
+			m_gridPtr->CopyFrontGeometry();
+			m_jobChanges.clear();
+		}
+	}
+
+	void GeometryManager::VoxelizeInto(Grid* grid)
+	{
+		// removed objects are zero sized and add nothing
+		for (const PlaneShape& shape : m_geometry)
+		{
+			grid->AddShape(&shape);
+		}
+
+		// the objects were added to the back copy of the walls
+		if (grid->HasBackGeometry())
+		{
+			grid->SwapGeometry();
+			grid->CopyFrontGeometry();
+		}
+	}
+
 	unsigned GeometryManager::GetMemoryRequirement(const PlaneverbConfig * config)
 	{
 		return 0;
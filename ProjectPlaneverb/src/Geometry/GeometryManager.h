@@ -2,25 +2,48 @@
 
 #include <PvTypes.h>
 #include <vector>
+#include <thread>
 #include <mutex>
+#include <condition_variable>
 
 namespace Planeverb
 {
 	// Forward declare
 	class Grid;
+	class CommandQueue;
+	struct Command;
 
+	// Geometry is tracked twice, the game thread's objects, which hand out IDs, and the objects the
+	// background thread has voxelized, which follow through the command queue
+	// with PlaneverbConfig::voxelizeConcurrently a helper thread voxelizes the changes into the grid's back copy
+	// of the walls while the background thread simulates the front copy
 	class GeometryManager
 	{
 	public:
-		GeometryManager(Grid* grid, char* mem);
+		GeometryManager(const PlaneverbConfig* config, Grid* grid, CommandQueue* commands, char* mem);
 		~GeometryManager();
+
+		// game thread
 		PlaneObjectID AddObject(const AABB* box);
-		const AABB* GetPlaneObject(PlaneObjectID id) const;
+		PlaneObjectID AddObject(const PlaneShape* shape);
+		const PlaneShape* GetPlaneObject(PlaneObjectID id) const;
 		void RemoveObject(PlaneObjectID id);
 		void UpdateObject(PlaneObjectID id, const AABB* transform);
+		void UpdateObject(PlaneObjectID id, const PlaneShape* shape);
+
+		// adds the game thread's geometry, including changes that weren't pushed yet, to another grid
+		void VoxelizeInto(Grid* grid);
 
+		// background thread, queues a popped geometry command for the next push
+		void ApplyCommand(const Command& command);
+
+		// hands the changes to the voxelizer thread when voxelizing concurrently, they're then simulated
+		// from the next push on, otherwise voxelizes them right away
 		void PushGeometryChanges();
 
+		// moves the grid once the listener strays from its center and voxelizes the cells it newly covers
+		void FollowListener(const vec3& listenerPos);
+
 		static unsigned GetMemoryRequirement(const struct PlaneverbConfig* config);
 
 	private:
@@ -29,22 +52,41 @@ namespace Planeverb
 		{
 			ct_Add,
 			ct_Remove,
+			ct_Update,
 		};
 
 		// Geometry change internal struct
 		struct GeometryChange
 		{
 			ChangeType type;
-			AABB aabb;
+			PlaneShape shape;
+			PlaneShape previous;	// shape before an update
 		};
 
-		std::vector<AABB> m_geometry;					// keep track of AABBs, object ID is index into vector
-		std::vector<PlaneObjectID> m_openSlots;			// list of open AABBs
+		void ApplyChange(const GeometryChange& change);
+
+		// voxelizer thread
+		void VoxelizerProcessor();
+		void WaitForVoxelizer();
+
+		// game thread
+		std::vector<PlaneShape> m_geometry;				// keep track of shapes, object ID is index into vector
+		std::vector<PlaneObjectID> m_openSlots;			// list of open shapes
 		PlaneObjectID m_highestID;						// next ID to dispense
+		CommandQueue* m_commands;						// changes for the background thread
 
+		// background thread
+		std::vector<PlaneShape> m_gridGeometry;			// objects as the grid has them, indexed by object ID
 		std::vector<GeometryChange> m_geometryChanges;	// queue of geometry changes to happen at the next sync point
-		std::mutex m_mutex;								// sync mutex
 		Grid* m_gridPtr;								// handle to the grid
-		using GLock = std::lock_guard<std::mutex>;		// ease of use typedef for lock_guard
+
+		// voxelizer thread, only started when voxelizing concurrently
+		std::thread m_voxelizer;						// edits the grid's back copy of the walls
+		std::mutex m_voxelizerMutex;					// guards the flags below
+		std::condition_variable m_voxelizerSignal;		// signals a new job, and the end of one
+		bool m_voxelizing;								// a job is running
+		bool m_stopVoxelizer;							// the thread exits
+		std::vector<GeometryChange> m_jobReplay;		// changes the front copy has and the back copy doesn't yet
+		std::vector<GeometryChange> m_jobChanges;		// changes neither copy has, simulated after the next push
 	};
 } // namespace Planeverb
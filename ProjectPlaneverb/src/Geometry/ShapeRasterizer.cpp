@@ -0,0 +1,139 @@
+#include <Geometry\ShapeRasterizer.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace Planeverb
+{
+	namespace
+	{
+		// floor of a cell coordinate clamped to [lo, hi], coordinates far outside the grid don't overflow
+		int ClampedFloor(Real value, int lo, int hi)
+		{
+			return (int)std::floor(std::min(std::max(value, (Real)lo), (Real)hi));
+		}
+	} // namespace
+
+	ShapeRasterizer::ShapeRasterizer(const CellRect& rect) :
+		m_numEdges(0),
+		m_nextEdge(0),
+		m_numActive(0),
+		m_bounds(rect),
+		m_rowBegin(rect.rowBegin),
+		m_rowEnd(std::max(rect.rowEnd, rect.rowBegin)),
+		m_isRect(true)
+	{
+	}
+
+	ShapeRasterizer::ShapeRasterizer(const vec2* vertices, unsigned numVertices, const CellRect& bounds) :
+		m_numEdges(0),
+		m_nextEdge(0),
+		m_numActive(0),
+		m_bounds(bounds),
+		m_rowBegin(bounds.rowBegin),
+		m_rowEnd(bounds.rowBegin),
+		m_isRect(false)
+	{
+		numVertices = std::min(numVertices, PV_MAX_SHAPE_VERTICES);
+		if (numVertices < 3)
+			return;
+
+		// row r samples the scanline u = r + 1, so rows [floor(min u), floor(max u)) can have cells
+		Real minU = vertices[0].x, maxU = vertices[0].x;
+		for (unsigned i = 1; i < numVertices; ++i)
+		{
+			minU = std::min(minU, vertices[i].x);
+			maxU = std::max(maxU, vertices[i].x);
+		}
+		m_rowBegin = std::max(ClampedFloor(minU, bounds.rowBegin - 1, bounds.rowEnd + 1), bounds.rowBegin);
+		m_rowEnd = std::max(std::min(ClampedFloor(maxU, bounds.rowBegin - 1, bounds.rowEnd + 1), bounds.rowEnd), m_rowBegin);
+
+		// an edge crosses the scanlines in (u0, u1], the same half open rule on every edge keeps the crossings paired
+		for (unsigned i = 0; i < numVertices; ++i)
+		{
+			const vec2& a = vertices[i];
+			const vec2& b = vertices[(i + 1) % numVertices];
+			if (a.x == b.x)
+				continue;
+
+			const vec2& lo = a.x < b.x ? a : b;
+			const vec2& hi = a.x < b.x ? b : a;
+			Edge edge;
+			edge.rowBegin = std::max(ClampedFloor(lo.x, m_rowBegin - 1, m_rowEnd + 1), m_rowBegin);
+			edge.rowEnd = std::min(ClampedFloor(hi.x, m_rowBegin - 1, m_rowEnd + 1), m_rowEnd);
+			if (edge.rowBegin >= edge.rowEnd)
+				continue;
+			edge.u = lo.x;
+			edge.v = lo.y;
+			edge.slope = (hi.y - lo.y) / (hi.x - lo.x);
+
+			// edge table sorted by first row
+			int j = m_numEdges++;
+			for (; j > 0 && m_edges[j - 1].rowBegin > edge.rowBegin; --j)
+				m_edges[j] = m_edges[j - 1];
+			m_edges[j] = edge;
+		}
+	}
+
+	int ShapeRasterizer::GetRowSpans(int row, CellSpan spans[PV_MAX_ROW_SPANS])
+	{
+		if (row < m_rowBegin || row >= m_rowEnd)
+			return 0;
+
+		if (m_isRect)
+		{
+			if (m_bounds.colBegin >= m_bounds.colEnd)
+				return 0;
+			spans[0] = CellSpan{ m_bounds.colBegin, m_bounds.colEnd };
+			return 1;
+		}
+
+		// retire the edges that ended, then activate the ones that start
+		int numActive = 0;
+		for (int i = 0; i < m_numActive; ++i)
+		{
+			if (m_edges[m_active[i]].rowEnd > row)
+				m_active[numActive++] = m_active[i];
+		}
+		m_numActive = numActive;
+		for (; m_nextEdge < m_numEdges && m_edges[m_nextEdge].rowBegin <= row; ++m_nextEdge)
+		{
+			if (m_edges[m_nextEdge].rowEnd > row)
+				m_active[m_numActive++] = m_nextEdge;
+		}
+
+		// sorted crossings of the scanline
+		const Real scanline = (Real)(row + 1);
+		Real crossings[PV_MAX_SHAPE_VERTICES];
+		for (int i = 0; i < m_numActive; ++i)
+		{
+			const Edge& edge = m_edges[m_active[i]];
+			const Real v = edge.v + (scanline - edge.u) * edge.slope;
+			int j = i;
+			for (; j > 0 && crossings[j - 1] > v; --j)
+				crossings[j] = crossings[j - 1];
+			crossings[j] = v;
+		}
+
+		// every pair of crossings bounds an inside stretch, touching spans are merged
+		int numSpans = 0;
+		for (int i = 0; i + 1 < m_numActive; i += 2)
+		{
+			const int colBegin = std::max(ToColumn(crossings[i]), m_bounds.colBegin);
+			const int colEnd = std::min(ToColumn(crossings[i + 1]), m_bounds.colEnd);
+			if (colBegin >= colEnd)
+				continue;
+			if (numSpans > 0 && spans[numSpans - 1].colEnd >= colBegin)
+				spans[numSpans - 1].colEnd = std::max(spans[numSpans - 1].colEnd, colEnd);
+			else
+				spans[numSpans++] = CellSpan{ colBegin, colEnd };
+		}
+		return numSpans;
+	}
+
+	int ShapeRasterizer::ToColumn(Real v) const
+	{
+		// column c samples v = c + 1, so a crossing at v starts the cells from floor(v)
+		return ClampedFloor(v, m_bounds.colBegin - 1, m_bounds.colEnd + 1);
+	}
+} // namespace Planeverb
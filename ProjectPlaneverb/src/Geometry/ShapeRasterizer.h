@@ -0,0 +1,56 @@
+#pragma once
+
+#include <PvTypes.h>
+#include <FDTD\Grid.h>	// CellRect
+
+namespace Planeverb
+{
+	// most column spans one row of a polygon can have
+	const constexpr int PV_MAX_ROW_SPANS = PV_MAX_SHAPE_VERTICES / 2;
+
+	// cells [colBegin, colEnd) of one row
+	struct CellSpan
+	{
+		int colBegin, colEnd;
+	};
+
+	// Scanline rasterizer, a cell is covered when its far corner (row + 1, col + 1) is inside the shape,
+	// so a rectangle covers the same cells Grid::GetCellRect gives an AABB
+	// rows are produced in increasing order from an active edge list, nothing is allocated
+	class ShapeRasterizer
+	{
+	public:
+		// every cell of a rectangle
+		explicit ShapeRasterizer(const CellRect& rect);
+
+		// polygon in cell units, (world + grid offset) / dx, with the even-odd rule, clipped to bounds
+		ShapeRasterizer(const vec2* vertices, unsigned numVertices, const CellRect& bounds);
+
+		// rows [GetRowBegin(), GetRowEnd()) may have cells
+		int GetRowBegin() const { return m_rowBegin; }
+		int GetRowEnd() const { return m_rowEnd; }
+
+		// sorted, disjoint spans of a row, rows must be asked for in increasing order, returns their count
+		int GetRowSpans(int row, CellSpan spans[PV_MAX_ROW_SPANS]);
+
+	private:
+		// polygon edge, only edges that aren't parallel to the rows are kept
+		struct Edge
+		{
+			int rowBegin, rowEnd;	// rows whose scanline crosses the edge
+			Real u, v;				// end with the lower row coordinate
+			Real slope;				// column change per row
+		};
+
+		int ToColumn(Real v) const;
+
+		Edge m_edges[PV_MAX_SHAPE_VERTICES];	// sorted by first row
+		int m_numEdges;
+		int m_nextEdge;							// first edge that wasn't active yet
+		int m_active[PV_MAX_SHAPE_VERTICES];	// edges crossing the last row
+		int m_numActive;
+		CellRect m_bounds;						// clip rectangle, or the rectangle itself
+		int m_rowBegin, m_rowEnd;
+		bool m_isRect;
+	};
+} // namespace Planeverb
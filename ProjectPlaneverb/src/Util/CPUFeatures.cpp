@@ -0,0 +1,46 @@
+#include <Util\CPUFeatures.h>
+
+#include <intrin.h>
+
+namespace Planeverb
+{
+	namespace
+	{
+		SimdLevel DetectSimdLevel()
+		{
+			int info[4];
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+
+			__cpuid(info, 1);
+			const bool hasSSE2 = (info[3] & (1 << 26)) != 0;
+			const bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+			const bool hasAVX = (info[2] & (1 << 28)) != 0;
+			if (!hasSSE2)
+				return simd_Scalar;
+
+			// wider registers are only usable if the OS saves them on context switches
+			if (!hasOSXSAVE || !hasAVX || maxLeaf < 7)
+				return simd_SSE;
+			const unsigned long long xcr0 = _xgetbv(0);
+			const bool osSavesYMM = (xcr0 & 0x6) == 0x6;
+			const bool osSavesZMM = (xcr0 & 0xe6) == 0xe6;
+
+			__cpuidex(info, 7, 0);
+			const bool hasAVX2 = (info[1] & (1 << 5)) != 0;
+			const bool hasAVX512F = (info[1] & (1 << 16)) != 0;
+
+			if (hasAVX512F && osSavesZMM)
+				return simd_AVX512;
+			if (hasAVX2 && osSavesYMM)
+				return simd_AVX2;
+			return simd_SSE;
+		}
+	} // namespace <>
+
+	SimdLevel GetSupportedSimdLevel()
+	{
+		static const SimdLevel level = DetectSimdLevel();
+		return level;
+	}
+} // namespace Planeverb
@@ -0,0 +1,17 @@
+#pragma once
+
+namespace Planeverb
+{
+	// SIMD instruction sets with a dedicated kernel, ordered from narrowest to widest
+	enum SimdLevel
+	{
+		simd_Scalar,
+		simd_SSE,		// SSE2, 4 lanes
+		simd_AVX2,		// AVX2, 8 lanes
+		simd_AVX512,	// AVX-512F, 16 lanes
+	};
+
+	// Detects the widest instruction set supported by both the CPU and the OS
+	// Result is computed once and cached
+	SimdLevel GetSupportedSimdLevel();
+} // namespace Planeverb
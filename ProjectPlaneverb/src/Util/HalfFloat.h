@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace Planeverb
+{
+	// IEEE 754 half precision conversion, round to nearest even, saturates to the largest finite half
+	inline std::uint16_t FloatToHalf(float value)
+	{
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+
+		const std::uint16_t sign = (std::uint16_t)((bits >> 16) & 0x8000u);
+		const std::uint32_t absBits = bits & 0x7fffffffu;
+
+		// NaN, infinity and anything rounding past 65504 saturate
+		if (absBits >= 0x477ff000u)
+			return sign | 0x7bffu;
+
+		// normal halves, rebias the exponent and round the mantissa
+		if (absBits >= 0x38800000u)
+		{
+			const std::uint32_t rounded = absBits + 0xfffu + ((absBits >> 13) & 1u);
+			return sign | (std::uint16_t)((rounded - 0x38000000u) >> 13);
+		}
+
+		// subnormal halves, shift the mantissa with its implicit bit into place
+		if (absBits >= 0x33000000u)
+		{
+			const std::uint32_t exponent = absBits >> 23;
+			const std::uint32_t mantissa = (absBits & 0x7fffffu) | 0x800000u;
+			const std::uint32_t shift = 126u - exponent;
+			const std::uint32_t halfway = 1u << (shift - 1);
+			const std::uint32_t remainder = mantissa & ((1u << shift) - 1u);
+			std::uint32_t result = mantissa >> shift;
+			if (remainder > halfway || (remainder == halfway && (result & 1u)))
+				++result;
+			return sign | (std::uint16_t)result;
+		}
+
+		// underflows to zero
+		return sign;
+	}
+
+	inline float HalfToFloat(std::uint16_t half)
+	{
+		const std::uint32_t sign = (std::uint32_t)(half & 0x8000u) << 16;
+		const std::uint32_t exponent = (half >> 10) & 0x1fu;
+		std::uint32_t mantissa = half & 0x3ffu;
+		std::uint32_t bits;
+
+		if (exponent == 0)
+		{
+			if (mantissa == 0)
+			{
+				bits = sign;
+			}
+			else
+			{
+				// subnormal, normalize into a float
+				int e = -1;
+				do
+				{
+					++e;
+					mantissa <<= 1;
+				} while (!(mantissa & 0x400u));
+				bits = sign | ((std::uint32_t)(112 - e) << 23) | ((mantissa & 0x3ffu) << 13);
+			}
+		}
+		else if (exponent == 0x1f)
+		{
+			bits = sign | 0x7f800000u | (mantissa << 13);
+		}
+		else
+		{
+			bits = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+		}
+
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+} // namespace Planeverb
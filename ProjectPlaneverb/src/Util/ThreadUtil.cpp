@@ -0,0 +1,82 @@
+#include <Util\ThreadUtil.h>
+
+// keep std::min and std::max usable
+#define NOMINMAX
+#include <Windows.h>
+#include <omp.h>
+#include <thread>
+#include <algorithm>
+
+namespace Planeverb
+{
+	int GetThreadCount(unsigned maxThreadUsage)
+	{
+		if (maxThreadUsage == 0)
+			return omp_get_max_threads();
+		return (int)maxThreadUsage;
+	}
+
+	size_t PinCurrentThread(unsigned core)
+	{
+		// affinity masks only cover the first 64 logical cores
+		unsigned numCores = std::thread::hardware_concurrency();
+		if (numCores == 0 || numCores > 64)
+			numCores = 64;
+		DWORD_PTR mask = (DWORD_PTR)1 << (core % numCores);
+		return (size_t)SetThreadAffinityMask(GetCurrentThread(), mask);
+	}
+
+	void RestoreThreadAffinity(size_t mask)
+	{
+		// a zero mask means pinning failed, nothing to restore
+		if (mask)
+			SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask);
+	}
+
+	unsigned GetThreadCore(unsigned thread, unsigned long long coreMask)
+	{
+		if (coreMask == 0)
+			return thread;
+
+		// threads past the number of cores in the mask wrap around
+		unsigned numCores = 0;
+		for (unsigned long long bits = coreMask; bits; bits &= bits - 1)
+			++numCores;
+		unsigned index = thread % numCores;
+		for (unsigned core = 0; core < 64; ++core)
+		{
+			if ((coreMask >> core) & 1ull)
+			{
+				if (index == 0)
+					return core;
+				--index;
+			}
+		}
+		return thread;
+	}
+
+	void SetThreadCores(unsigned long long coreMask)
+	{
+		if (coreMask)
+			SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)coreMask);
+	}
+
+	void SetThreadPriorityLevel(int priority)
+	{
+		// THREAD_PRIORITY_LOWEST to THREAD_PRIORITY_HIGHEST are -2 to 2
+		priority = std::min(std::max(priority, THREAD_PRIORITY_LOWEST), THREAD_PRIORITY_HIGHEST);
+		SetThreadPriority(GetCurrentThread(), priority);
+	}
+
+	double GetThreadCpuSeconds()
+	{
+		FILETIME creation, exit, kernel, user;
+		if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+			return 0.0;
+
+		// FILETIMEs count 100 nanosecond intervals
+		const unsigned long long kernelTicks = ((unsigned long long)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+		const unsigned long long userTicks = ((unsigned long long)user.dwHighDateTime << 32) | user.dwLowDateTime;
+		return (double)(kernelTicks + userTicks) * 1e-7;
+	}
+} // namespace Planeverb
@@ -0,0 +1,25 @@
+#pragma once
+
+namespace Planeverb
+{
+	// Resolve the config's maxThreadUsage into a thread count, 0 means as many as possible
+	int GetThreadCount(unsigned maxThreadUsage);
+
+	// Pins the calling thread to a single logical core, returns the previous affinity mask
+	size_t PinCurrentThread(unsigned core);
+
+	// Restores an affinity mask returned by PinCurrentThread
+	void RestoreThreadAffinity(size_t mask);
+
+	// Logical core of a simulation thread, the thread-th core set in coreMask, or core thread if the mask is 0
+	unsigned GetThreadCore(unsigned thread, unsigned long long coreMask);
+
+	// Restricts the calling thread to the cores of a mask, 0 leaves it unchanged
+	void SetThreadCores(unsigned long long coreMask);
+
+	// Sets the calling thread's priority, -2 lowest to 2 highest
+	void SetThreadPriorityLevel(int priority);
+
+	// CPU time the calling thread has run for, user and kernel, in seconds
+	double GetThreadCpuSeconds();
+} // namespace Planeverb
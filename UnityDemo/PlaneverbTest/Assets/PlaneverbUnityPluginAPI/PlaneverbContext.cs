@@ -16,6 +16,15 @@ namespace Planeverb
 		public float sourceDirectionY;
 	}
 
+	// matches Planeverb::PlaneShapeType
+	public enum PlaneShapeType
+	{
+		AABB,
+		OrientedBox,
+		Polygon,
+		Segment
+	}
+
 	[AddComponentMenu("Planeverb/PlaneverbContext")]
 	public class PlaneverbContext : MonoBehaviour
 	{
@@ -36,12 +45,18 @@ namespace Planeverb
 		[DllImport(DLLNAME)]
 		private static extern void PlaneverbUpdateEmission(int id, float x, float y, float z);
 
+		[DllImport(DLLNAME)]
+		private static extern void PlaneverbUpdateEmissions(int[] ids, float[] x, float[] y, float[] z, int count);
+
 		[DllImport(DLLNAME)]
 		private static extern void PlaneverbEndEmission(int id);
 
 		[DllImport(DLLNAME)]
 		private static extern PlaneverbOutput PlaneverbGetOutput(int emissionID);
 
+		[DllImport(DLLNAME)]
+		private static extern void PlaneverbGetOutputs(int[] emissionIDs, [Out] PlaneverbOutput[] outputs, int count);
+
 		[DllImport(DLLNAME)]
 		private static extern int PlaneverbAddGeometry(float posX, float posY,
 		float width, float height,
@@ -53,6 +68,18 @@ namespace Planeverb
 		float width, float height,
 		float absorption);
 
+		[DllImport(DLLNAME)]
+		private static extern int PlaneverbAddShape(int type, float posX, float posY,
+		float width, float height, float rotation,
+		float[] vertices, int numVertices,
+		float absorption);
+
+		[DllImport(DLLNAME)]
+		private static extern void PlaneverbUpdateShape(int id, int type, float posX, float posY,
+		float width, float height, float rotation,
+		float[] vertices, int numVertices,
+		float absorption);
+
 		[DllImport(DLLNAME)]
 		private static extern void PlaneverbRemoveGeometry(int id);
 
@@ -98,6 +125,12 @@ namespace Planeverb
 			PlaneverbUpdateEmission(id, pos.x, pos.y, pos.z);
 		}
 
+		// x, y and z hold the positions of the count first ids
+		public static void UpdateEmissions(int[] ids, float[] x, float[] y, float[] z, int count)
+		{
+			PlaneverbUpdateEmissions(ids, x, y, z, count);
+		}
+
 		public static void EndEmission(int id)
 		{
 			PlaneverbEndEmission(id);
@@ -115,6 +148,36 @@ namespace Planeverb
 				aabb.width, aabb.height, aabb.absorption);
 		}
 
+		// rotated boxes use position, width, height and rotation in radians, polygons (up to 16 vertices) and
+		// segments use the x/z vertices, segments are width meters thick
+		public static int AddShape(PlaneShapeType type, Vector2 position, float width, float height,
+			float rotation, Vector2[] vertices, float absorption)
+		{
+			float[] xy = FlattenVertices(vertices);
+			return PlaneverbAddShape((int)type, position.x, position.y, width, height, rotation,
+				xy, xy.Length / 2, absorption);
+		}
+
+		public static void UpdateShape(int id, PlaneShapeType type, Vector2 position, float width, float height,
+			float rotation, Vector2[] vertices, float absorption)
+		{
+			float[] xy = FlattenVertices(vertices);
+			PlaneverbUpdateShape(id, (int)type, position.x, position.y, width, height, rotation,
+				xy, xy.Length / 2, absorption);
+		}
+
+		private static float[] FlattenVertices(Vector2[] vertices)
+		{
+			int count = vertices == null ? 0 : vertices.Length;
+			float[] xy = new float[count * 2];
+			for (int i = 0; i < count; ++i)
+			{
+				xy[2 * i] = vertices[i].x;
+				xy[2 * i + 1] = vertices[i].y;
+			}
+			return xy;
+		}
+
 		public static void RemoveGeometry(int id)
 		{
 			PlaneverbRemoveGeometry(id);
@@ -129,6 +192,12 @@ namespace Planeverb
 		{
 			return PlaneverbGetOutput(emissionID);
 		}
+
+		// fills outputs with the outputs of the count first emission IDs, e.g. of every emitter once per audio block
+		public static void GetOutputs(int[] emissionIDs, PlaneverbOutput[] outputs, int count)
+		{
+			PlaneverbGetOutputs(emissionIDs, outputs, count);
+		}
 		#endregion
 	}
 }
\ No newline at end of file